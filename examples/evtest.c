@@ -26,20 +26,21 @@ int main() {
 	ptp_device_info_json(&di, temp, sizeof(temp));
 	printf("%s\n", temp);
 
-	int length = 0;
-	struct PtpGenericEvent *s = NULL;
 	if (ptp_device_type(&r) == PTP_DEV_EOS) {
 		ptp_eos_set_remote_mode(&r, 1);
 		ptp_eos_set_event_mode(&r, 1);
 
 		int rc = ptp_eos_get_event(&r);
 		if (rc) return rc;
-		length = ptp_eos_events(&r, &s);
 
-		for (int i = 0; i < length; i++) {
-			if (s[i].code == 0) continue;
-			printf("%X = %X\n", s[i].code, s[i].value);
+		struct PtpEventReader e;
+		struct PtpGenericEvent ev;
+		ptp_eos_events_open(&r, &e);
+		while (ptp_eos_events_next(&r, &e, &ev) == 1) {
+			if (ev.code == 0) continue;
+			printf("%X = %X\n", ev.code, ev.value);
 		}
+		ptp_eos_events_close(&r, &e);
 	}
 
 	ptp_device_close(&r);
@@ -0,0 +1,383 @@
+// Asynchronous command queue, run by one I/O worker thread per runtime
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <camlib.h>
+#include <ptp.h>
+
+struct PtpAsync {
+	pthread_t thread;
+	pthread_mutex_t lock;
+	// Signaled when a request is queued, or the worker should stop
+	pthread_cond_t queued;
+	// Signaled when a request is finished
+	pthread_cond_t finished;
+	int stop;
+	// Threads inside ptp_async_* other than the worker, see async_get
+	int users;
+
+	// One FIFO per enum PtpAsyncPriority
+	struct PtpAsyncRequest *head[PTP_PRIO_COUNT];
+	struct PtpAsyncRequest *tail[PTP_PRIO_COUNT];
+};
+
+// Guards r->async and PtpAsync.users, so ptp_async_stop can't free the queue while
+// another thread is still waiting on it
+static pthread_mutex_t users_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t users_done = PTHREAD_COND_INITIALIZER;
+
+// Take a reference on the runtime's queue, NULL if there is no worker. Release with async_put.
+static struct PtpAsync *async_get(struct PtpRuntime *r) {
+	pthread_mutex_lock(&users_lock);
+	struct PtpAsync *a = r->async;
+	if (a != NULL) a->users++;
+	pthread_mutex_unlock(&users_lock);
+	return a;
+}
+
+static void async_put(struct PtpAsync *a) {
+	pthread_mutex_lock(&users_lock);
+	if (--a->users == 0) pthread_cond_broadcast(&users_done);
+	pthread_mutex_unlock(&users_lock);
+}
+
+static void enqueue(struct PtpAsync *a, struct PtpAsyncRequest *req) {
+	int p = req->priority;
+	req->next = NULL;
+	if (a->tail[p] == NULL) {
+		a->head[p] = req;
+	} else {
+		a->tail[p]->next = req;
+	}
+	a->tail[p] = req;
+}
+
+// Oldest request of the most urgent class
+static struct PtpAsyncRequest *dequeue(struct PtpAsync *a) {
+	for (int p = 0; p < PTP_PRIO_COUNT; p++) {
+		struct PtpAsyncRequest *req = a->head[p];
+		if (req == NULL) continue;
+		a->head[p] = req->next;
+		if (a->head[p] == NULL) a->tail[p] = NULL;
+		return req;
+	}
+
+	return NULL;
+}
+
+static int has_data_phase(struct PtpRuntime *r) {
+	if (r->connection_type == PTP_IP) {
+		struct PtpIpHeader *h = (struct PtpIpHeader *)(r->data);
+		return h->type == PTPIP_DATA_PACKET_START;
+	} else {
+		struct PtpBulkContainer *c = (struct PtpBulkContainer *)(r->data);
+		return c->type == PTP_PACKET_TYPE_DATA;
+	}
+}
+
+static void finish_request(struct PtpAsync *a, struct PtpAsyncRequest *req, int rc) {
+	pthread_mutex_lock(&a->lock);
+	req->rc = rc;
+	req->done = 1;
+	pthread_cond_broadcast(&a->finished);
+	pthread_mutex_unlock(&a->lock);
+}
+
+// Run one chunk of a download. Returns 1 if there is more to get.
+static int download_step(struct PtpRuntime *r, struct PtpAsyncRequest *req, int *rc) {
+	*rc = ptp_get_partial_object(r, req->handle, (int)req->offset, req->chunk_size);
+	if (*rc) return 0;
+
+	int length = has_data_phase(r) ? ptp_get_payload_length(r) : 0;
+	if (length > 0 && req->sink(r, req->sink_arg, ptp_get_payload(r), length)) {
+		*rc = PTP_CANCELED;
+		return 0;
+	}
+
+	req->offset += length;
+	return length == req->chunk_size;
+}
+
+static void run_request(struct PtpRuntime *r, struct PtpAsync *a, struct PtpAsyncRequest *req) {
+	// Keep the runtime locked past the transaction, so r->data is still ours in the callback
+	ptp_mutex_keep_locked(r);
+
+	int rc;
+	if (req->fn != NULL) {
+		rc = req->fn(r, req->fn_arg);
+	} else if (req->sink != NULL) {
+		if (download_step(r, req, &rc)) {
+			ptp_mutex_unlock(r);
+			// Back of the line, anything more urgent goes first
+			pthread_mutex_lock(&a->lock);
+			enqueue(a, req);
+			pthread_mutex_unlock(&a->lock);
+			return;
+		}
+	} else if (req->data == NULL) {
+		rc = ptp_send(r, &req->cmd);
+	} else {
+		rc = ptp_send_data(r, &req->cmd, req->data, req->data_length);
+	}
+
+	// A failed transaction drops every lock level (ptp_mutex_unlock_thread), so the
+	// response and payload would be read unlocked. Hold exactly one level again.
+	if (rc) {
+		ptp_mutex_unlock_thread(r);
+		ptp_mutex_keep_locked(r);
+	}
+
+	if (req->fn == NULL && (rc == 0 || rc == PTP_CHECK_CODE)) {
+		req->code = ptp_get_return_code(r);
+	}
+
+	if (req->callback != NULL) {
+		req->rc = rc;
+		req->done = 1;
+		req->callback(r, req, req->arg);
+		ptp_mutex_unlock(r);
+		ptp_async_free(req);
+		return;
+	}
+
+	if (rc == 0 && req->fn == NULL && req->sink == NULL && has_data_phase(r)) {
+		int length = ptp_get_payload_length(r);
+		req->payload = malloc(length);
+		if (req->payload == NULL) {
+			rc = PTP_OUT_OF_MEM;
+		} else {
+			memcpy(req->payload, ptp_get_payload(r), length);
+			req->payload_length = length;
+		}
+	}
+
+	ptp_mutex_unlock(r);
+	finish_request(a, req, rc);
+}
+
+static void *async_worker(void *arg) {
+	struct PtpRuntime *r = (struct PtpRuntime *)arg;
+	struct PtpAsync *a = r->async;
+
+	while (1) {
+		pthread_mutex_lock(&a->lock);
+		struct PtpAsyncRequest *req = NULL;
+		while (!a->stop && (req = dequeue(a)) == NULL) {
+			pthread_cond_wait(&a->queued, &a->lock);
+		}
+
+		if (a->stop) {
+			// Put it back so it gets canceled with the rest
+			if (req != NULL) enqueue(a, req);
+			pthread_mutex_unlock(&a->lock);
+			break;
+		}
+		pthread_mutex_unlock(&a->lock);
+
+		run_request(r, a, req);
+	}
+
+	return NULL;
+}
+
+int ptp_async_start(struct PtpRuntime *r) {
+	if (r->async != NULL) return 0;
+
+	struct PtpAsync *a = calloc(1, sizeof(struct PtpAsync));
+	if (a == NULL) return PTP_OUT_OF_MEM;
+
+	pthread_mutex_init(&a->lock, NULL);
+	pthread_cond_init(&a->queued, NULL);
+	pthread_cond_init(&a->finished, NULL);
+
+	pthread_mutex_lock(&users_lock);
+	r->async = a;
+	pthread_mutex_unlock(&users_lock);
+	if (pthread_create(&a->thread, NULL, async_worker, r)) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_CORE, "Failed to start I/O worker\n");
+		pthread_mutex_lock(&users_lock);
+		r->async = NULL;
+		pthread_mutex_unlock(&users_lock);
+		pthread_cond_destroy(&a->finished);
+		pthread_cond_destroy(&a->queued);
+		pthread_mutex_destroy(&a->lock);
+		free(a);
+		return PTP_RUNTIME_ERR;
+	}
+
+	return 0;
+}
+
+void ptp_async_stop(struct PtpRuntime *r) {
+	struct PtpAsync *a = async_get(r);
+	if (a == NULL) return;
+
+	pthread_mutex_lock(&a->lock);
+	if (a->stop) {
+		// Someone else is already stopping it
+		pthread_mutex_unlock(&a->lock);
+		async_put(a);
+		return;
+	}
+	a->stop = 1;
+	pthread_cond_broadcast(&a->queued);
+	pthread_mutex_unlock(&a->lock);
+	async_put(a);
+
+	pthread_join(a->thread, NULL);
+
+	// Whatever didn't get to run is canceled
+	struct PtpAsyncRequest *req;
+	while ((req = dequeue(a)) != NULL) {
+		if (req->callback != NULL) {
+			req->rc = PTP_CANCELED;
+			req->done = 1;
+			req->callback(r, req, req->arg);
+			ptp_async_free(req);
+		} else {
+			finish_request(a, req, PTP_CANCELED);
+		}
+	}
+
+	// Threads woken by finish_request still have to get back out of a->lock
+	pthread_mutex_lock(&users_lock);
+	r->async = NULL;
+	while (a->users != 0) {
+		pthread_cond_wait(&users_done, &users_lock);
+	}
+	pthread_mutex_unlock(&users_lock);
+
+	pthread_cond_destroy(&a->finished);
+	pthread_cond_destroy(&a->queued);
+	pthread_mutex_destroy(&a->lock);
+	free(a);
+}
+
+static struct PtpAsyncRequest *new_request(int priority, ptp_async_callback *callback, void *arg) {
+	if (priority < 0 || priority >= PTP_PRIO_COUNT) return NULL;
+
+	struct PtpAsyncRequest *req = calloc(1, sizeof(struct PtpAsyncRequest));
+	if (req == NULL) return NULL;
+
+	req->priority = priority;
+	req->callback = callback;
+	req->arg = arg;
+	return req;
+}
+
+// Consumes the reference from async_get
+static struct PtpAsyncRequest *submit(struct PtpAsync *a, struct PtpAsyncRequest *req) {
+	pthread_mutex_lock(&a->lock);
+	if (a->stop) {
+		// Too late, nothing would ever run or cancel it
+		pthread_mutex_unlock(&a->lock);
+		async_put(a);
+		ptp_async_free(req);
+		return NULL;
+	}
+	enqueue(a, req);
+	pthread_cond_signal(&a->queued);
+	pthread_mutex_unlock(&a->lock);
+
+	async_put(a);
+	return req;
+}
+
+struct PtpAsyncRequest *ptp_async_submit_priority(struct PtpRuntime *r, int priority, struct PtpCommand *cmd, void *data, int length, ptp_async_callback *callback, void *arg) {
+	struct PtpAsync *a = async_get(r);
+	if (a == NULL) return NULL;
+
+	struct PtpAsyncRequest *req = new_request(priority, callback, arg);
+	if (req == NULL) {
+		async_put(a);
+		return NULL;
+	}
+
+	memcpy(&req->cmd, cmd, sizeof(struct PtpCommand));
+
+	if (data != NULL) {
+		req->data = malloc(length);
+		if (req->data == NULL) {
+			free(req);
+			async_put(a);
+			return NULL;
+		}
+		memcpy(req->data, data, length);
+		req->data_length = length;
+	}
+
+	return submit(a, req);
+}
+
+struct PtpAsyncRequest *ptp_async_submit(struct PtpRuntime *r, struct PtpCommand *cmd, void *data, int length, ptp_async_callback *callback, void *arg) {
+	return ptp_async_submit_priority(r, PTP_PRIO_CONTROL, cmd, data, length, callback, arg);
+}
+
+struct PtpAsyncRequest *ptp_async_call(struct PtpRuntime *r, int priority, ptp_async_fn *fn, void *fn_arg, ptp_async_callback *callback, void *arg) {
+	struct PtpAsync *a = async_get(r);
+	if (a == NULL) return NULL;
+
+	struct PtpAsyncRequest *req = new_request(priority, callback, arg);
+	if (req == NULL) {
+		async_put(a);
+		return NULL;
+	}
+
+	req->fn = fn;
+	req->fn_arg = fn_arg;
+
+	return submit(a, req);
+}
+
+struct PtpAsyncRequest *ptp_async_download(struct PtpRuntime *r, uint32_t handle, int chunk_size, ptp_data_sink *sink, void *sink_arg, ptp_async_callback *callback, void *arg) {
+	if (chunk_size <= 0) return NULL;
+	struct PtpAsync *a = async_get(r);
+	if (a == NULL) return NULL;
+
+	struct PtpAsyncRequest *req = new_request(PTP_PRIO_BULK, callback, arg);
+	if (req == NULL) {
+		async_put(a);
+		return NULL;
+	}
+
+	req->cmd.code = PTP_OC_GetPartialObject;
+	req->handle = handle;
+	req->chunk_size = chunk_size;
+	req->sink = sink;
+	req->sink_arg = sink_arg;
+
+	return submit(a, req);
+}
+
+int ptp_async_poll(struct PtpRuntime *r, struct PtpAsyncRequest *req) {
+	struct PtpAsync *a = async_get(r);
+	if (a == NULL) return req->done;
+
+	pthread_mutex_lock(&a->lock);
+	int done = req->done;
+	pthread_mutex_unlock(&a->lock);
+	async_put(a);
+	return done;
+}
+
+int ptp_async_wait(struct PtpRuntime *r, struct PtpAsyncRequest *req) {
+	struct PtpAsync *a = async_get(r);
+	if (a == NULL) return req->rc;
+
+	pthread_mutex_lock(&a->lock);
+	while (!req->done) {
+		pthread_cond_wait(&a->finished, &a->lock);
+	}
+	int rc = req->rc;
+	pthread_mutex_unlock(&a->lock);
+	async_put(a);
+	return rc;
+}
+
+void ptp_async_free(struct PtpAsyncRequest *req) {
+	free(req->data);
+	free(req->payload);
+	free(req);
+}
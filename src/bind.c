@@ -51,7 +51,7 @@ int bind_init(struct BindReq *bind, struct PtpRuntime *r) {
 
 int bind_connect(struct BindReq *bind, struct PtpRuntime *r) {
 	// Sanity check if uninitialized
-	if (r->data_length != CAMLIB_DEFAULT_SIZE) {
+	if (r->data == NULL || r->data_length < CAMLIB_DEFAULT_SIZE) {
 		return sprintf(bind->buffer, "{\"error\": %d}", PTP_OUT_OF_MEM);
 	}
 
@@ -181,11 +181,10 @@ int bind_custom(struct BindReq *bind, struct PtpRuntime *r) {
 }
 
 int bind_drive_lens(struct BindReq *bind, struct PtpRuntime *r) {
-	int x;
-	if (ptp_device_type(r) == PTP_DEV_EOS) {
-		x = ptp_eos_drive_lens(r, bind->params[0]);
-	} else {
-		x = PTP_UNSUPPORTED;
+	const struct PtpVendorOps *ops = ptp_get_profile(r)->ops;
+	int x = PTP_UNSUPPORTED;
+	if (ops->drive_lens != NULL) {
+		x = ops->drive_lens(r, bind->params[0]);
 	}
 
 	return sprintf(bind->buffer, "{\"error\": %d}", x);
@@ -248,16 +247,11 @@ int bind_ml_get_bmp_lv(struct BindReq *bind, struct PtpRuntime *r) {
 }
 
 int bind_set_property(struct BindReq *bind, struct PtpRuntime *r) {
-	int dev = ptp_device_type(r);
 	int x = 0;
 
 	// Set a raw property value
 	if (strlen(bind->string) == 0) {
-		if (dev == PTP_DEV_EOS) {
-			x = ptp_eos_set_prop_value(r, bind->params[0], bind->params[1]);
-		} else {
-			x = ptp_set_prop_value(r, bind->params[0], bind->params[1]);
-		}
+		x = ptp_get_profile(r)->ops->set_prop_value(r, bind->params[0], bind->params[1]);
 		return sprintf(bind->buffer, "{\"error\": %d}", x);
 	}
 
@@ -267,9 +261,7 @@ int bind_set_property(struct BindReq *bind, struct PtpRuntime *r) {
 }
 
 int bind_get_events(struct BindReq *bind, struct PtpRuntime *r) {
-	int dev = ptp_device_type(r);
-
-	if (dev == PTP_DEV_EOS) {
+	if (ptp_get_profile(r)->event_method == PTP_EVENTS_EOS) {
 		int x = ptp_eos_get_event(r);
 		if (x) return sprintf(bind->buffer, "{\"error\": %d}", x);
 
@@ -294,8 +286,7 @@ int bind_get_events(struct BindReq *bind, struct PtpRuntime *r) {
 }
 
 int bind_get_all_props(struct BindReq *bind, struct PtpRuntime *r) {
-	int dev = ptp_device_type(r);
-	if (dev == PTP_DEV_EOS) {
+	if (ptp_get_profile(r)->event_method == PTP_EVENTS_EOS) {
 		return bind_get_events(bind, r);
 	} else {
 		return sprintf(bind->buffer, "{\"error\": 0, \"resp\": []}");
@@ -371,28 +362,20 @@ int bind_get_status(struct BindReq *bind, struct PtpRuntime *r) {
 }
 
 int bind_bulb_start(struct BindReq *bind, struct PtpRuntime *r) {
-	int x = 0;
-	if (ptp_device_type(r) == PTP_DEV_EOS) {
-		x = ptp_eos_remote_release_on(r, 1);
-		if (ptp_get_return_code(r) != PTP_RC_OK) return sprintf(bind->buffer, "{\"error\": %d}", PTP_CHECK_CODE);
-		x = ptp_eos_remote_release_on(r, 2);
-		if (ptp_get_return_code(r) != PTP_RC_OK) return sprintf(bind->buffer, "{\"error\": %d}", PTP_CHECK_CODE);
-	} else {
-		x = PTP_UNSUPPORTED;
+	const struct PtpVendorOps *ops = ptp_get_profile(r)->ops;
+	int x = PTP_UNSUPPORTED;
+	if (ops->bulb_start != NULL) {
+		x = ops->bulb_start(r);
 	}
 
 	return sprintf(bind->buffer, "{\"error\": %d}", x);
 }
 
 int bind_bulb_stop(struct BindReq *bind, struct PtpRuntime *r) {
-	int x = 0;
-	if (ptp_device_type(r) == PTP_DEV_EOS) {
-		x = ptp_eos_remote_release_off(r, 2);
-		if (ptp_get_return_code(r) != PTP_RC_OK) return sprintf(bind->buffer, "{\"error\": %d}", PTP_CHECK_CODE);
-		x = ptp_eos_remote_release_off(r, 1);
-		if (ptp_get_return_code(r) != PTP_RC_OK) return sprintf(bind->buffer, "{\"error\": %d}", PTP_CHECK_CODE);
-	} else {
-		x = PTP_UNSUPPORTED;
+	const struct PtpVendorOps *ops = ptp_get_profile(r)->ops;
+	int x = PTP_UNSUPPORTED;
+	if (ops->bulb_stop != NULL) {
+		x = ops->bulb_stop(r);
 	}
 
 	return sprintf(bind->buffer, "{\"error\": %d}", x);
@@ -419,22 +402,20 @@ int bind_cancel_af(struct BindReq *bind, struct PtpRuntime *r) {
 }
 
 int bind_mirror_up(struct BindReq *bind, struct PtpRuntime *r) {
-	int x = 0;
-	if (ptp_device_type(r) == PTP_DEV_EOS) {
-		x = ptp_eos_set_prop_value(r, PTP_PC_EOS_VF_Output, 3);
-	} else {
-		x = PTP_UNSUPPORTED;
+	const struct PtpVendorOps *ops = ptp_get_profile(r)->ops;
+	int x = PTP_UNSUPPORTED;
+	if (ops->set_mirror != NULL) {
+		x = ops->set_mirror(r, 1);
 	}
 
 	return sprintf(bind->buffer, "{\"error\": %d}", x);
 }
 
 int bind_mirror_down(struct BindReq *bind, struct PtpRuntime *r) {
-	int x = 0;
-	if (ptp_device_type(r) == PTP_DEV_EOS) {
-		x = ptp_eos_set_prop_value(r, PTP_PC_EOS_VF_Output, 0);
-	} else {
-		x = PTP_UNSUPPORTED;
+	const struct PtpVendorOps *ops = ptp_get_profile(r)->ops;
+	int x = PTP_UNSUPPORTED;
+	if (ops->set_mirror != NULL) {
+		x = ops->set_mirror(r, 0);
 	}
 
 	return sprintf(bind->buffer, "{\"error\": %d}", x);
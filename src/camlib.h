@@ -27,9 +27,63 @@
 void ptp_verbose_log(char *fmt, ...);
 __attribute__ ((noreturn)) void ptp_panic(char *fmt, ...);
 
+/// @brief Log levels, a message is kept if its level is <= the configured level
+enum PtpLogLevel {
+	PTP_LOG_NONE = 0,
+	PTP_LOG_ERR = 1,
+	PTP_LOG_WARN = 2,
+	PTP_LOG_INFO = 3,
+	PTP_LOG_DEBUG = 4,
+	/// @brief Per packet messages from the I/O loops
+	PTP_LOG_TRACE = 5,
+};
+
+/// @brief Subsystem a message comes from, see ptp_log_set_categories
+enum PtpLogCategory {
+	PTP_LOG_CORE = 0,
+	PTP_LOG_USB = 1,
+	PTP_LOG_IP = 2,
+	PTP_LOG_VENDOR = 3,
+	PTP_LOG_SIM = 4,
+	PTP_LOG_CATEGORY_COUNT,
+};
+
+// Messages above this level are compiled out. VERBOSE keeps everything, as it always has.
+#ifndef CAMLIB_LOG_LEVEL
+	#ifdef VERBOSE
+		#define CAMLIB_LOG_LEVEL PTP_LOG_TRACE
+	#else
+		#define CAMLIB_LOG_LEVEL PTP_LOG_WARN
+	#endif
+#endif
+
+/// @brief Leveled log message, costs nothing if level is above CAMLIB_LOG_LEVEL
+#define ptp_log(level, category, ...) do { \
+		if ((level) <= CAMLIB_LOG_LEVEL) ptp_log_write(level, category, __VA_ARGS__); \
+	} while (0)
+
+/// @brief Backend of ptp_log, also from log.c
+__attribute__((format(printf, 3, 4)))
+void ptp_log_write(int level, int category, const char *fmt, ...);
+
 // 1mb default buffer size
 #define CAMLIB_DEFAULT_SIZE 1000000
 
+// Default hard limit for r->data, a data phase bigger than this has to be streamed
+#ifndef CAMLIB_MAX_BUFFER_SIZE
+	#define CAMLIB_MAX_BUFFER_SIZE (1024 * 1024 * 1024)
+#endif
+
+// r->data shrinks back to CAMLIB_DEFAULT_SIZE after this many transactions that didn't need more
+#ifndef CAMLIB_BUFFER_IDLE_TRANSACTIONS
+	#define CAMLIB_BUFFER_IDLE_TRANSACTIONS 32
+#endif
+
+// Size of the pieces a streamed data phase is read in, must fit in CAMLIB_DEFAULT_SIZE
+#ifndef CAMLIB_STREAM_CHUNK
+	#define CAMLIB_STREAM_CHUNK (256 * 1024)
+#endif
+
 /// @brief Camlib library errors, not PTP return codes
 enum PtpGeneralError {
 	PTP_OK = 0,
@@ -55,6 +109,14 @@ enum PtpLiveViewType {
 	PTP_LV_EOS_ML_BMP = 4, // ptplv v2
 };
 
+/// @brief Pixel layouts for uncompressed liveview frames (PTP_LV_ML)
+enum PtpLvPixelFormat {
+	PTP_LV_FORMAT_RGBA = 0,
+	PTP_LV_FORMAT_BGRA = 1,
+	/// @brief Packed 24 bit RGB, as sent by the camera
+	PTP_LV_FORMAT_RGB = 2,
+};
+
 /// @brief Unique camera types - each type should have similar opcodes and behavior
 enum PtpVendors {
 	PTP_DEV_EMPTY = 0,
@@ -92,6 +154,81 @@ struct PtpPropAvail {
 	void *data;
 };
 
+/// @brief Bookkeeping for r->data, see ptp_buffer_stats
+struct PtpBufferStats {
+	/// @brief Number of reallocs, growing or shrinking
+	int reallocs;
+	/// @brief Number of idle shrinks back to CAMLIB_DEFAULT_SIZE
+	int shrinks;
+	/// @brief Largest size r->data has been
+	size_t peak_size;
+	/// @brief Current size of r->data
+	size_t current_size;
+
+	// Largest size requested in the current idle window, and transactions in it
+	size_t window_need;
+	int window_transactions;
+};
+
+/// @brief Bits per PtpCaps bitmap: the low 12 bits of a code, plus 4096 for vendor codes (bit 15 set).
+/// Codes whose category bits don't match (say, an opcode outside 0x1000/0x9000) are looked up in r->di instead.
+#define PTP_CAPS_BITS 8192
+
+/// @brief How a device reports events and property changes
+enum PtpEventMethod {
+	PTP_EVENTS_NONE = 0,
+	/// @brief Standard event packets, over the interrupt endpoint or the PTP/IP event channel
+	PTP_EVENTS_STANDARD = 1,
+	/// @brief Polled with PTP_OC_EOS_GetEvent, see ptp_eos_get_event
+	PTP_EVENTS_EOS = 2,
+};
+
+struct PtpRuntime;
+
+/// @brief Vendor specific implementations behind the generic functions.
+/// A NULL entry means the vendor has no equivalent, callers return PTP_UNSUPPORTED.
+struct PtpVendorOps {
+	/// @brief Set a property by its raw code. Never NULL, falls back to ptp_set_prop_value.
+	int (*set_prop_value)(struct PtpRuntime *r, int code, int value);
+	/// @brief See ptp_set_generic_property
+	int (*set_generic_property)(struct PtpRuntime *r, const char *name, int value);
+	/// @brief See ptp_pre_take_picture
+	int (*pre_take_picture)(struct PtpRuntime *r);
+	/// @brief See ptp_take_picture
+	int (*take_picture)(struct PtpRuntime *r);
+	/// @brief Hold the shutter open, until bulb_stop
+	int (*bulb_start)(struct PtpRuntime *r);
+	int (*bulb_stop)(struct PtpRuntime *r);
+	/// @brief Move the focus motor, the step size and direction is up to the vendor
+	int (*drive_lens)(struct PtpRuntime *r, int steps);
+	/// @brief 1 to lock the mirror up, 0 to bring it back down
+	int (*set_mirror)(struct PtpRuntime *r, int up);
+};
+
+/// @brief What camlib worked out about the device, once per GetDeviceInfo. See ptp_get_profile.
+struct PtpDeviceProfile {
+	/// @brief enum PtpDeviceType
+	int vendor;
+	/// @brief enum PtpLiveViewType
+	int liveview_type;
+	/// @brief enum PtpEventMethod
+	int event_method;
+	/// @brief Never NULL
+	const struct PtpVendorOps *ops;
+};
+
+/// @brief Bitmaps of what GetDeviceInfo reported, rebuilt by ptp_parse_device_info
+struct PtpCaps {
+	/// @brief The device info these were built from. Only used while r->di still points to it.
+	const struct PtpDeviceInfo *di;
+	uint32_t ops[PTP_CAPS_BITS / 32];
+	uint32_t events[PTP_CAPS_BITS / 32];
+	uint32_t props[PTP_CAPS_BITS / 32];
+	/// @brief Capture and playback formats
+	uint32_t formats[PTP_CAPS_BITS / 32];
+	struct PtpDeviceProfile profile;
+};
+
 /// @brief Holds all camlib instance info
 /// @struct PtpRuntime
 struct PtpRuntime {
@@ -113,6 +250,10 @@ struct PtpRuntime {
     uint8_t *data;
     int data_length;
 
+	/// @brief Hard limit for data_length, set with ptp_set_buffer_limit
+	size_t data_max_size;
+	struct PtpBufferStats buffer_stats;
+
 	/// @note For optimization on libusb, as many bytes as possible should be read at once. Generally this
 	/// is 512, but certain comm backends can manage more. For TCP, this isn't used.
 	int max_packet_size;
@@ -120,12 +261,23 @@ struct PtpRuntime {
 	/// @brief Info about current connection, used to detect camera type, supported opodes, etc
 	/// @note Set by ptp_parse_device_info.
 	struct PtpDeviceInfo *di;
+
+	/// @brief Lookup tables for di, see struct PtpCaps
+	struct PtpCaps caps;
 	int device_type;
 
 	/// @brief For Windows compatibility, this is set to indicate lenth for a data packet
 	/// that will be sent after a command packet. Will be set to zero when ptp_send_bulk_packets is called.
 	int data_phase_length;
 
+	/// @brief PTP/IP only: split outgoing data phases into DATA packets with at most this many
+	/// bytes of payload, the last piece going in the END packet. 0 (default) sends a single END packet.
+	int data_packet_size;
+
+	/// @brief Layout of PTP_LV_ML frames from ptp_liveview_frame, one of enum PtpLvPixelFormat.
+	/// Defaults to PTP_LV_FORMAT_RGBA.
+	int liveview_format;
+
 	/// @brief For session comm/io structures (holds backend instance pointers)
 	void *comm_backend;
 
@@ -147,6 +299,26 @@ struct PtpRuntime {
 	struct PtpPropAvail *avail;
 
 	struct ObjectCache *oc;
+
+	/// @brief I/O worker thread state, see ptp_async_start
+	/// @note Optional
+	struct PtpAsync *async;
+
+	/// @brief Transaction timing and counters, see ptp_stats_enable
+	/// @note Optional
+	struct PtpStats *stats;
+
+	/// @brief Binary trace being recorded, see ptp_trace_start
+	/// @note Optional
+	struct PtpTrace *trace;
+
+	/// @brief Background liveview thread, see ptp_lv_stream_start
+	/// @note Optional
+	struct PtpLvStream *lv_stream;
+
+	/// @brief Property state kept up to date from events, see ptp_prop_store_enable
+	/// @note Optional
+	struct PtpPropStore *prop_store;
 };
 
 /// @brief Generic event / property change
@@ -165,6 +337,11 @@ struct PtpCommand {
 	int data_length;
 };
 
+/// @brief Receives data phase payload in order, as it comes off the wire
+/// @note data points into r->data, and is only valid during the call
+/// @returns Nonzero to stop receiving - the rest of the data phase is discarded
+typedef int ptp_data_sink(struct PtpRuntime *r, void *arg, uint8_t *data, int length);
+
 /// @brief Generic Struct for arrays
 struct PtpArray {
 	uint32_t length;
@@ -226,6 +403,24 @@ int ptp_send(struct PtpRuntime *r, struct PtpCommand *cmd);
 /// @memberof PtpRuntime
 int ptp_send_data(struct PtpRuntime *r, struct PtpCommand *cmd, void *data, int length);
 
+/// @brief Send a command request, and pass the data phase to sink in CAMLIB_STREAM_CHUNK sized pieces
+/// instead of buffering it in r->data. Only the response is left in r->data.
+/// @returns PTP_CANCELED if the sink stopped the transfer
+/// @memberof PtpRuntime
+int ptp_send_stream(struct PtpRuntime *r, struct PtpCommand *cmd, ptp_data_sink *sink, void *arg);
+
+/// @brief Same as ptp_send, but the incoming data phase is written to stream instead of r->data.
+/// On PTP/IP this is spliced from the socket to the file where the kernel allows it.
+/// @memberof PtpRuntime
+int ptp_send_to_file(struct PtpRuntime *r, struct PtpCommand *cmd, FILE *stream);
+
+/// @brief Same as ptp_send_data, but the data phase is length bytes read from stream
+/// @memberof PtpRuntime
+int ptp_send_data_file(struct PtpRuntime *r, struct PtpCommand *cmd, FILE *stream, int length);
+
+/// @brief Sink for ptp_send_stream that writes to a file descriptor, passed as (void *)(intptr_t)fd
+int ptp_fd_sink(struct PtpRuntime *r, void *arg, uint8_t *data, int length);
+
 /// @brief Try and get an event from the camera over int endpoint (USB-only)
 /// @memberof PtpRuntime
 int ptp_get_event(struct PtpRuntime *r, struct PtpEventContainer *ec);
@@ -245,26 +440,64 @@ void ptp_mutex_keep_locked(struct PtpRuntime *r);
 /// @memberof PtpRuntime
 void ptp_mutex_lock(struct PtpRuntime *r);
 
+/// @brief Release every level the current thread holds, done when a transaction fails
+/// @memberof PtpRuntime
+void ptp_mutex_unlock_thread(struct PtpRuntime *r);
+
 /// @brief Gets type of device from r->di
 /// @returns enum PtpDeviceType
 /// @memberof PtpRuntime
 int ptp_device_type(struct PtpRuntime *r);
 
-/// @brief Check if an opcode is supported by looking through supported props in r->di
+/// @brief Check if an opcode is in the supported opcodes of r->di
 /// @returns 1 if yes, 0 if no
 /// @memberof PtpRuntime
 int ptp_check_opcode(struct PtpRuntime *r, int opcode);
 
-/// @brief Check if a property code is supported by looking through supported props in r->di
+/// @brief Check if a property code is in the supported props of r->di
 /// @returns 1 if yes, 0 if no
 /// @memberof PtpRuntime
 int ptp_check_prop(struct PtpRuntime *r, int code);
 
-/// @brief Mostly for internal use - realloc the data buffer
+/// @brief Check if an event code is in the supported events of r->di
+/// @returns 1 if yes, 0 if no
+/// @memberof PtpRuntime
+int ptp_check_event(struct PtpRuntime *r, int code);
+
+/// @brief Check if an object format is in the capture or playback formats of r->di
+/// @returns 1 if yes, 0 if no
+/// @memberof PtpRuntime
+int ptp_check_format(struct PtpRuntime *r, int code);
+
+/// @brief Rebuild r->caps from r->di, done by ptp_parse_device_info. Call it after changing r->di by hand.
+/// @memberof PtpRuntime
+void ptp_update_caps(struct PtpRuntime *r);
+
+/// @brief Get the device profile for r->di, without any string compares.
+/// With no device info yet this is an empty profile with the standard PTP ops.
+/// @memberof PtpRuntime
+const struct PtpDeviceProfile *ptp_get_profile(struct PtpRuntime *r);
+
+/// @brief Mostly for internal use - operation table for a vendor (generic.c)
+/// @param vendor enum PtpDeviceType
+const struct PtpVendorOps *ptp_get_vendor_ops(int vendor);
+
+/// @brief Mostly for internal use - make sure the data buffer holds at least size bytes.
+/// Grows geometrically, and never shrinks (see CAMLIB_BUFFER_IDLE_TRANSACTIONS for that).
 /// @note r->data will be reassigned, any old references must be updated
+/// @returns PTP_OUT_OF_MEM if size is past the limit or realloc fails, r->data is left untouched
 /// @memberof PtpRuntime
 int ptp_buffer_resize(struct PtpRuntime *r, size_t size);
 
+/// @brief Set the hard limit for r->data (default CAMLIB_MAX_BUFFER_SIZE)
+/// @returns PTP_RUNTIME_ERR if max is under CAMLIB_STREAM_CHUNK, over INT_MAX, or under the current buffer size
+/// @memberof PtpRuntime
+int ptp_set_buffer_limit(struct PtpRuntime *r, size_t max);
+
+/// @brief Copy out r->data statistics
+/// @memberof PtpRuntime
+void ptp_buffer_stats(struct PtpRuntime *r, struct PtpBufferStats *stats);
+
 int ptp_write_unicode_string(char *dat, char *string);
 int ptp_read_unicode_string(char *buffer, char *dat, int max);
 int ptp_read_utf8_string(void *dat, char *string, int max);
@@ -283,6 +516,9 @@ inline static int ptp_read_u8  (void *buf, uint8_t *out) { *out = ((uint8_t *)bu
 // Build a new PTP/IP or PTP/USB command packet in r->data
 int ptp_new_cmd_packet(struct PtpRuntime *r, struct PtpCommand *cmd);
 
+// Build the data phase header(s) for a payload of data_length at r->data + of, returns header length
+int ptp_new_data_header(struct PtpRuntime *r, int of, struct PtpCommand *cmd, int data_length);
+
 // Only for PTP_USB or PTP_USB_IP use
 int ptp_new_data_packet(struct PtpRuntime *r, struct PtpCommand *cmd, void *data, int data_length);
 
@@ -330,4 +566,339 @@ int ptp_object_service_length(struct PtpRuntime *r, struct ObjectCache *oc);
 int ptp_object_service_step(struct PtpRuntime *r, struct ObjectCache *oc);
 void ptp_object_service_add_priority(struct PtpRuntime *r, struct ObjectCache *oc, int handle);
 
+// Async command api (async.c)
+struct PtpAsyncRequest;
+typedef void ptp_async_callback(struct PtpRuntime *r, struct PtpAsyncRequest *req, void *arg);
+typedef int ptp_async_fn(struct PtpRuntime *r, void *arg);
+
+/// @brief Scheduling classes for the I/O worker. Between transactions the worker always picks
+/// the oldest request of the most urgent class, so a control command waits for at most one
+/// transaction of background traffic.
+enum PtpAsyncPriority {
+	/// @brief Interactive control (shutter, property changes)
+	PTP_PRIO_CONTROL = 0,
+	/// @brief Event polling
+	PTP_PRIO_EVENTS = 1,
+	PTP_PRIO_LIVEVIEW = 2,
+	/// @brief Downloads and other big transfers
+	PTP_PRIO_BULK = 3,
+	PTP_PRIO_COUNT = 4,
+};
+
+/// @brief A command queued on the I/O worker
+struct PtpAsyncRequest {
+	/// @brief One of enum PtpAsyncPriority
+	int priority;
+
+	struct PtpCommand cmd;
+	uint8_t *data;
+	int data_length;
+
+	// For ptp_async_call
+	ptp_async_fn *fn;
+	void *fn_arg;
+
+	// For ptp_async_download, offset is how much has been passed to sink so far
+	uint32_t handle;
+	uint32_t offset;
+	int chunk_size;
+	ptp_data_sink *sink;
+	void *sink_arg;
+
+	ptp_async_callback *callback;
+	void *arg;
+
+	/// @brief Set once the transaction is finished
+	int done;
+	/// @brief Result of ptp_send/ptp_send_data, or PTP_CANCELED if the worker was stopped first
+	int rc;
+	/// @brief Response code from the camera, if the transaction got that far
+	int code;
+	/// @brief Copy of the incoming data phase, for requests without a callback. NULL if there wasn't one.
+	uint8_t *payload;
+	int payload_length;
+
+	struct PtpAsyncRequest *next;
+};
+
+/// @brief Start the I/O worker thread for this runtime. All async requests are run by it, one at a time.
+/// Blocking calls can still be made from other threads, they are serialized with the worker by the runtime mutex.
+/// @memberof PtpRuntime
+int ptp_async_start(struct PtpRuntime *r);
+
+/// @brief Stop the worker. Requests still queued complete with PTP_CANCELED. Call before ptp_close.
+/// Other threads may be in ptp_async_wait or ptp_async_poll, this returns once they are out.
+/// @memberof PtpRuntime
+void ptp_async_stop(struct PtpRuntime *r);
+
+/// @brief Queue a command, with an optional data phase (data is copied).
+/// If callback is set, it's called on the worker thread with the runtime still locked, so the response
+/// can be read from r->data. The request is freed after the callback returns.
+/// Without a callback, poll or wait on the returned request, then free it with ptp_async_free.
+/// @returns NULL if the worker isn't running or out of memory
+/// @memberof PtpRuntime
+struct PtpAsyncRequest *ptp_async_submit(struct PtpRuntime *r, struct PtpCommand *cmd, void *data, int length, ptp_async_callback *callback, void *arg);
+
+/// @brief Same as ptp_async_submit, at one of enum PtpAsyncPriority (ptp_async_submit uses PTP_PRIO_CONTROL)
+/// @memberof PtpRuntime
+struct PtpAsyncRequest *ptp_async_submit_priority(struct PtpRuntime *r, int priority, struct PtpCommand *cmd, void *data, int length, ptp_async_callback *callback, void *arg);
+
+/// @brief Run fn on the worker at the given priority, for helpers that do several transactions
+/// (ptp_liveview_frame, ptp_eos_get_event). req->rc is the return value of fn.
+/// @memberof PtpRuntime
+struct PtpAsyncRequest *ptp_async_call(struct PtpRuntime *r, int priority, ptp_async_fn *fn, void *fn_arg, ptp_async_callback *callback, void *arg);
+
+/// @brief Download an object at PTP_PRIO_BULK, as GetPartialObject requests of chunk_size bytes.
+/// After each chunk is passed to sink, the download goes to the back of the bulk queue, so more urgent
+/// requests get a turn between chunks. Nonzero from sink cancels the download with PTP_CANCELED.
+/// @memberof PtpRuntime
+struct PtpAsyncRequest *ptp_async_download(struct PtpRuntime *r, uint32_t handle, int chunk_size, ptp_data_sink *sink, void *sink_arg, ptp_async_callback *callback, void *arg);
+
+/// @brief Returns 1 if the request is finished
+int ptp_async_poll(struct PtpRuntime *r, struct PtpAsyncRequest *req);
+
+/// @brief Block until the request is finished
+/// @returns req->rc
+int ptp_async_wait(struct PtpRuntime *r, struct PtpAsyncRequest *req);
+
+/// @brief Free a finished request that had no callback
+void ptp_async_free(struct PtpAsyncRequest *req);
+
+// Transaction stats (stats.c)
+#ifndef PTP_STATS_MAX_OPS
+	#define PTP_STATS_MAX_OPS 64
+#endif
+
+/// @brief Latency histogram buckets, bucket i counts transactions that took under 2^i microseconds.
+/// The last bucket takes everything slower.
+#define PTP_STATS_BUCKETS 24
+
+/// @brief Counters for one opcode. Time is in microseconds, summed over all transactions.
+struct PtpOpStats {
+	int code;
+	uint32_t count;
+	/// @brief Transactions that failed with an I/O or runtime error
+	uint32_t errors;
+	/// @brief Transactions the camera answered with something other than PTP_RC_OK
+	uint32_t bad_responses;
+	/// @brief Data phase payload bytes
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	/// @brief Writing the command and any outgoing data phase
+	uint64_t send_us;
+	/// @brief From the end of the send until the incoming data phase is in (0 if there was none)
+	uint64_t data_us;
+	/// @brief Until the response is in
+	uint64_t response_us;
+	uint64_t max_us;
+	uint32_t histogram[PTP_STATS_BUCKETS];
+};
+
+struct PtpStats {
+	uint32_t transactions;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	/// @brief Extra reads done by the wait_for_response loops
+	uint32_t retries;
+	int ops_length;
+	struct PtpOpStats ops[PTP_STATS_MAX_OPS];
+
+	// Phase marks of the transaction in progress
+	uint64_t start;
+	uint64_t sent;
+	uint64_t data_done;
+	uint64_t data_in;
+	uint64_t data_out;
+};
+
+/// @brief Start recording per opcode counters and latency for every transaction
+/// @memberof PtpRuntime
+int ptp_stats_enable(struct PtpRuntime *r);
+
+/// @brief Stop recording and free the counters
+/// @memberof PtpRuntime
+void ptp_stats_disable(struct PtpRuntime *r);
+
+/// @brief Zero all counters
+/// @memberof PtpRuntime
+void ptp_stats_reset(struct PtpRuntime *r);
+
+/// @brief Copy out the counters for an opcode
+/// @returns 0, or -1 if stats are off or the opcode hasn't been seen
+/// @memberof PtpRuntime
+int ptp_stats_op(struct PtpRuntime *r, int code, struct PtpOpStats *out);
+
+/// @brief Dump all counters, including ptp_buffer_stats, as JSON
+/// @memberof PtpRuntime
+int ptp_stats_json(struct PtpRuntime *r, char *buffer, int max);
+
+// Called by lib.c and the transport while the runtime is locked, no-ops if stats are off
+void ptp_stats_begin(struct PtpRuntime *r);
+void ptp_stats_sent(struct PtpRuntime *r, int bytes_out);
+void ptp_stats_data_done(struct PtpRuntime *r, int bytes_in);
+void ptp_stats_retry(struct PtpRuntime *r);
+void ptp_stats_end(struct PtpRuntime *r, int code, int rc);
+
+// Transaction traces (trace.c)
+/// @brief Flags of a trace record
+enum PtpTraceFlags {
+	/// @brief Camera to host, otherwise host to camera
+	PTP_TRACE_IN = (1 << 0),
+	/// @brief Interrupt endpoint or PTP/IP event channel
+	PTP_TRACE_EVENT = (1 << 1),
+};
+
+/// @brief Record every byte going through the backend into a binary trace at path, with
+/// timestamps from a monotonic clock. Replay it with replay_backend.c.
+/// Trace format, all little endian:
+/// - Header: u32 magic 'PTPT', u16 version (1), u16 enum PtpConnType, u32 max_packet_size, u32 0
+/// - Records: u32 microseconds since the previous record, u8 enum PtpTraceFlags, u32 length, then length bytes
+/// @note sendfile and splice are not used while tracing, so that the payload can be recorded
+/// @memberof PtpRuntime
+int ptp_trace_start(struct PtpRuntime *r, const char *path);
+
+/// @brief Flush and close the trace
+/// @memberof PtpRuntime
+int ptp_trace_stop(struct PtpRuntime *r);
+
+/// @brief Called by the transport after each successful backend read or write, no-op if not tracing
+void ptp_trace_io(struct PtpRuntime *r, int flags, const void *data, int length);
+
+#define PTP_TRACE_MAGIC 0x54505450
+#define PTP_TRACE_VERSION 1
+#define PTP_TRACE_HEADER_SIZE 16
+#define PTP_TRACE_RECORD_SIZE 9
+
+// Liveview streaming (lv_stream.c)
+/// @brief A liveview frame, owned by the stream
+struct PtpLvFrame {
+	/// @brief JPEG for EOS, or pixels in r->liveview_format for Magic Lantern
+	uint8_t *data;
+	int length;
+	int size;
+	/// @brief Counts up from 1, gaps are frames that were dropped before anyone saw them
+	uint64_t seq;
+	/// @brief When the frame came in, in microseconds from a monotonic clock
+	uint64_t time_us;
+};
+
+struct PtpLvStreamInfo {
+	uint64_t frames;
+	/// @brief Frames replaced by a newer one before the consumer took them
+	uint64_t dropped;
+	/// @brief Polls the camera had no new frame for
+	uint64_t not_ready;
+	/// @brief Current estimate of the camera's frame interval
+	uint32_t interval_us;
+};
+
+/// @brief Called on the liveview thread for every frame. frame is only valid until the callback returns.
+typedef void ptp_lv_callback(struct PtpRuntime *r, const struct PtpLvFrame *frame, void *arg);
+
+/// @brief Fetch liveview frames on a background thread until ptp_lv_stream_stop. Frames rotate through
+/// three buffers, so the thread never waits on the consumer and the consumer always gets the newest
+/// frame, older ones are dropped. Polling follows the frame rate the camera actually delivers.
+/// ptp_liveview_init must have been called. callback can be NULL, for ptp_lv_stream_latest only.
+/// @memberof PtpRuntime
+int ptp_lv_stream_start(struct PtpRuntime *r, ptp_lv_callback *callback, void *arg);
+
+/// @brief Stop the thread and free the frames. Call before ptp_liveview_deinit.
+/// @memberof PtpRuntime
+void ptp_lv_stream_stop(struct PtpRuntime *r);
+
+/// @brief Newest frame, valid until the next call. For a single consumer thread.
+/// @returns 1 if the frame is new since the last call, 0 if not (*frame is the previous one, or NULL
+/// if nothing came in yet), or the error that stopped the thread
+/// @memberof PtpRuntime
+int ptp_lv_stream_latest(struct PtpRuntime *r, struct PtpLvFrame **frame);
+
+/// @brief Copy of the stream counters
+/// @memberof PtpRuntime
+void ptp_lv_stream_info(struct PtpRuntime *r, struct PtpLvStreamInfo *info);
+
+// Property store (props.c)
+/// @brief Last known state of a property
+struct PtpProp {
+	int code;
+	/// @brief Raw value as the camera reported it (the first 32 bits, for wider values)
+	uint32_t value;
+	/// @brief 0 until a value is known, and after a standard DevicePropChanged until ptp_prop_store_refresh
+	int valid;
+	/// @brief ptp_prop_store_seq at the last change
+	uint32_t seq;
+	/// @brief Allowed values (EOS AvailListChanged), NULL if the camera hasn't sent any.
+	/// From ptp_prop_store_get, this is the caller's buffer.
+	uint32_t *avail;
+	/// @brief Number of allowed values the camera sent, may be more than were copied
+	int avail_length;
+};
+
+/// @brief Keep a table of property state, updated from events as they come in through
+/// ptp_eos_get_event and ptp_get_event. Reading it never touches the camera.
+/// @note Updates happen under the IO lock, the readers below take it and copy out, so any thread can use them.
+/// @memberof PtpRuntime
+int ptp_prop_store_enable(struct PtpRuntime *r);
+
+/// @memberof PtpRuntime
+void ptp_prop_store_disable(struct PtpRuntime *r);
+
+/// @brief Copy out the state of a property. Up to max allowed values are copied to avail, which may be NULL.
+/// @returns 0, or -1 if nothing is known about it
+/// @memberof PtpRuntime
+int ptp_prop_store_get(struct PtpRuntime *r, int code, struct PtpProp *out, uint32_t *avail, int max);
+
+/// @brief Sequence number of the last change, 0 before any
+/// @memberof PtpRuntime
+uint32_t ptp_prop_store_seq(struct PtpRuntime *r);
+
+/// @brief Fill codes with the properties that changed after seq since, most recent first
+/// @returns How many were written, at most max
+/// @memberof PtpRuntime
+int ptp_prop_store_changed(struct PtpRuntime *r, uint32_t since, int *codes, int max);
+
+/// @brief Read a property with GetDevicePropValue into the store, for standard cameras
+/// that only say that something changed
+/// @memberof PtpRuntime
+int ptp_prop_store_refresh(struct PtpRuntime *r, int code);
+
+/// @brief Mostly for internal use - apply the last EOS GetEvent response
+void ptp_prop_store_eos_events(struct PtpRuntime *r);
+
+/// @brief Mostly for internal use - mark a property as changed to an unknown value
+void ptp_prop_store_invalidate(struct PtpRuntime *r, int code);
+
+// Leveled logging (log.c)
+#ifndef CAMLIB_LOG_SLOTS
+	// Must be a power of 2
+	#define CAMLIB_LOG_SLOTS 256
+#endif
+
+// Longer messages are cut off
+#ifndef CAMLIB_LOG_LINE
+	#define CAMLIB_LOG_LINE 256
+#endif
+
+/// @brief Receives every message that passes the filters, one line at a time
+typedef void ptp_log_sink(int level, int category, const char *msg);
+
+/// @brief Set the runtime log level. Defaults to PTP_LOG_TRACE with VERBOSE, otherwise PTP_LOG_WARN.
+/// Nothing above CAMLIB_LOG_LEVEL can be turned back on.
+void ptp_log_set_level(int level);
+
+/// @brief Bitmask of (1 << enum PtpLogCategory) to keep, all by default
+void ptp_log_set_categories(unsigned int mask);
+
+/// @brief Replace the default sink (stdout), NULL to restore it
+void ptp_log_set_sink(ptp_log_sink *sink);
+
+/// @brief Queue messages in a lock-free ring buffer and hand them to the sink from a background thread,
+/// so logging never blocks the caller. Messages are dropped if the ring is full.
+int ptp_log_start_async(void);
+
+/// @brief Drain the ring buffer, stop the thread and go back to logging from the caller
+void ptp_log_stop_async(void);
+
+/// @brief Messages lost to a full ring buffer since start
+unsigned int ptp_log_dropped(void);
+
 #endif
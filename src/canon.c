@@ -115,7 +115,15 @@ int ptp_eos_get_event(struct PtpRuntime *r) {
 	struct PtpCommand cmd;
 	cmd.code = PTP_OC_EOS_GetEvent;
 	cmd.param_length = 0;
-	return ptp_send(r, &cmd);
+	if (r->prop_store == NULL) return ptp_send(r, &cmd);
+
+	// Keep the payload until the store has seen it
+	ptp_mutex_keep_locked(r);
+	int rc = ptp_send(r, &cmd);
+	if (rc) return rc;
+	ptp_prop_store_eos_events(r);
+	ptp_mutex_unlock(r);
+	return 0;
 }
 
 int ptp_eos_ping(struct PtpRuntime *r) {
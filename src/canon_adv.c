@@ -165,13 +165,13 @@ static struct Tokens *lex_evproc_command(char string[]) {
 			c++;
 			toks->t[t].string[s] = '\0';
 		} else {
-			ptp_verbose_log("Skipping unknown character '%c'\n", string[c]);
+			ptp_log(PTP_LOG_WARN, PTP_LOG_VENDOR, "Skipping unknown character '%c'\n", string[c]);
 			c++;
 			continue;
 		}
 
 		if (t >= MAX_TOK) {
-			ptp_verbose_log("Error: Hit max parameter count.\n");
+			ptp_log(PTP_LOG_ERR, PTP_LOG_VENDOR, "Error: Hit max parameter count.\n");
 			return NULL;
 		} else {
 			t++;
@@ -198,7 +198,7 @@ char *canon_evproc_pack(int *out_length, char *string) {
 	char *data = malloc(500);
 
 	if (toks->length == 0) {
-		ptp_verbose_log("Error, must have at least 1 parameter.\n");
+		ptp_log(PTP_LOG_ERR, PTP_LOG_VENDOR, "Error, must have at least 1 parameter.\n");
 		return NULL;
 	}
 
@@ -209,7 +209,7 @@ char *canon_evproc_pack(int *out_length, char *string) {
 		data[len] = '\0';
 		length += len + 1;
 	} else {
-		ptp_verbose_log("Error, first parameter must be plain text.\n");
+		ptp_log(PTP_LOG_ERR, PTP_LOG_VENDOR, "Error, first parameter must be plain text.\n");
 		return NULL;
 	}
 
@@ -268,7 +268,7 @@ char *canon_evproc_pack(int *out_length, char *string) {
 static int eos_evproc(struct PtpRuntime *r, char *request, int payload) {
 	int rc = ptp_eos_activate_command(r);
 	if (rc) {
-		ptp_verbose_log("Error activating command %d\n", rc);
+		ptp_log(PTP_LOG_ERR, PTP_LOG_VENDOR, "Error activating command %d\n", rc);
 		return rc;
 	}
 
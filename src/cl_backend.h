@@ -44,13 +44,36 @@ int ptp_device_reset(struct PtpRuntime *r);
 // Recieve all packets, and whatever else (common logic for all backends)
 int ptp_send_bulk_packets(struct PtpRuntime *r, int length);
 int ptp_receive_bulk_packets(struct PtpRuntime *r);
+
+// Same as ptp_receive_bulk_packets, but the data phase goes to sink in chunks and only
+// the response packet is kept at the start of r->data
+int ptp_receive_stream_packets(struct PtpRuntime *r, ptp_data_sink *sink, void *arg);
 int ptp_read_int(struct PtpRuntime *r, void *to, int length);
 
+// Read exactly length bytes of an incoming USB data container (after the first packet).
+// The default loops ptp_cmd_read, libusb.c overrides it with several transfers in flight.
+int ptpusb_read_data_phase(struct PtpRuntime *r, void *to, int length);
+
+// Read exactly length bytes of an incoming USB data container (after the first packet), passing
+// each piece to sink as it arrives. Pieces live in r->data and are only valid during the call.
+// The default reads CAMLIB_STREAM_CHUNK at a time, libusb.c keeps transfers queued while sink runs.
+// Returns length, PTP_IO_ERR, or whatever nonzero value sink returned.
+int ptpusb_stream_data_phase(struct PtpRuntime *r, int length, ptp_data_sink *sink, void *arg);
+
 int ptp_device_close(struct PtpRuntime *r); // TODO: Disconnect, confusing with ptp_close
 
+// Send r->data till length, then data_length bytes of data, without copying data into r->data
+int ptp_send_data_packets(struct PtpRuntime *r, int length, void *data, int data_length);
+
+// USB half of ptp_send_data_packets, libwpd overrides it since it can only send whole data phases
+int ptpusb_send_data_packets(struct PtpRuntime *r, int length, void *data, int data_length);
+
 // Upload file data as packets, but upload r->data till length first
 int ptp_fsend_packets(struct PtpRuntime *r, int length, FILE *stream);
 
+// USB half of ptp_fsend_packets, libwpd overrides it since it can only send whole data phases
+int ptpusb_fsend_packets(struct PtpRuntime *r, int length, FILE *stream);
+
 // Reads the incoming packet to file, starting after an optional offset
 int ptp_freceive_bulk_packets(struct PtpRuntime *r, FILE *stream, int of);
 
@@ -58,10 +81,81 @@ int ptpip_connect(struct PtpRuntime *r, const char *addr, int port);
 int ptpip_cmd_write(struct PtpRuntime *r, void *data, int size);
 int ptpip_cmd_read(struct PtpRuntime *r, void *data, int size);
 
+// Write header and then payload to the command socket in one call (writev), all or nothing.
+// Returns header_length + payload_length, or negative on error.
+int ptpip_cmd_writev(struct PtpRuntime *r, void *header, int header_length, void *payload, int payload_length);
+
+// Kernel side copies between the command socket and a file descriptor, moving up to size bytes.
+// Return PTP_UNSUPPORTED (with nothing moved) if the platform or fd can't do it, so callers can fall back.
+int ptpip_cmd_sendfile(struct PtpRuntime *r, int fd, int size);
+int ptpip_cmd_splice(struct PtpRuntime *r, int fd, int size);
+
 int ptpip_connect_events(struct PtpRuntime *r, const char *addr, int port);
 int ptpip_event_send(struct PtpRuntime *r, void *data, int size);
 int ptpip_event_read(struct PtpRuntime *r, void *data, int size);
 
 int ptpip_close(struct PtpRuntime *r); // TODO: Disconnect, confusing with ptp_close
 
+// In-memory simulated camera (sim.c). Link sim_backend.c instead of libusb.c and ip.c to talk to it.
+struct PtpSimConfig {
+	/// @brief Added to every transaction, in microseconds
+	int latency_us;
+	/// @brief Bytes per second in either direction, 0 for no limit
+	int bandwidth;
+	/// @brief USB packet size, reported in r->max_packet_size
+	int max_packet_size;
+	/// @brief PTP/IP: payload bytes per DATA packet the camera sends, 0 for a single END packet
+	int ip_data_chunk;
+	/// @brief PTP/IP: most bytes a single socket read returns, 0 for no limit
+	int max_read;
+	/// @brief PTP/IP: the stream arrives in segments of this many bytes and a read never crosses
+	/// into the next one, like a buffered socket. 0 for no segments.
+	int ip_segment;
+	/// @brief Objects on the card besides 0xdeadbeef (test.png), handles 1 to num_objects
+	int num_objects;
+	int object_size;
+	/// @brief JPEG size of each EOS liveview frame
+	int lv_frame_size;
+	/// @brief EOS liveview frame rate, polls in between frames get PTP_RC_CANON_NotReady. 0 for no limit.
+	int lv_fps;
+	/// @brief Extra property change events in every EOS GetEvent response
+	int events_per_poll;
+};
+
+void ptpsim_default_config(struct PtpSimConfig *c);
+
+/// @brief Config for simulated cameras connected after this call
+void ptpsim_set_config(const struct PtpSimConfig *c);
+
+struct PtpSim;
+
+/// @brief New camera, with c or else the ptpsim_set_config config
+struct PtpSim *ptpsim_new(const struct PtpSimConfig *c);
+void ptpsim_free(struct PtpSim *s);
+int ptpsim_max_packet_size(struct PtpSim *s);
+
+/// @brief Host to camera bytes, in any size pieces. framing is one of enum PtpConnType.
+/// @returns length, or negative on a malformed packet
+int ptpsim_write(struct PtpSim *s, int framing, const void *data, int length);
+
+/// @brief Camera to host bytes, runs the last command if its data phase is in.
+/// PTP_USB framing returns at most one transfer per call (0 for a zero length packet).
+/// @returns bytes read, 0 if nothing is queued
+int ptpsim_read(struct PtpSim *s, void *to, int length);
+
+// Trace replay (replay_backend.c), link it instead of libusb.c and ip.c
+enum PtpReplayMode {
+	/// @brief Hold each reply back as long as the camera took to send it
+	PTP_REPLAY_REALTIME = 0,
+	/// @brief Replies are available right away
+	PTP_REPLAY_FAST = 1,
+};
+
+/// @brief Load a trace written by ptp_trace_start, and set r->connection_type and
+/// r->max_packet_size to what was recorded. Connect as usual after this.
+int ptp_replay_open(struct PtpRuntime *r, const char *path, int mode);
+
+/// @brief Number of writes that didn't match the trace, 0 for a faithful replay
+int ptp_replay_mismatches(struct PtpRuntime *r);
+
 #endif
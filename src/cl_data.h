@@ -123,10 +123,36 @@ struct PtpCanonEvent {
 	int def;
 };
 
+// GetViewFinderData is a list of these blocks, length includes the header
 struct PtpEOSViewFinderData {
 	uint32_t length;
 	uint32_t type;
-	// standard JPG follows
+	// block data follows
+};
+
+// Block types seen holding the liveview JPEG, depending on the body
+enum PtpEOSViewFinderBlockType {
+	PTP_EOS_VF_JPEG = 1,
+	PTP_EOS_VF_JPEG2 = 9,
+	PTP_EOS_VF_JPEG3 = 11,
+};
+
+// A block of GetViewFinderData, pointing into the receive buffer
+struct PtpEOSViewFinderBlock {
+	uint32_t type;
+	uint8_t *data;
+	int length;
+};
+
+struct PtpEOSViewFinderIter {
+	uint8_t *d;
+	uint8_t *end;
+};
+
+// Cursor over the entries of an EOS GetEvent response
+struct PtpEventReader {
+	uint8_t *d;
+	uint8_t *end;
 };
 
 struct PtpEOSObject {
@@ -163,6 +189,10 @@ enum PtpCHDKCommands {
 #pragma pack(pop)
 
 #ifdef CAMLIB_INCLUDE_IMPL
+// snprintf into str + cur, for building up JSON. Output that doesn't fit is cut off.
+__attribute__((format(printf, 4, 5)))
+int osnprintf(char *str, int cur, int size, const char *format, ...);
+
 int ptp_pack_object_info(struct PtpRuntime *r, struct PtpObjectInfo *oi, uint8_t *buf, int max);
 
 int ptp_parse_prop_value(struct PtpRuntime *r);
@@ -175,11 +205,26 @@ int ptp_storage_info_json(const struct PtpStorageInfo *so, char *buffer, int max
 int ptp_object_info_json(const struct PtpObjectInfo *so, char *buffer, int max);
 
 int ptp_eos_events(struct PtpRuntime *r, struct PtpGenericEvent **p);
-void *ptp_open_eos_events(struct PtpRuntime *r);
-void *ptp_get_eos_event(struct PtpRuntime *r, void *e, struct PtpCanonEvent *ce);
+
+// Decode the last GetEvent response one entry at a time, straight out of r->data.
+// Holds the IO lock until ptp_eos_events_close, so other threads can't replace the payload.
+void ptp_eos_events_open(struct PtpRuntime *r, struct PtpEventReader *e);
+// Returns 1 and fills p, 0 at the end, PTP_CHECK_CODE if an entry runs past the payload
+int ptp_eos_events_next(struct PtpRuntime *r, struct PtpEventReader *e, struct PtpGenericEvent *p);
+void ptp_eos_events_close(struct PtpRuntime *r, struct PtpEventReader *e);
 
 int ptp_eos_events_json(struct PtpRuntime *r, char *buffer, int max);
 
+// Walk the blocks of the last GetViewFinderData response, without copying.
+// Blocks point into r->data, so they are only valid until the next transaction.
+void ptp_eos_vf_iter(struct PtpRuntime *r, struct PtpEOSViewFinderIter *it);
+// Returns 1 and fills b, 0 at the end, PTP_CHECK_CODE if a block runs past the payload
+int ptp_eos_vf_next(struct PtpEOSViewFinderIter *it, struct PtpEOSViewFinderBlock *b);
+// First block of a type, returns 0 if found
+int ptp_eos_vf_find(struct PtpRuntime *r, uint32_t type, struct PtpEOSViewFinderBlock *b);
+// First block holding the JPEG, whichever type the body uses for it
+int ptp_eos_vf_find_jpeg(struct PtpRuntime *r, struct PtpEOSViewFinderBlock *b);
+
 // Standard property value converters (conv.c)
 int ptp_eos_get_shutter(int data, int dir);
 int ptp_eos_get_iso(int data, int dir);
@@ -33,4 +33,21 @@ struct PtpEnum {
 extern int ptp_enums_length;
 extern struct PtpEnum ptp_enums[];
 
+// Perfect hash over ptp_enums, generated by stringify.py. A key hashes to a bucket,
+// the bucket's seed rehashes it to a slot, and the slot holds the first ptp_enums index
+// with that key (or -1). Lookups still compare the entry, since unknown keys land anywhere.
+struct PtpEnumTable {
+	int buckets;
+	int size;
+	const unsigned short *seeds;
+	const short *index;
+};
+
+// Keyed by value, for ptp_get_enum_all
+extern const struct PtpEnumTable ptp_enum_by_value;
+// Keyed by type, vendor and value, for ptp_get_enum
+extern const struct PtpEnumTable ptp_enum_by_code;
+// Keyed by name, for ptp_enum_all and ptp_enum
+extern const struct PtpEnumTable ptp_enum_by_name;
+
 #endif
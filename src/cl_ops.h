@@ -88,6 +88,14 @@ int ptp_get_partial_object(struct PtpRuntime *r, uint32_t handle, int offset, in
 /// @memberof PtpRuntime
 int ptp_get_object(struct PtpRuntime *r, int handle);
 
+/// @brief Download an object straight to a file with a single GetObject, without buffering it in r->data
+/// @memberof PtpRuntime
+int ptp_get_object_file(struct PtpRuntime *r, int handle, FILE *stream);
+
+/// @brief Upload length bytes from stream with SendObject, after ptp_send_object_info
+/// @memberof PtpRuntime
+int ptp_send_object_file(struct PtpRuntime *r, FILE *stream, int length);
+
 /// @brief Download an object from handle, to a local file (uses GetPartialObject)
 /// @memberof PtpRuntime
 int ptp_download_object(struct PtpRuntime *r, int handle, FILE *stream, size_t max);
@@ -135,10 +143,28 @@ int ptp_liveview_deinit(struct PtpRuntime *r);
 // Get a frame directly into a buffer. Size is expected to be from ptp_liveview_size()
 int ptp_liveview_frame(struct PtpRuntime *r, void *buffer);
 int ptp_liveview_type(struct PtpRuntime *r);
+// Vendor specific parts of ptp_liveview_frame
+int ptp_liveview_ml(struct PtpRuntime *r, uint8_t *buffer);
+int ptp_liveview_eos(struct PtpRuntime *r, uint8_t *buffer);
+// EOS only: get the next frame's JPEG as a pointer into the receive buffer, with no size cap.
+// Returns 0 with *length == 0 if no frame was sent. On success the runtime stays locked, and the
+// pointer stays valid, until ptp_liveview_release. Transactions from the same thread invalidate it.
+// The other blocks of the same response (ptp_eos_vf_next) can be read until then too.
+int ptp_liveview_eos_borrow(struct PtpRuntime *r, const uint8_t **jpeg, int *length);
+void ptp_liveview_release(struct PtpRuntime *r);
+// Expand packed RGB pixels to one of enum PtpLvPixelFormat, using SIMD when the CPU has it. Returns bytes written.
+int ptp_liveview_convert_rgb(void *out, const void *in, int pixels, int format);
+// Force the kernel ptp_liveview_convert_rgb uses: "avx2", "ssse3", "neon" or "scalar", NULL for the default.
+// For tests and benchmarks, not safe while another thread is converting. PTP_UNSUPPORTED if this CPU can't run it.
+int ptp_liveview_rgb_kernel(const char *name);
 
 // Get Magic Lantern transparent menus buffer - see https://github.com/petabyt/ptpview
 int ptp_ml_init_bmp_lv(struct PtpRuntime *r);
 int ptp_ml_get_bmp_lv(struct PtpRuntime *r, uint32_t **buffer_ptr);
+// Same as ptp_ml_get_bmp_lv, into a reusable buffer of PTP_ML_BMP_LV_WIDTH * PTP_ML_BMP_LV_HEIGHT BGRA pixels
+int ptp_ml_get_bmp_lv_frame(struct PtpRuntime *r, uint32_t *frame);
+#define PTP_ML_BMP_LV_WIDTH 720
+#define PTP_ML_BMP_LV_HEIGHT 480
 
 int ptp_chdk_get_version(struct PtpRuntime *r);
 int ptp_chdk_upload_file(struct PtpRuntime *r, char *input, char *dest);
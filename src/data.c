@@ -9,8 +9,8 @@
 
 #include <camlib.h>
 
-// Custom snprint with offset
-static int osnprintf(char *str, int cur, int size, const char *format, ...) {
+// Custom snprint with offset, returns the number of chars actually written
+int osnprintf(char *str, int cur, int size, const char *format, ...) {
 	if (size - cur < 0) {
 		ptp_panic("osnprintf overflow %d/%d", cur, size);
 		return 0;
@@ -22,6 +22,9 @@ static int osnprintf(char *str, int cur, int size, const char *format, ...) {
 	r = vsnprintf(str + cur, size - cur, format, args);
 	va_end(args);
 
+	// Cut off output stays cut off, instead of pushing cur past size
+	if (r < 0) return 0;
+	if (r > size - cur - 1) return size - cur > 0 ? size - cur - 1 : 0;
 	return r;
 }
 
@@ -41,15 +44,22 @@ int ptp_get_data_size(void *d, int type) {
 	case PTP_TC_INT64:
 	case PTP_TC_UINT64:
 		return 8;
+	// Sizes in bytes, including the length prefix
 	case PTP_TC_UINT8ARRAY:
+		ptp_read_u32(d, &length32);
+		return 4 + length32;
 	case PTP_TC_UINT16ARRAY:
+		ptp_read_u32(d, &length32);
+		return 4 + length32 * 2;
 	case PTP_TC_UINT32ARRAY:
+		ptp_read_u32(d, &length32);
+		return 4 + length32 * 4;
 	case PTP_TC_UINT64ARRAY:
 		ptp_read_u32(d, &length32);
-		return length32;
+		return 4 + length32 * 8;
 	case PTP_TC_STRING:
 		ptp_read_u8(d, &length8);
-		return length8;
+		return 1 + length8 * 2;
 	}
 
 	ptp_panic("Invalid size read");
@@ -216,9 +226,10 @@ int ptp_prop_desc_json(const struct PtpPropDesc *pd, char *buffer, int max) {
 		for (int i = 0; i < pd->enum_form->length; i++) {
 			char *end = ", ";
 			if (i >= pd->enum_form->length - 1) end = "";
-			uint32_t value;
+			uint32_t value = 0;
 			void *data = NULL;
 			of += parse_data_data_or_u32(pd->enum_form->data + of, pd->data_type, &value, &data);
+			free(data);
 			curr += osnprintf(buffer, curr, max, "%d%s", value, end);
 		}
 		curr += osnprintf(buffer, curr, max, "],\n");
@@ -297,7 +308,7 @@ int ptp_pack_object_info(struct PtpRuntime *r, struct PtpObjectInfo *oi, uint8_t
 void *ptp_pack_chdk_upload_file(struct PtpRuntime *r, char *in, char *out, int *length) {
 	FILE *f = fopen(in, "rb");
 	if (f == NULL) {
-		ptp_verbose_log("Unable to open %s\n", in);
+		ptp_log(PTP_LOG_ERR, PTP_LOG_CORE, "Unable to open %s\n", in);
 		return NULL;
 	}
 
@@ -343,6 +354,7 @@ int ptp_parse_device_info(struct PtpRuntime *r, struct PtpDeviceInfo *di) {
 	b += ptp_read_string(b, di->serial_number, sizeof(di->serial_number));
 
 	r->di = di; // set last parsed di
+	ptp_update_caps(r);
 
 	return 0;
 }
@@ -538,120 +550,152 @@ int ptp_eos_prop_next(uint8_t *d, struct PtpGenericEvent *p) {
 	return 0;
 }
 
-// TODO: Stream reader for events
-struct PtpEventReader {
-	int entries;
-	int index;
-	void *ptr;
-};
-
 int ptp_eos_events_length(struct PtpRuntime *r) {
 	uint8_t *dp = ptp_get_payload(r);
+	uint8_t *end = dp + ptp_get_payload_length(r);
 
 	int length = 0;
-	while (dp != NULL) {
-		if (dp >= (uint8_t *)ptp_get_payload(r) + ptp_get_payload_length(r)) break;
-		uint8_t *d = dp;
+	while (end - dp >= 8) {
 		uint32_t size, type;
-		d += ptp_read_u32(d, &size);
-		d += ptp_read_u32(d, &type);
-
-		dp += size;
+		ptp_read_u32(dp, &size);
+		ptp_read_u32(dp + 4, &type);
 
 		// TODO: length is 1 when props list is invalid/empty
 		if (type == 0) break;
+		if (size < 8 || size > (uint32_t)(end - dp)) break;
 
+		dp += size;
 		length++;
 	}
 
 	return length;
 }
 
-// TODO: misnomer: ptp_eos_unpack_events
-// TODO: we should have a way to read next entry without allocating/freeing memory
-int ptp_eos_events(struct PtpRuntime *r, struct PtpGenericEvent **p) {
-	int length = ptp_eos_events_length(r);
+void ptp_eos_events_open(struct PtpRuntime *r, struct PtpEventReader *e) {
+	ptp_mutex_lock(r);
+	e->d = ptp_get_payload(r);
+	e->end = e->d + ptp_get_payload_length(r);
+}
 
-	if (length == 0) return 0;
-	if (length < 0) return length;
+void ptp_eos_events_close(struct PtpRuntime *r, struct PtpEventReader *e) {
+	e->d = e->end;
+	ptp_mutex_unlock(r);
+}
 
-	(*p) = malloc(sizeof(struct PtpGenericEvent) * length);
-	struct PtpGenericEvent *p_base = (*p);
+// Smallest entry (header included) that can be decoded as this type
+static uint32_t eos_event_min_size(uint32_t type, uint32_t size, uint8_t *d) {
+	switch (type) {
+	case PTP_EC_EOS_PropValueChanged: {
+		if (size < 16) return 16;
+		uint32_t code;
+		ptp_read_u32(d, &code);
+		if (code == PTP_PC_EOS_ImageFormat) return 32;
+		return 16;
+		}
+	case PTP_EC_EOS_RequestObjectTransfer:
+		return 16;
+	case PTP_EC_EOS_ObjectAddedEx:
+		return 8 + sizeof(uint32_t);
+	case PTP_EC_EOS_AvailListChanged:
+		return 20;
+	default:
+		return 8;
+	}
+}
 
-	uint8_t *dp = ptp_get_payload(r);
-	for (int i = 0; i < length; i++) {
-		struct PtpGenericEvent *cur = &p_base[i];
-		memset(cur, 0, sizeof(struct PtpGenericEvent));
+int ptp_eos_events_next(struct PtpRuntime *r, struct PtpEventReader *e, struct PtpGenericEvent *p) {
+	memset(p, 0, sizeof(struct PtpGenericEvent));
+	if (e->end - e->d < 8) return 0;
+
+	uint8_t *d = e->d;
+	uint32_t size, type;
+	d += ptp_read_u32(d, &size);
+	d += ptp_read_u32(d, &type);
+
+	// Detect termination or overflow
+	if (type == 0) return 0;
+	if (size < 8 || size > (uint32_t)(e->end - e->d) || size < eos_event_min_size(type, size, d)) {
+		ptp_log(PTP_LOG_WARN, PTP_LOG_VENDOR, "Bad EOS event size %u for %X\n", size, type);
+		e->d = e->end;
+		return PTP_CHECK_CODE;
+	}
 
-		uint8_t *d = dp;
+	// Move over for the next entry
+	e->d += size;
 
-		uint32_t size, type;
-		d += ptp_read_u32(d, &size);
-		d += ptp_read_u32(d, &type);
+	switch (type) {
+	case PTP_EC_EOS_PropValueChanged:
+		ptp_eos_prop_next(d, p);
+		break;
+	case PTP_EC_EOS_InfoCheckComplete:
+	case PTP_PC_EOS_FocusInfoEx:
+		p->name = ptp_get_enum_all(type);
+		break;
+	case PTP_EC_EOS_RequestObjectTransfer: {
+		uint32_t a, b;
+		d += ptp_read_u32(d, &a);
+		d += ptp_read_u32(d, &b);
+		p->name = "request object transfer";
+		p->code = a;
+		p->value = b;
+		} break;
+	case PTP_EC_EOS_ObjectAddedEx: {
+		struct PtpEOSObject *obj = (struct PtpEOSObject *)d;
+		p->name = "new object";
+		p->value = obj->a;
+		} break;
+	case PTP_EC_EOS_AvailListChanged: {
+		uint32_t code, dat_type, count;
+		d += ptp_read_u32(d, &code);
+		d += ptp_read_u32(d, &dat_type);
+		d += ptp_read_u32(d, &count);
+
+		int payload_size = (size - 20);
+
+		// Make sure to not divide by zero :)
+		if (payload_size != 0 && count != 0) {
+			int memb_size = payload_size / count;
+			ptp_set_prop_avail_info(r, code, memb_size, count, d);
+		}
+		} break;
+	}
 
-		// Detect termination or overflow
-		if (type == 0) break;
+	return 1;
+}
 
-		switch (type) {
-		case PTP_EC_EOS_PropValueChanged:
-			d += ptp_eos_prop_next(d, cur);
-			break;
-		case PTP_EC_EOS_InfoCheckComplete:
-		case PTP_PC_EOS_FocusInfoEx:
-			cur->name = ptp_get_enum_all(type);
-			break;
-		case PTP_EC_EOS_RequestObjectTransfer: {
-			uint32_t a, b;
-			d += ptp_read_u32(d, &a);
-			d += ptp_read_u32(d, &b);
-			cur->name = "request object transfer";
-			cur->code = a;
-			cur->value = b;
-			} break;
-		case PTP_EC_EOS_ObjectAddedEx: {
-			struct PtpEOSObject *obj = (struct PtpEOSObject *)d;
-			cur->name = "new object";
-			cur->value = obj->a;
-			} break;
-		case PTP_EC_EOS_AvailListChanged: {
-			uint32_t code, dat_type, count;
-			d += ptp_read_u32(d, &code);
-			d += ptp_read_u32(d, &dat_type);
-			d += ptp_read_u32(d, &count);
-
-			int payload_size = (size - 20);
-
-			// Make sure to not divide by zero :)
-			if (payload_size != 0 && count != 0) {
-				int memb_size = payload_size / count;
-				ptp_set_prop_avail_info(r, code, memb_size, count, d);
-			}
-			} break;
-		}
+// TODO: misnomer: ptp_eos_unpack_events
+int ptp_eos_events(struct PtpRuntime *r, struct PtpGenericEvent **p) {
+	int length = ptp_eos_events_length(r);
+	if (length <= 0) return length;
 
-		// Move dp over for the next entry
-		dp += size;
+	(*p) = malloc(sizeof(struct PtpGenericEvent) * length);
+	if (*p == NULL) return PTP_OUT_OF_MEM;
+
+	struct PtpEventReader e;
+	ptp_eos_events_open(r, &e);
+	int i = 0;
+	while (i < length && ptp_eos_events_next(r, &e, &(*p)[i]) == 1) {
+		i++;
 	}
+	ptp_eos_events_close(r, &e);
 
-	return length;
+	if (i == 0) {
+		free(*p);
+		(*p) = NULL;
+	}
+
+	return i;
 }
 
 int ptp_eos_events_json(struct PtpRuntime *r, char *buffer, int max) {
-	struct PtpGenericEvent *events = NULL;
-
-	int length = ptp_eos_events(r, &events);
-	if (length == 0) {
-		strncpy(buffer, "[]", max);
-		return 2;
-	}
+	struct PtpEventReader e;
+	struct PtpGenericEvent ev;
 
 	int curr = osnprintf(buffer, 0, max, "[");
-	for (int i = 0; i < length; i++) {
-		char *end = ",";
-		if (i - 1 == length) end = "";
+	ptp_eos_events_open(r, &e);
+	while (ptp_eos_events_next(r, &e, &ev) == 1) {
+		struct PtpGenericEvent *p = &ev;
 
-		struct PtpGenericEvent *p = &(events[i]);
-		
 		if (p->name == NULL) {
 			if (p->code == 0) continue;
 			curr += osnprintf(buffer, curr, max, "[%u, %u]", p->code, p->value);
@@ -663,10 +707,59 @@ int ptp_eos_events_json(struct PtpRuntime *r, char *buffer, int max) {
 			}
 		}
 
-		curr += osnprintf(buffer, curr, max, "%s\n", end);
+		curr += osnprintf(buffer, curr, max, ",\n");
 	}
+	ptp_eos_events_close(r, &e);
 
 	curr += osnprintf(buffer, curr, max, "]");
 
 	return curr;
 }
+
+void ptp_eos_vf_iter(struct PtpRuntime *r, struct PtpEOSViewFinderIter *it) {
+	it->d = ptp_get_payload(r);
+	it->end = it->d + ptp_get_payload_length(r);
+}
+
+int ptp_eos_vf_next(struct PtpEOSViewFinderIter *it, struct PtpEOSViewFinderBlock *b) {
+	if (it->end - it->d < 8) return 0;
+
+	uint32_t length, type;
+	ptp_read_u32(it->d, &length);
+	ptp_read_u32(it->d + 4, &type);
+	if (length < 8 || length > (uint32_t)(it->end - it->d)) {
+		ptp_log(PTP_LOG_WARN, PTP_LOG_VENDOR, "Bad viewfinder block length %u\n", length);
+		return PTP_CHECK_CODE;
+	}
+
+	b->type = type;
+	b->data = it->d + 8;
+	b->length = (int)length - 8;
+
+	it->d += length;
+	return 1;
+}
+
+int ptp_eos_vf_find(struct PtpRuntime *r, uint32_t type, struct PtpEOSViewFinderBlock *b) {
+	struct PtpEOSViewFinderIter it;
+	ptp_eos_vf_iter(r, &it);
+
+	int rc;
+	while ((rc = ptp_eos_vf_next(&it, b)) == 1) {
+		if (b->type == type) return 0;
+	}
+
+	return rc ? rc : PTP_CHECK_CODE;
+}
+
+int ptp_eos_vf_find_jpeg(struct PtpRuntime *r, struct PtpEOSViewFinderBlock *b) {
+	struct PtpEOSViewFinderIter it;
+	ptp_eos_vf_iter(r, &it);
+
+	int rc;
+	while ((rc = ptp_eos_vf_next(&it, b)) == 1) {
+		if (b->type == PTP_EOS_VF_JPEG || b->type == PTP_EOS_VF_JPEG2 || b->type == PTP_EOS_VF_JPEG3) return 0;
+	}
+
+	return rc ? rc : PTP_CHECK_CODE;
+}
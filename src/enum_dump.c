@@ -563,3 +563,259 @@ struct PtpEnum ptp_enums[] = {
 {PTP_ENUM, 0, "USB_TYPE_CLASS", 0x20},
 
 };int ptp_enums_length = 560;
+
+static const unsigned short ptp_enum_by_value_seeds[] = {
+2, 0, 2, 11, 1, 1, 2, 2, 6, 1, 1, 1, 1, 1, 3, 0,
+7, 0, 1, 1, 5, 9, 6, 18, 32, 15, 9, 8, 30, 6, 5, 16,
+1, 3, 14, 2, 1, 0, 0, 19, 3, 4, 1, 18, 6, 1, 32, 32,
+1, 7, 10, 0, 1, 1, 7, 3, 0, 1, 8, 2, 16, 3, 0, 0,
+4, 2, 2, 29, 6, 29, 1, 12, 2, 1, 1, 35, 25, 2, 0, 4,
+32, 34, 14, 5, 1, 0, 1, 8, 5, 5, 4, 8, 0, 3, 2, 7,
+2, 20, 5, 4, 3, 53, 4, 1, 1, 0, 2, 10, 5, 0, 0, 1,
+1, 18, 10, 18, 2, 1, 0, 2, 8, 4, 9, 10, 6, 9, 7, 8,
+1, 10, 2, 11, 16, 1, 1, 3, 3, 0, 66, 0, 22, 33, 10, 0,
+26, 72, 1, 4, 8, 32, 18, 72, 1, 14, 4, 4, 1, 24, 4, 13,
+45, 13, 1, 2, 2, 4, 9, 0, 10, 1, 36, 1, 4, 20, 18, 1,
+10, 32, 35, 0, 0, 33, 5, 14, 2, 4, 7, 1, 0, 10, 1, 1,
+13, 0, 0, 0, 48, 5, 34, 3, 0, 15, 3, 0, 6, 6, 72, 20,
+1, 11, 22, 20, 1, 4, 17, 18, 18, 1, 23, 0, 42, 12, 2, 27,
+8, 1, 2, 17, 19, 0, 10, 16, 1, 14, 27, 6, 1, 1, 2, 5,
+1, 65, 33, 32, 30, 0, 32, 0, 0, 0, 23, 2, 1, 13, 6, 45,
+};
+static const short ptp_enum_by_value_index[] = {
+1, -1, 183, 472, 546, 174, -1, 432, -1, -1, 215, 396, -1, 417, -1, 523,
+307, -1, -1, -1, 353, 72, 154, 121, 30, 409, -1, -1, 282, -1, 468, 0,
+-1, 424, 492, -1, 377, 4, -1, -1, -1, 280, 383, 281, -1, 265, -1, -1,
+195, -1, -1, -1, -1, 333, 321, 367, -1, -1, 119, 88, -1, 31, 100, 359,
+216, 75, -1, -1, 197, 97, 52, 170, -1, 327, -1, 95, 229, 81, -1, 9,
+318, -1, 255, 297, 339, -1, -1, 267, 369, -1, 79, -1, -1, -1, 22, 464,
+137, 326, 337, -1, -1, 300, -1, 412, 278, 187, 165, -1, 42, 203, -1, -1,
+-1, 180, -1, 456, -1, 483, -1, 273, 269, 310, 134, -1, 228, 112, 545, -1,
+352, -1, 217, -1, -1, -1, -1, 168, 543, 102, -1, -1, 470, 331, 23, -1,
+7, 77, -1, 125, -1, 64, 239, -1, 419, -1, 311, 341, -1, 221, -1, 11,
+-1, 442, 332, -1, 499, 392, 45, 54, 242, -1, 93, 192, 484, 27, -1, -1,
+-1, -1, -1, 346, -1, 103, 28, -1, 276, 487, -1, 80, -1, 179, -1, -1,
+188, -1, 41, -1, -1, 421, 324, 408, -1, -1, -1, -1, 169, 422, -1, -1,
+309, -1, 336, 370, 178, -1, -1, -1, 335, -1, 317, -1, -1, 158, -1, 224,
+449, 279, 47, -1, 204, -1, -1, 117, 264, -1, 323, -1, -1, 519, -1, 65,
+390, -1, -1, 20, 290, -1, 416, -1, -1, -1, 145, 33, 275, -1, 437, -1,
+131, -1, 198, 289, -1, 25, 254, 304, -1, 161, -1, 458, 115, -1, 236, -1,
+-1, -1, 24, 182, -1, 433, -1, 39, -1, 111, -1, -1, -1, 232, -1, -1,
+-1, 129, 463, 113, -1, -1, -1, 460, 186, -1, -1, 226, 495, 328, 247, 479,
+500, 123, 550, 208, 450, -1, -1, -1, -1, 26, -1, -1, 12, -1, -1, 51,
+379, -1, 243, -1, -1, 444, -1, 529, 189, -1, 348, -1, -1, 301, -1, -1,
+-1, 71, -1, 314, 469, -1, 66, 428, -1, -1, -1, 118, 252, 193, 211, -1,
+-1, 284, -1, 322, 34, -1, 48, -1, -1, 233, 2, 230, 259, -1, -1, 486,
+340, 257, 122, 175, 108, 402, -1, 382, -1, -1, -1, 164, 50, -1, 521, -1,
+-1, 152, 87, 441, -1, 14, -1, -1, -1, -1, -1, 277, -1, 130, -1, -1,
+-1, 291, 160, 356, -1, 85, -1, 126, -1, -1, -1, 395, -1, 5, -1, -1,
+393, -1, -1, 285, -1, 549, 139, -1, 214, 373, 270, -1, -1, 8, -1, 185,
+-1, 555, -1, -1, -1, -1, 429, 485, 104, 219, -1, 400, 227, -1, 497, -1,
+362, -1, 496, -1, 465, -1, -1, -1, -1, 481, 414, -1, -1, -1, 292, 78,
+329, -1, 404, -1, 151, 36, 153, 69, -1, 21, -1, -1, 345, 431, 443, -1,
+-1, 547, 43, 222, 194, -1, 374, -1, 237, 355, -1, -1, 68, 155, 89, -1,
+473, 343, -1, -1, -1, -1, -1, -1, -1, 344, 453, -1, -1, 184, -1, 303,
+-1, -1, -1, -1, 82, -1, -1, -1, 148, -1, 457, -1, 251, -1, -1, 223,
+-1, -1, 294, 105, 58, 334, -1, 144, -1, 162, 357, 436, 411, 399, 471, 73,
+150, -1, -1, 491, -1, -1, -1, 159, 38, -1, -1, 542, 260, 220, 415, 407,
+401, -1, -1, 349, 302, -1, -1, 245, -1, -1, 37, -1, 191, -1, -1, -1,
+256, -1, 201, -1, 440, -1, -1, -1, 498, 501, -1, -1, -1, 199, -1, 325,
+76, 10, -1, 385, 32, 490, 405, 467, -1, 316, -1, 298, 287, 378, 17, 40,
+-1, -1, -1, 63, -1, -1, 403, 446, 109, -1, -1, -1, -1, 173, -1, -1,
+319, 263, -1, -1, -1, 366, -1, -1, 246, -1, 364, 74, 62, -1, -1, -1,
+234, -1, -1, 19, 489, 156, -1, -1, 205, -1, 338, -1, -1, -1, 167, 147,
+-1, -1, -1, 299, -1, 99, 522, 305, 94, 248, -1, -1, -1, -1, -1, 286,
+-1, 445, 207, 439, -1, -1, 315, 361, -1, -1, -1, 476, 372, -1, 398, -1,
+423, -1, -1, 452, 146, 371, 110, -1, -1, -1, 143, 57, -1, 350, 363, 240,
+-1, -1, -1, -1, -1, -1, 477, -1, 524, -1, -1, 149, -1, 494, 478, -1,
+347, 241, -1, -1, -1, 394, 140, 272, -1, 157, 342, -1, -1, 375, -1, 266,
+-1, 493, -1, 181, -1, 91, 438, -1, 313, 413, 544, -1, -1, 296, -1, 435,
+250, 426, 60, 128, 190, -1, -1, -1, -1, 35, 448, 136, -1, -1, 430, 459,
+380, -1, -1, -1, 141, -1, 6, -1, -1, -1, -1, 261, 434, -1, -1, 213,
+-1, 210, -1, -1, -1, -1, 358, -1, -1, -1, -1, 293, 386, -1, -1, -1,
+312, 376, 98, -1, -1, -1, -1, 61, -1, -1, 46, 368, -1, 320, -1, -1,
+258, -1, 461, 212, 18, -1, -1, -1, -1, 391, -1, 90, -1, -1, 360, 410,
+-1, -1, 107, 196, -1, -1, -1, 132, -1, -1, 425, -1, -1, 427, -1, 253,
+-1, -1, -1, 330, -1, -1, 420, -1, 200, -1, -1, -1, 29, -1, 142, 462,
+-1, 548, -1, -1, -1, 49, -1, -1, 218, -1, -1, 365, -1, -1, 387, 166,
+488, -1, -1, 238, -1, 3, 53, -1, 55, 70, 454, -1, -1, -1, -1, 133,
+-1, -1, -1, -1, 44, 209, 86, -1, 295, 171, -1, -1, -1, 101, -1, 59,
+-1, -1, 16, -1, -1, -1, 120, -1, 231, 244, -1, 116, -1, -1, -1, -1,
+-1, -1, 202, 92, 502, -1, 397, -1, -1, -1, -1, 225, 176, -1, 163, 306,
+451, -1, 106, 288, -1, -1, -1, -1, 15, 56, -1, -1, -1, 124, -1, 249,
+271, -1, -1, -1, 474, -1, -1, -1, 127, 381, 480, -1, -1, -1, -1, 406,
+351, -1, -1, -1, -1, 138, -1, 274, 475, 13, 96, -1, -1, 235, -1, -1,
+283, 135, -1, 67, -1, -1, -1, 308, 559, -1, 384, -1, 268, 206, -1, 418,
+-1, -1, 466, -1, -1, -1, 354, -1, 482, -1, 177, -1, -1, -1, 114, 262,
+};
+const struct PtpEnumTable ptp_enum_by_value = {256, 1024, ptp_enum_by_value_seeds, ptp_enum_by_value_index};
+static const unsigned short ptp_enum_by_code_seeds[] = {
+2, 1, 0, 25, 11, 0, 2, 10, 0, 2, 1, 1, 22, 32, 3, 1,
+2, 16, 1, 12, 5, 17, 2, 9, 0, 1, 3, 57, 19, 16, 14, 5,
+1, 4, 35, 5, 3, 10, 25, 2, 0, 0, 5, 1, 11, 1, 39, 32,
+3, 0, 25, 3, 5, 2, 23, 4, 0, 1, 6, 5, 1, 1, 6, 1,
+1, 1, 2, 0, 1, 0, 1, 2, 0, 2, 19, 3, 4, 2, 16, 1,
+9, 7, 9, 3, 11, 0, 1, 5, 8, 32, 3, 8, 5, 18, 1, 3,
+1, 9, 65, 2, 16, 64, 1, 1, 5, 0, 0, 1, 17, 48, 0, 1,
+1, 14, 3, 7, 3, 1, 3, 3, 1, 2, 1, 0, 8, 0, 19, 12,
+4, 0, 0, 1, 25, 26, 0, 2, 1, 0, 70, 4, 15, 1, 13, 0,
+0, 8, 4, 5, 7, 26, 2, 14, 1, 1, 4, 1, 4, 11, 2, 4,
+0, 4, 9, 1, 2, 1, 42, 4, 8, 11, 4, 5, 56, 1, 36, 1,
+37, 48, 3, 0, 2, 33, 4, 8, 34, 2, 33, 5, 10, 24, 18, 1,
+5, 5, 0, 2, 3, 1, 11, 20, 7, 9, 2, 33, 1, 3, 68, 0,
+1, 35, 32, 36, 4, 1, 73, 32, 49, 46, 19, 0, 9, 17, 21, 6,
+6, 2, 0, 3, 20, 6, 20, 38, 1, 8, 1, 16, 33, 19, 35, 32,
+3, 39, 7, 4, 73, 0, 32, 0, 0, 24, 0, 39, 13, 0, 2, 1,
+};
+static const short ptp_enum_by_code_index[] = {
+1, 43, -1, -1, 22, -1, -1, -1, -1, 26, -1, 106, 153, 286, 427, 545,
+505, 0, -1, 72, 124, 38, 75, 356, -1, 68, 185, 380, 424, -1, 544, 521,
+460, -1, 184, 134, 387, 423, -1, 64, -1, 285, -1, 282, 507, 265, -1, 420,
+191, -1, 402, 162, -1, 321, 411, 368, -1, -1, 362, 471, -1, 230, -1, 350,
+-1, 395, -1, -1, 2, -1, 513, 444, 119, 324, -1, 371, 229, 37, -1, 115,
+318, 445, 255, 297, 339, -1, 7, 267, 448, -1, 175, 489, -1, -1, 179, 3,
+-1, 327, 307, -1, -1, 303, -1, 412, 257, -1, -1, -1, -1, -1, -1, -1,
+-1, 14, -1, -1, 59, 222, -1, 258, 262, 310, 525, -1, 96, -1, 543, -1,
+352, 67, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 23, 329, 547, -1,
+-1, 173, -1, 159, 234, -1, 76, -1, 313, -1, 311, 337, -1, 555, -1, -1,
+-1, 452, 298, 27, 248, 127, 25, -1, 240, -1, -1, -1, 299, 472, 87, -1,
+-1, 409, 145, 289, 373, 467, -1, 150, 272, -1, -1, 281, -1, 151, 135, -1,
+476, 155, -1, -1, 407, 131, 340, 108, 74, 142, -1, -1, -1, -1, -1, -1,
+344, -1, 333, 110, -1, -1, -1, -1, 335, -1, 369, -1, -1, -1, -1, 224,
+363, 461, -1, 454, 54, 198, -1, 370, 264, -1, 331, 147, -1, 519, -1, -1,
+-1, -1, -1, 85, 291, -1, -1, -1, -1, -1, 113, -1, 277, 188, -1, -1,
+-1, -1, -1, 336, 211, -1, 259, 315, -1, 86, 170, -1, -1, -1, 236, -1,
+-1, 428, -1, -1, -1, 226, 463, -1, -1, 181, -1, -1, -1, 244, -1, 163,
+-1, 80, -1, 176, -1, -1, 473, 465, -1, 45, 114, 228, -1, 322, 132, 207,
+122, -1, 214, -1, 510, 166, 189, 511, -1, 61, -1, 433, 227, -1, 4, -1,
+379, 385, 237, -1, -1, 82, -1, 529, -1, -1, 348, -1, 161, 301, 200, 154,
+-1, -1, -1, 314, -1, -1, 479, -1, 88, -1, 133, -1, 251, 417, 32, -1,
+500, 199, -1, 141, 183, -1, 435, -1, -1, 233, -1, 152, 144, -1, -1, 295,
+360, 261, 421, 203, 503, -1, -1, -1, 121, 190, 53, -1, 49, 130, 523, 443,
+225, 364, -1, 239, -1, 194, -1, 126, -1, -1, -1, 275, -1, -1, 21, -1,
+-1, 290, 243, 367, -1, 468, -1, 148, 406, -1, -1, 39, 171, 215, 167, -1,
+386, -1, 442, 526, -1, 548, -1, 35, 174, 422, 196, 419, -1, -1, -1, -1,
+-1, 391, -1, -1, -1, 50, 66, 13, -1, 219, -1, 149, -1, 90, 6, 46,
+416, -1, -1, -1, 486, -1, -1, 10, -1, 217, -1, -1, -1, 504, 319, -1,
+325, -1, 383, -1, 492, 69, -1, -1, 439, 103, -1, -1, 345, 453, 177, -1,
+-1, 550, 497, 218, -1, -1, 201, -1, 12, 346, 187, -1, -1, 197, -1, -1,
+104, 343, 5, 89, -1, -1, 52, -1, -1, 353, -1, -1, -1, -1, 55, 294,
+30, -1, 284, -1, 94, -1, 164, 488, -1, -1, 99, -1, 260, -1, -1, -1,
+-1, -1, 484, 372, -1, 334, 431, 527, 477, -1, 354, 111, -1, 9, 405, -1,
+-1, -1, 478, -1, -1, 494, -1, 169, -1, -1, -1, -1, 269, 221, 109, -1,
+-1, 480, -1, 349, 323, -1, 40, 232, 436, -1, 165, -1, 137, -1, -1, 414,
+256, -1, 341, -1, -1, -1, -1, -1, 288, 216, 139, 182, -1, 98, 117, 338,
+-1, 399, -1, -1, 456, -1, 70, -1, -1, 316, 458, 302, -1, 381, 549, 506,
+249, -1, -1, 425, -1, 41, 493, -1, 118, 482, -1, -1, -1, 394, -1, 81,
+317, 213, 138, -1, -1, 342, -1, 462, 246, 57, 328, -1, 542, -1, -1, -1,
+247, -1, -1, -1, 205, 168, -1, -1, 93, -1, 320, -1, -1, 430, -1, -1,
+-1, -1, 271, 392, -1, 31, 524, 305, 204, 160, 502, -1, -1, 278, 429, -1,
+-1, 283, 332, -1, 44, 410, 306, -1, -1, 51, -1, -1, 48, 71, 33, -1,
+475, -1, -1, 125, -1, 123, 42, -1, -1, 78, 501, -1, 457, 359, -1, 245,
+-1, -1, -1, -1, -1, 128, -1, 491, -1, 361, -1, -1, 408, -1, -1, 434,
+296, 365, 29, 19, -1, 156, 326, 276, -1, 102, 509, -1, -1, 376, -1, 426,
+446, -1, -1, 546, -1, -1, -1, -1, 107, -1, 522, -1, -1, 304, -1, 358,
+186, -1, -1, -1, -1, -1, 415, -1, -1, 116, -1, 483, -1, 58, 508, -1,
+378, -1, -1, 17, 377, -1, 60, 206, 202, 193, 105, 252, 28, 100, 449, 212,
+97, -1, 34, 390, -1, -1, 355, 464, -1, 62, -1, 293, -1, 451, -1, -1,
+312, 440, 95, -1, -1, 404, -1, 474, -1, -1, -1, 366, -1, 309, -1, 208,
+263, -1, -1, -1, 274, -1, -1, -1, -1, 398, -1, -1, -1, -1, 273, 112,
+466, 499, -1, -1, -1, -1, -1, 351, -1, 280, 20, -1, 8, -1, 441, 253,
+-1, -1, -1, 330, -1, 16, 209, -1, -1, -1, -1, -1, 192, 47, 136, -1,
+-1, -1, -1, -1, -1, 496, -1, 92, 223, 180, -1, -1, -1, -1, 437, -1,
+-1, -1, 210, 241, -1, -1, 73, -1, -1, -1, -1, -1, -1, 481, -1, 470,
+77, -1, -1, 178, -1, 469, -1, -1, 300, -1, -1, 63, 157, 292, 101, -1,
+459, 140, -1, -1, -1, -1, -1, 438, 231, 242, 65, 498, -1, 413, 403, 146,
+490, 375, -1, -1, 514, 450, -1, -1, -1, -1, 432, 220, -1, 485, 357, 158,
+-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 512, -1, 401, -1, 270,
+268, -1, 396, 36, -1, -1, 143, -1, -1, 374, 250, 287, 120, -1, -1, -1,
+347, 418, -1, -1, 393, -1, -1, 172, -1, -1, -1, 382, -1, 235, 238, 195,
+279, 528, -1, -1, 487, 400, -1, 308, 559, -1, 384, 129, 266, 24, 15, 18,
+11, 397, -1, -1, -1, -1, -1, 495, -1, 56, -1, 91, -1, -1, 79, 254,
+};
+const struct PtpEnumTable ptp_enum_by_code = {256, 1024, ptp_enum_by_code_seeds, ptp_enum_by_code_index};
+static const unsigned short ptp_enum_by_name_seeds[] = {
+0, 3, 4, 0, 3, 1, 1, 2, 0, 1, 1, 1, 2, 1, 0, 1,
+1, 1, 1, 3, 2, 2, 5, 1, 1, 2, 3, 0, 1, 2, 1, 6,
+0, 2, 2, 1, 1, 1, 0, 2, 1, 3, 4, 3, 2, 2, 1, 1,
+4, 1, 2, 2, 1, 0, 1, 0, 0, 4, 1, 6, 3, 3, 0, 1,
+5, 2, 6, 5, 3, 1, 1, 1, 1, 2, 1, 2, 1, 3, 1, 1,
+1, 1, 1, 5, 1, 2, 0, 1, 1, 1, 2, 1, 0, 1, 0, 1,
+2, 1, 3, 1, 0, 3, 0, 0, 2, 4, 0, 5, 3, 1, 1, 1,
+0, 1, 2, 2, 1, 2, 0, 1, 7, 3, 3, 1, 1, 3, 2, 0,
+2, 3, 3, 3, 1, 6, 4, 1, 6, 2, 2, 2, 13, 2, 1, 1,
+6, 1, 2, 1, 2, 4, 2, 1, 4, 3, 9, 1, 1, 1, 2, 1,
+3, 3, 1, 4, 1, 2, 2, 3, 1, 1, 3, 2, 5, 2, 2, 1,
+0, 1, 2, 2, 2, 2, 5, 3, 1, 2, 1, 4, 4, 1, 3, 0,
+5, 1, 3, 13, 1, 1, 13, 2, 1, 1, 2, 2, 1, 1, 2, 0,
+1, 5, 7, 10, 3, 1, 3, 21, 2, 5, 2, 2, 4, 1, 4, 2,
+1, 2, 0, 0, 3, 1, 1, 1, 1, 1, 15, 1, 1, 2, 8, 3,
+3, 3, 5, 6, 7, 1, 0, 3, 5, 1, 1, 2, 2, 1, 6, 1,
+};
+static const short ptp_enum_by_name_index[] = {
+190, 137, 10, -1, 128, 54, 138, 393, 441, 482, -1, 194, -1, -1, -1, 263,
+-1, 535, 71, -1, -1, -1, 356, -1, 256, 317, 113, -1, -1, -1, 223, -1,
+174, 359, 329, -1, 130, -1, 101, -1, -1, -1, 540, -1, -1, 487, 363, 538,
+-1, 0, -1, 414, -1, -1, 468, -1, 355, 360, 387, -1, -1, -1, 397, 421,
+-1, 183, 61, 75, 243, 303, 462, -1, 526, -1, 500, 79, -1, 319, 416, -1,
+126, 36, 53, 415, -1, 494, -1, 2, 4, 321, -1, 120, 105, 264, 114, -1,
+239, -1, 244, -1, -1, 220, 224, -1, -1, 517, -1, -1, 357, -1, 261, -1,
+-1, -1, -1, 143, 257, 425, -1, -1, -1, -1, -1, -1, 296, 556, 196, -1,
+-1, 297, -1, 499, 530, -1, -1, 509, 478, -1, -1, 472, 410, 73, -1, 83,
+-1, 62, -1, 449, 176, -1, 384, 428, 157, 514, 29, -1, 85, 532, -1, 30,
+-1, -1, -1, -1, -1, -1, -1, 160, -1, -1, 245, -1, 506, -1, -1, -1,
+-1, 241, -1, 259, -1, 331, 151, 290, -1, 377, -1, -1, 446, -1, -1, -1,
+-1, -1, 121, -1, 288, -1, 481, -1, -1, -1, 43, 551, -1, 203, 100, -1,
+477, 133, 486, -1, 381, 395, -1, 466, 554, -1, -1, -1, 108, 149, -1, -1,
+-1, 523, 467, 497, -1, 265, -1, -1, 515, 87, -1, 41, -1, -1, -1, 69,
+207, 96, 559, -1, -1, 423, 117, 1, -1, 332, 189, -1, 311, 154, 452, 422,
+474, -1, -1, -1, -1, 524, 81, 271, -1, -1, 464, 17, 248, 158, 302, 495,
+403, 476, 233, -1, -1, -1, -1, 323, 330, -1, 555, 295, 122, -1, -1, -1,
+-1, -1, 334, -1, 488, -1, -1, 375, 434, -1, -1, -1, 340, -1, -1, -1,
+278, -1, 129, 413, 171, -1, -1, 519, 501, -1, -1, 123, 364, 167, 427, 161,
+-1, 78, 118, -1, 76, 432, 34, -1, 492, 192, 49, -1, 401, -1, 533, 409,
+197, 7, 270, 391, -1, -1, 349, -1, -1, 242, -1, 186, 11, -1, 206, -1,
+-1, 404, 420, 507, 448, 115, -1, 19, -1, 182, 27, 439, 328, 216, -1, -1,
+341, -1, 134, -1, 550, -1, 283, -1, 44, 479, 200, 346, 333, -1, -1, -1,
+-1, -1, -1, -1, -1, -1, 367, 445, -1, -1, -1, 237, 300, -1, -1, 453,
+-1, 26, 430, 354, 547, -1, -1, -1, -1, -1, -1, -1, -1, -1, 512, -1,
+-1, 369, 287, -1, -1, 15, 56, 191, 250, 3, -1, 253, 273, 204, 178, 80,
+251, -1, 229, 188, -1, 459, 33, 235, -1, 511, -1, -1, -1, -1, 443, -1,
+9, 144, -1, 95, -1, -1, -1, 312, 368, 324, -1, -1, -1, 454, -1, 58,
+-1, 366, 20, 40, 215, 92, -1, 32, -1, 304, -1, 289, -1, 437, 392, 45,
+-1, 222, -1, -1, -1, -1, -1, -1, 38, 513, 305, 339, 516, 480, -1, 362,
+309, 269, -1, 382, 199, 165, 483, 201, -1, -1, 419, -1, 351, 136, 168, -1,
+544, -1, 326, -1, -1, -1, -1, 455, -1, 325, 227, 272, -1, -1, -1, -1,
+-1, 546, 315, 131, 520, -1, -1, 281, 246, -1, -1, 307, 376, 238, -1, 301,
+164, -1, 22, 228, -1, 424, 471, 504, -1, 91, 426, 276, 155, 124, -1, 433,
+21, -1, 266, 553, 262, -1, 127, -1, -1, -1, 531, 77, 152, -1, -1, 125,
+-1, 150, 521, -1, 436, 502, 6, -1, -1, 234, -1, -1, -1, -1, 51, -1,
+230, -1, -1, 97, 94, -1, 280, 181, -1, 451, 379, 209, 5, -1, -1, -1,
+274, -1, 327, -1, 24, 98, -1, 135, 485, 147, 470, -1, 162, 293, 365, -1,
+236, -1, -1, -1, -1, -1, -1, 35, 399, 306, -1, -1, 463, 159, -1, -1,
+-1, -1, -1, -1, 208, 291, 218, -1, 394, 187, 496, 308, 140, -1, -1, 279,
+-1, 338, 458, -1, -1, 55, -1, 145, 552, 282, 383, 294, -1, 353, -1, 232,
+-1, -1, -1, 405, -1, -1, -1, -1, 390, -1, 219, 536, 198, 193, 217, 460,
+-1, -1, -1, 343, -1, -1, 221, 226, 292, -1, 318, -1, 31, 169, 348, -1,
+-1, -1, 358, -1, 109, 370, -1, 166, 110, 498, -1, 412, -1, 537, 170, 450,
+411, -1, -1, -1, -1, 184, 46, -1, -1, -1, 435, -1, -1, -1, 39, 213,
+12, 398, 418, 102, 299, -1, -1, 456, -1, -1, 231, 175, -1, -1, 68, -1,
+-1, -1, 429, -1, -1, -1, -1, 90, -1, -1, 493, 557, -1, 177, 310, 541,
+103, -1, 545, -1, -1, 361, 275, 484, 255, -1, 286, -1, 267, -1, -1, -1,
+48, -1, -1, -1, -1, -1, -1, -1, 70, -1, 347, 543, 180, 314, -1, -1,
+505, -1, -1, 195, -1, -1, 465, 172, 285, -1, -1, 67, -1, 284, 25, -1,
+491, 444, -1, 86, 202, 406, -1, -1, 388, 558, 139, 342, 508, 240, -1, 352,
+65, -1, 374, 258, 371, 316, 320, 417, 28, 99, 548, -1, -1, -1, 104, 372,
+-1, -1, 431, 313, 518, -1, -1, 18, -1, -1, -1, -1, 88, 442, 534, 277,
+16, -1, 298, -1, 74, 47, -1, 461, 212, -1, 386, 447, -1, 549, -1, -1,
+63, -1, 42, 141, -1, 13, -1, -1, 57, -1, 322, 210, 66, 173, -1, 344,
+-1, 205, 408, 82, -1, 153, -1, 378, 214, 52, -1, -1, 64, -1, 350, 106,
+389, -1, -1, -1, -1, -1, -1, -1, 23, -1, -1, 112, -1, -1, 527, 335,
+146, -1, -1, -1, -1, -1, 132, 539, 225, -1, 211, 380, 156, 475, 528, -1,
+185, 72, -1, -1, 402, -1, -1, -1, 249, 337, -1, 522, 542, 163, 142, 407,
+396, 525, -1, 268, 440, 111, 60, 50, 254, 503, -1, 119, -1, 84, 116, 107,
+37, 179, 457, -1, -1, -1, 373, -1, -1, 247, -1, 260, -1, -1, -1, -1,
+-1, 93, 438, -1, 490, -1, -1, -1, 14, 510, 489, -1, -1, 385, -1, 89,
+252, -1, -1, 336, 400, -1, 345, 473, 59, -1, 529, -1, -1, 8, 469, 148,
+};
+const struct PtpEnumTable ptp_enum_by_name = {256, 1024, ptp_enum_by_name_seeds, ptp_enum_by_name_index};
@@ -1,8 +1,53 @@
 #include <string.h>
+#include <stdint.h>
 #include <camlib.h>
 
 char *enum_null = "(null)";
 
+// These must match the hash functions in stringify.py
+
+static uint32_t hash_int(uint32_t x, uint32_t seed) {
+	x ^= seed;
+	x *= 0x9e3779b1;
+	x ^= x >> 16;
+	x *= 0x85ebca6b;
+	x ^= x >> 13;
+	return x;
+}
+
+static uint32_t hash_str(const char *s, uint32_t seed) {
+	uint32_t h = 2166136261u ^ seed;
+	for (; *s != '\0'; s++) {
+		h ^= (uint8_t)*s;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+static uint32_t code_key(int type, int vendor, int value) {
+	return (uint32_t)value ^ ((uint32_t)type << 24) ^ ((uint32_t)vendor << 20);
+}
+
+// Returns the ptp_enums index in the slot for this key, the caller checks it's a match
+static int lookup_int(const struct PtpEnumTable *t, uint32_t key) {
+	uint32_t seed = t->seeds[hash_int(key, 0) & (t->buckets - 1)];
+	return t->index[hash_int(key, seed) & (t->size - 1)];
+}
+
+static int lookup_name(const char *string) {
+	const struct PtpEnumTable *t = &ptp_enum_by_name;
+	uint32_t seed = t->seeds[hash_str(string, 0) & (t->buckets - 1)];
+	int i = t->index[hash_str(string, seed) & (t->size - 1)];
+	if (i < 0 || strcmp(string, ptp_enums[i].name)) return -1;
+	return i;
+}
+
+static int lookup_code(int type, int vendor, int id) {
+	int i = lookup_int(&ptp_enum_by_code, code_key(type, vendor, id));
+	if (i < 0 || ptp_enums[i].value != id || ptp_enums[i].type != type || ptp_enums[i].vendor != vendor) return -1;
+	return i;
+}
+
 int ptp_enum_index(char *string, int *value, int i) {
 	if (i >= ptp_enums_length) {
 		return 1;
@@ -14,42 +59,31 @@ int ptp_enum_index(char *string, int *value, int i) {
 }
 
 int ptp_enum_all(char *string) {
-	for (int i = 0; i < ptp_enums_length; i++) {
-		if (!strcmp(string, ptp_enums[i].name)) {
-			return ptp_enums[i].value;
-		}
-	}
-
-	return -1;
+	int i = lookup_name(string);
+	if (i < 0) return -1;
+	return ptp_enums[i].value;
 }
 
 int ptp_enum(int type, char *string) {
-	for (int i = 0; i < ptp_enums_length; i++) {
-		if (!strcmp(string, ptp_enums[i].name) && ptp_enums[i].type == type) {
-			return ptp_enums[i].value;
-		}
-	}
-
-	return -1;
+	int i = lookup_name(string);
+	if (i < 0 || ptp_enums[i].type != type) return -1;
+	return ptp_enums[i].value;
 }
 
 char *ptp_get_enum_all(int id) {
-	for (int i = 0; i < ptp_enums_length; i++) {
-		if (id == ptp_enums[i].value) {
-			return ptp_enums[i].name;
-		}
-	}
-
-	return enum_null;
+	int i = lookup_int(&ptp_enum_by_value, (uint32_t)id);
+	if (i < 0 || ptp_enums[i].value != id) return enum_null;
+	return ptp_enums[i].name;
 }
 
 char *ptp_get_enum(int type, int vendor, int id) {
-	for (int i = 0; i < ptp_enums_length; i++) {
-		if (ptp_enums[i].value == id && ptp_enums[i].type == type
-				&& (ptp_enums[i].vendor == vendor || ptp_enums[i].vendor == PTP_DEV_EMPTY)) {
-			return ptp_enums[i].name;
-		}
+	// Vendor entries and generic ones are keyed separately, the one first in ptp_enums wins
+	int i = lookup_code(type, vendor, id);
+	if (vendor != PTP_DEV_EMPTY) {
+		int generic = lookup_code(type, PTP_DEV_EMPTY, id);
+		if (i < 0 || (generic >= 0 && generic < i)) i = generic;
 	}
 
-	return enum_null;
+	if (i < 0) return enum_null;
+	return ptp_enums[i].name;
 }
@@ -31,7 +31,7 @@ int ptp_validate_property_value(struct PtpRuntime *r, int prop_code, uint32_t va
 		}
 
 		if (value == cur_val) {
-			ptp_verbose_log("Found valid prop value %X for 0x%X\n", value, prop_code);
+			ptp_log(PTP_LOG_DEBUG, PTP_LOG_CORE, "Found valid prop value %X for 0x%X\n", value, prop_code);
 			return 0;
 		}
 	}
@@ -50,28 +50,17 @@ static int ptp_eos_set_validate_prop(struct PtpRuntime *r, int prop_code, uint32
 	return ptp_eos_set_prop_value(r, prop_code, value);
 }
 
-int ptp_set_generic_property(struct PtpRuntime *r, const char *name, int value) {
-	int dev = ptp_device_type(r);
+static int eos_set_generic_property(struct PtpRuntime *r, const char *name, int value) {
 	int rc = 0;
 	if (!strcmp(name, "aperture")) {
-		if (dev == PTP_DEV_EOS) {
-			rc = ptp_eos_set_validate_prop(r, PTP_PC_EOS_Aperture, ptp_eos_get_aperture(value, 1));
-		}
+		rc = ptp_eos_set_validate_prop(r, PTP_PC_EOS_Aperture, ptp_eos_get_aperture(value, 1));
 	} else if (!strcmp(name, "iso")) {
-		if (dev == PTP_DEV_EOS) {
-			rc = ptp_eos_set_validate_prop(r, PTP_PC_EOS_ISOSpeed, ptp_eos_get_iso(value, 1));
-		}
+		rc = ptp_eos_set_validate_prop(r, PTP_PC_EOS_ISOSpeed, ptp_eos_get_iso(value, 1));
 	} else if (!strcmp(name, "shutter speed")) {
-		if (dev == PTP_DEV_EOS) {
-			rc = ptp_eos_set_validate_prop(r, PTP_PC_EOS_ShutterSpeed, ptp_eos_get_shutter(value, 1));
-		}
+		rc = ptp_eos_set_validate_prop(r, PTP_PC_EOS_ShutterSpeed, ptp_eos_get_shutter(value, 1));
 	} else if (!strcmp(name, "white balance")) {
-		if (dev == PTP_DEV_EOS) {
-			rc = ptp_eos_set_prop_value(r, PTP_PC_EOS_WhiteBalance, ptp_eos_get_white_balance(value, 1));
-			rc = ptp_eos_set_prop_value(r, PTP_PC_EOS_EVFWBMode, ptp_eos_get_white_balance(value, 1));
-		}
-	} else if (!strcmp(name, "destination")) {
-		return PTP_UNSUPPORTED;
+		rc = ptp_eos_set_prop_value(r, PTP_PC_EOS_WhiteBalance, ptp_eos_get_white_balance(value, 1));
+		rc = ptp_eos_set_prop_value(r, PTP_PC_EOS_EVFWBMode, ptp_eos_get_white_balance(value, 1));
 	} else {
 		return PTP_UNSUPPORTED;
 	}
@@ -79,35 +68,97 @@ int ptp_set_generic_property(struct PtpRuntime *r, const char *name, int value)
 	return rc;
 }
 
-// Required for ptp_take_picture
-int ptp_pre_take_picture(struct PtpRuntime *r) {
-	if (ptp_device_type(r) == PTP_DEV_EOS) {
-		// Shutter half down, wait up to 10s for focus 
-		r->wait_for_response = 10;
-		int rc = ptp_eos_remote_release_on(r, 1);
-		if (rc) return rc;
-	}
+static int eos_pre_take_picture(struct PtpRuntime *r) {
+	// Shutter half down, wait up to 10s for focus 
+	r->wait_for_response = 10;
+	return ptp_eos_remote_release_on(r, 1);
+}
+
+static int eos_take_picture(struct PtpRuntime *r) {
+	// Shutter fully down, wait up to 3s for flash to pop up
+	r->wait_for_response = 3;
+	int rc = ptp_eos_remote_release_on(r, 2);
+	if (rc) return rc;
+
+	rc = ptp_eos_remote_release_off(r, 2);
+	if (rc) return rc;
 
-	return 0;	
+	rc = ptp_eos_remote_release_off(r, 1);
+	if (rc) return rc;
+
+	return 0;
 }
 
-int ptp_take_picture(struct PtpRuntime *r) {
-	if (ptp_device_type(r) == PTP_DEV_EOS) {
-		// Shutter fully down, wait up to 3s for flash to pop up
-		r->wait_for_response = 3;
-		int rc = ptp_eos_remote_release_on(r, 2);
-		if (rc) return rc;
+static int eos_bulb_start(struct PtpRuntime *r) {
+	int rc = ptp_eos_remote_release_on(r, 1);
+	if (ptp_get_return_code(r) != PTP_RC_OK) return PTP_CHECK_CODE;
+	rc = ptp_eos_remote_release_on(r, 2);
+	if (ptp_get_return_code(r) != PTP_RC_OK) return PTP_CHECK_CODE;
+	return rc;
+}
 
-		rc = ptp_eos_remote_release_off(r, 2);
-		if (rc) return rc;
+static int eos_bulb_stop(struct PtpRuntime *r) {
+	int rc = ptp_eos_remote_release_off(r, 2);
+	if (ptp_get_return_code(r) != PTP_RC_OK) return PTP_CHECK_CODE;
+	rc = ptp_eos_remote_release_off(r, 1);
+	if (ptp_get_return_code(r) != PTP_RC_OK) return PTP_CHECK_CODE;
+	return rc;
+}
 
-		rc = ptp_eos_remote_release_off(r, 1);
-		if (rc) return rc;
+static int eos_set_mirror(struct PtpRuntime *r, int up) {
+	return ptp_eos_set_prop_value(r, PTP_PC_EOS_VF_Output, up ? 3 : 0);
+}
 
-		return 0;
+static const struct PtpVendorOps eos_ops = {
+	.set_prop_value = ptp_eos_set_prop_value,
+	.set_generic_property = eos_set_generic_property,
+	.pre_take_picture = eos_pre_take_picture,
+	.take_picture = eos_take_picture,
+	.bulb_start = eos_bulb_start,
+	.bulb_stop = eos_bulb_stop,
+	.drive_lens = ptp_eos_drive_lens,
+	.set_mirror = eos_set_mirror,
+};
+
+// Anything that only speaks standard PTP
+static const struct PtpVendorOps generic_ops = {
+	.set_prop_value = ptp_set_prop_value,
+};
+
+const struct PtpVendorOps *ptp_get_vendor_ops(int vendor) {
+	switch (vendor) {
+	case PTP_DEV_EOS:
+		return &eos_ops;
+	default:
+		return &generic_ops;
 	}
+}
 
-	return PTP_UNSUPPORTED;
+int ptp_set_generic_property(struct PtpRuntime *r, const char *name, int value) {
+	const struct PtpVendorOps *ops = ptp_get_profile(r)->ops;
+	if (ops->set_generic_property == NULL) {
+		// Other vendors have always accepted (and ignored) the known names
+		if (!strcmp(name, "aperture") || !strcmp(name, "iso") || !strcmp(name, "shutter speed")
+				|| !strcmp(name, "white balance")) {
+			return 0;
+		}
+		return PTP_UNSUPPORTED;
+	}
+
+	return ops->set_generic_property(r, name, value);
+}
+
+// Required for ptp_take_picture
+int ptp_pre_take_picture(struct PtpRuntime *r) {
+	const struct PtpVendorOps *ops = ptp_get_profile(r)->ops;
+	if (ops->pre_take_picture == NULL) return 0;
+	return ops->pre_take_picture(r);
+}
+
+int ptp_take_picture(struct PtpRuntime *r) {
+	const struct PtpVendorOps *ops = ptp_get_profile(r)->ops;
+	if (ops->take_picture == NULL) return PTP_UNSUPPORTED;
+	return ops->take_picture(r);
 }
 
 int ptp_events_json(struct PtpRuntime *r, char *buffer, int max) {
@@ -1,6 +1,10 @@
 // POSIX PTP/IP implementation
 // Copyright 2023 by Daniel C (https://github.com/petabyt/camlib)
 
+#ifdef __linux__
+	#define _GNU_SOURCE // splice
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -10,18 +14,34 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 #include <netinet/tcp.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#ifdef __linux__
+	#include <sys/sendfile.h>
+#endif
 
 #include <camlib.h>
 #include <ptp.h>
 
+// Size of the per-connection receive buffer, small packets are framed out of it
+#ifndef PTPIP_RX_BUFFER_SIZE
+	#define PTPIP_RX_BUFFER_SIZE 16384
+#endif
+
 #define DEBUG_BYTES() for (int i = 0; i < result; i++) { printf("%02X ", ((uint8_t *)data)[i]); } puts("");
 
 struct PtpIpBackend {
 	int fd;
 	int evfd;
+	// Pipe for splicing the socket into files, opened on first use
+	int splice_pipe[2];
+	int splice_failed;
+	// Bytes read from fd but not yet consumed, rx[rx_start..rx_end)
+	int rx_start;
+	int rx_end;
+	uint8_t rx[PTPIP_RX_BUFFER_SIZE];
 };
 
 static int set_nonblocking_io(int sockfd, int enable) {
@@ -58,13 +78,13 @@ int ptpip_new_timeout_socket(const char *addr, int port) {
 	);
 
 	if (sockfd < 0) {
-		ptp_verbose_log("Failed to create socket\n");
+		ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Failed to create socket\n");
 		return -1;
 	}
 
 	if (set_nonblocking_io(sockfd, 1) < 0) {
 		close(sockfd);
-		ptp_verbose_log("Failed to set non-blocking IO\n");
+		ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Failed to set non-blocking IO\n");
 		return -1;
 	}
 
@@ -74,14 +94,14 @@ int ptpip_new_timeout_socket(const char *addr, int port) {
 	sa.sin_port = htons(port);
 	if (inet_pton(AF_INET, addr, &(sa.sin_addr)) <= 0) {
 		close(sockfd);
-		ptp_verbose_log("Failed to convert IP address\n");
+		ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Failed to convert IP address\n");
 		return -1;
 	}
 
 	if (connect(sockfd, (struct sockaddr*)&sa, sizeof(sa)) < 0) {
 		if (errno != EINPROGRESS) {
 			close(sockfd);
-			ptp_verbose_log("Failed to connect to socket\n");
+			ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Failed to connect to socket\n");
 			return -1;
 		}
 	}
@@ -99,19 +119,19 @@ int ptpip_new_timeout_socket(const char *addr, int port) {
 		socklen_t len = sizeof(so_error);
 		if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &so_error, &len) < 0) {
 			close(sockfd);
-			ptp_verbose_log("Failed to get socket options\n");
+			ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Failed to get socket options\n");
 			return -1;
 		}
 
 		if (so_error == 0) {
-			ptp_verbose_log("Connection established %s:%d (%d)\n", addr, port, sockfd);
+			ptp_log(PTP_LOG_INFO, PTP_LOG_IP, "Connection established %s:%d (%d)\n", addr, port, sockfd);
 			set_nonblocking_io(sockfd, 0); // ????
 			return sockfd;
 		}
 	}
 
 	close(sockfd);
-	ptp_verbose_log("Failed to connect\n");
+	ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Failed to connect\n");
 	return -1;
 }
 
@@ -130,6 +150,8 @@ int ptpip_connect(struct PtpRuntime *r, const char *addr, int port) {
 
 	if (fd > 0) {
 		b->fd = fd;
+		b->rx_start = 0;
+		b->rx_end = 0;
 		r->io_kill_switch = 0;
 		return 0;
 	} else {
@@ -156,12 +178,21 @@ int ptpip_close(struct PtpRuntime *r) {
 	struct PtpIpBackend *b = init_comm(r);
 	if (b->fd) close(b->fd);
 	if (b->evfd) close(b->evfd);
+	if (b->splice_pipe[0]) {
+		close(b->splice_pipe[0]);
+		close(b->splice_pipe[1]);
+		b->splice_pipe[0] = 0;
+		b->splice_pipe[1] = 0;
+	}
+	b->rx_start = 0;
+	b->rx_end = 0;
 	return 0;
 }
 
 int ptpip_cmd_write(struct PtpRuntime *r, void *data, int size) {
 	if (r->io_kill_switch) return -1;
-	struct PtpIpBackend *b = init_comm(r); // calling this seems slow?
+	struct PtpIpBackend *b = (struct PtpIpBackend *)r->comm_backend;
+	if (b == NULL) return -1;
 	int result = write(b->fd, data, size);
 	if (result < 0) {
 		return -1;
@@ -170,15 +201,173 @@ int ptpip_cmd_write(struct PtpRuntime *r, void *data, int size) {
 	}
 }
 
+// Hand out buffered bytes first
+static int rx_take(struct PtpIpBackend *b, void *data, int size) {
+	int avail = b->rx_end - b->rx_start;
+	if (size > avail) size = avail;
+	memcpy(data, b->rx + b->rx_start, size);
+	b->rx_start += size;
+	if (b->rx_start == b->rx_end) {
+		b->rx_start = 0;
+		b->rx_end = 0;
+	}
+	return size;
+}
+
+// Reads go through a receive buffer, so reading a packet length and then the rest of a small
+// packet costs one read() instead of two. Big reads with nothing buffered go straight to data.
 int ptpip_cmd_read(struct PtpRuntime *r, void *data, int size) {
 	if (r->io_kill_switch) return -1;
+	struct PtpIpBackend *b = (struct PtpIpBackend *)r->comm_backend;
+	if (b == NULL) return -1;
+
+	if (b->rx_end != b->rx_start) {
+		return rx_take(b, data, size);
+	}
+
+	if (size >= PTPIP_RX_BUFFER_SIZE) {
+		int result = read(b->fd, data, size);
+		if (result < 0) return -1;
+		return result;
+	}
+
+	int result = read(b->fd, b->rx, PTPIP_RX_BUFFER_SIZE);
+	if (result <= 0) {
+		return result < 0 ? -1 : 0;
+	}
+	b->rx_end = result;
+
+	return rx_take(b, data, size);
+}
+
+int ptpip_cmd_writev(struct PtpRuntime *r, void *header, int header_length, void *payload, int payload_length) {
+	if (r->io_kill_switch) return -1;
+	struct PtpIpBackend *b = (struct PtpIpBackend *)r->comm_backend;
+	if (b == NULL) return -1;
+
+	struct iovec iov[2];
+	iov[0].iov_base = header;
+	iov[0].iov_len = header_length;
+	iov[1].iov_base = payload;
+	iov[1].iov_len = payload_length;
+
+	struct iovec *v = iov;
+	int count = 2;
+	int total = 0;
+	while (count) {
+		ssize_t result = writev(b->fd, v, count);
+		if (result <= 0) return -1;
+		total += (int)result;
+
+		// Skip past whatever was written, the socket may take less than everything
+		while (count && (size_t)result >= v->iov_len) {
+			result -= v->iov_len;
+			v++;
+			count--;
+		}
+		if (count) {
+			v->iov_base = (uint8_t *)v->iov_base + result;
+			v->iov_len -= result;
+		}
+	}
+
+	return total;
+}
+
+int ptpip_cmd_sendfile(struct PtpRuntime *r, int fd, int size) {
+	if (r->io_kill_switch) return -1;
+#ifdef __linux__
 	struct PtpIpBackend *b = init_comm(r);
-	int result = read(b->fd, data, size);
+	ssize_t result = sendfile(b->fd, fd, NULL, size);
 	if (result < 0) {
+		if (errno == EINVAL || errno == ENOSYS) return PTP_UNSUPPORTED;
 		return -1;
-	} else {
-		return result;
 	}
+
+	return (int)result;
+#else
+	return PTP_UNSUPPORTED;
+#endif
+}
+
+#ifdef __linux__
+// Empty the pipe with plain reads and writes, after the fd refused a splice
+static int drain_pipe(int pipefd, int fd, ssize_t length) {
+	char buffer[4096];
+	while (length > 0) {
+		ssize_t n = read(pipefd, buffer, length < (ssize_t)sizeof(buffer) ? length : (ssize_t)sizeof(buffer));
+		if (n <= 0) return -1;
+		length -= n;
+
+		char *p = buffer;
+		while (n > 0) {
+			ssize_t w = write(fd, p, n);
+			if (w <= 0) return -1;
+			p += w;
+			n -= w;
+		}
+	}
+
+	return 0;
+}
+#endif
+
+int ptpip_cmd_splice(struct PtpRuntime *r, int fd, int size) {
+	if (r->io_kill_switch) return -1;
+#ifdef __linux__
+	struct PtpIpBackend *b = init_comm(r);
+
+	// Whatever the receive buffer already holds has to go first
+	if (b->rx_end != b->rx_start) {
+		int n = b->rx_end - b->rx_start;
+		if (n > size) n = size;
+		ssize_t w = write(fd, b->rx + b->rx_start, n);
+		if (w <= 0) return -1;
+		b->rx_start += (int)w;
+		if (b->rx_start == b->rx_end) {
+			b->rx_start = 0;
+			b->rx_end = 0;
+		}
+		return (int)w;
+	}
+
+	if (b->splice_failed) return PTP_UNSUPPORTED;
+
+	if (b->splice_pipe[0] == 0) {
+		if (pipe(b->splice_pipe)) return PTP_UNSUPPORTED;
+		// Bigger pipe means fewer round trips, fine if this fails
+		fcntl(b->splice_pipe[1], F_SETPIPE_SZ, CAMLIB_STREAM_CHUNK);
+	}
+
+	ssize_t in = splice(b->fd, NULL, b->splice_pipe[1], NULL, size, SPLICE_F_MOVE | SPLICE_F_MORE);
+	if (in < 0) {
+		if (errno == EINVAL) {
+			b->splice_failed = 1;
+			return PTP_UNSUPPORTED;
+		}
+		return -1;
+	} else if (in == 0) {
+		return -1;
+	}
+
+	ssize_t out = 0;
+	while (out < in) {
+		ssize_t rc = splice(b->splice_pipe[0], NULL, fd, NULL, in - out, SPLICE_F_MOVE);
+		if (rc < 0 && errno == EINVAL) {
+			// Data is already in the pipe, so finish this piece by hand and stop splicing
+			b->splice_failed = 1;
+			if (drain_pipe(b->splice_pipe[0], fd, in - out)) return -1;
+			break;
+		} else if (rc <= 0) {
+			return -1;
+		}
+		out += rc;
+	}
+
+	return (int)in;
+#else
+	return PTP_UNSUPPORTED;
+#endif
 }
 
 int ptpip_event_send(struct PtpRuntime *r, void *data, int size) {
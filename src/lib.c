@@ -4,6 +4,8 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
+#include <unistd.h>
 
 #include <camlib.h>
 #include <ptp.h>
@@ -20,9 +22,13 @@ void ptp_reset(struct PtpRuntime *r) {
 void ptp_init(struct PtpRuntime *r) {
 	memset(r, 0, sizeof(struct PtpRuntime));
 	ptp_reset(r);
+	ptp_update_caps(r);
 
 	r->data = malloc(CAMLIB_DEFAULT_SIZE);
 	r->data_length = CAMLIB_DEFAULT_SIZE;
+	r->data_max_size = CAMLIB_MAX_BUFFER_SIZE;
+	r->buffer_stats.peak_size = CAMLIB_DEFAULT_SIZE;
+	r->buffer_stats.current_size = CAMLIB_DEFAULT_SIZE;
 
 	r->avail = calloc(1, sizeof(struct PtpPropAvail));
 
@@ -36,7 +42,7 @@ void ptp_init(struct PtpRuntime *r) {
 	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
 
 	if (pthread_mutex_init(r->mutex, &attr)) {
-		ptp_verbose_log("Failed to init mutex\n");
+		ptp_log(PTP_LOG_ERR, PTP_LOG_CORE, "Failed to init mutex\n");
 		free(r->mutex);
 		r->mutex = NULL;
 	}
@@ -104,23 +110,82 @@ void ptpusb_free_device_list(struct PtpDeviceEntry *e) {
 	}
 }
 
-int ptp_buffer_resize(struct PtpRuntime *r, size_t size) {
-	if (size < r->data_length) {
-		ptp_panic("You cannot downsize the data buffer (%u -> %u)", r->data_length, size);
+static int buffer_realloc(struct PtpRuntime *r, size_t size) {
+	uint8_t *data = realloc(r->data, size);
+	if (data == NULL) {
+		return PTP_OUT_OF_MEM;
 	}
 
-	// realloc with a little extra space to minimize reallocs later on
-	static int extra = 100;
-	ptp_verbose_log("Extending IO buffer to %X\n", size + extra);
-	r->data = realloc(r->data, size + extra);
-	r->data_length = size + extra;
-	if (r->data == NULL) {
+	r->data = data;
+	r->data_length = (int)size;
+
+	struct PtpBufferStats *s = &r->buffer_stats;
+	s->reallocs++;
+	s->current_size = size;
+	if (size > s->peak_size) s->peak_size = size;
+
+	return 0;
+}
+
+int ptp_buffer_resize(struct PtpRuntime *r, size_t size) {
+	if (size > r->buffer_stats.window_need) r->buffer_stats.window_need = size;
+
+	if (size <= (size_t)r->data_length) return 0;
+
+	if (size > r->data_max_size) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_CORE, "IO buffer of %zu bytes is past the limit (%zu)\n", size, r->data_max_size);
 		return PTP_OUT_OF_MEM;
 	}
 
+	// Double the buffer, so a series of slightly bigger packets doesn't realloc every time
+	size_t new_size = (size_t)r->data_length * 2;
+	if (new_size < size) new_size = size;
+	if (new_size > r->data_max_size) new_size = r->data_max_size;
+
+	ptp_log(PTP_LOG_DEBUG, PTP_LOG_CORE, "Extending IO buffer to %zX\n", new_size);
+	return buffer_realloc(r, new_size);
+}
+
+// Called at the start of every transaction. Once a window of transactions passes without
+// anything needing more than the default size, give the memory back.
+static void buffer_idle_check(struct PtpRuntime *r) {
+	struct PtpBufferStats *s = &r->buffer_stats;
+	if (r->data_length <= CAMLIB_DEFAULT_SIZE) return;
+
+	s->window_transactions++;
+	if (s->window_transactions < CAMLIB_BUFFER_IDLE_TRANSACTIONS) return;
+
+	if (s->window_need <= CAMLIB_DEFAULT_SIZE) {
+		ptp_log(PTP_LOG_DEBUG, PTP_LOG_CORE, "Shrinking idle IO buffer to %X\n", CAMLIB_DEFAULT_SIZE);
+		if (buffer_realloc(r, CAMLIB_DEFAULT_SIZE) == 0) {
+			s->shrinks++;
+		}
+	}
+
+	s->window_transactions = 0;
+	s->window_need = 0;
+}
+
+int ptp_set_buffer_limit(struct PtpRuntime *r, size_t max) {
+	// data_length is an int, and streaming needs room for at least one chunk
+	if (max < CAMLIB_STREAM_CHUNK || max > INT_MAX) return PTP_RUNTIME_ERR;
+
+	ptp_mutex_lock(r);
+	if (max < (size_t)r->data_length) {
+		ptp_mutex_unlock(r);
+		return PTP_RUNTIME_ERR;
+	}
+	r->data_max_size = max;
+	ptp_mutex_unlock(r);
 	return 0;
 }
 
+void ptp_buffer_stats(struct PtpRuntime *r, struct PtpBufferStats *stats) {
+	ptp_mutex_lock(r);
+	memcpy(stats, &r->buffer_stats, sizeof(struct PtpBufferStats));
+	ptp_mutex_unlock(r);
+}
+
 void ptp_mutex_lock(struct PtpRuntime *r) {
 	if (r->mutex == NULL) return;
 	pthread_mutex_lock(r->mutex);
@@ -137,6 +202,7 @@ void ptp_mutex_unlock(struct PtpRuntime *r) {
 }
 
 void ptp_close(struct PtpRuntime *r) {
+	ptp_prop_store_disable(r);
 	free(r->data);
 }
 
@@ -146,86 +212,112 @@ void ptp_mutex_unlock_thread(struct PtpRuntime *r) {
 	while (pthread_mutex_unlock(r->mutex) == 0); 
 }
 
-// Perform a generic command transaction - no data phase
-int ptp_send(struct PtpRuntime *r, struct PtpCommand *cmd) {
+static int send_transaction(struct PtpRuntime *r, struct PtpCommand *cmd, ptp_data_sink *sink, void *arg, FILE *file) {
 	ptp_mutex_lock(r);
+	ptp_stats_begin(r);
+
+	buffer_idle_check(r);
 
 	r->data_phase_length = 0;
 
 	int length = ptp_new_cmd_packet(r, cmd);
 	if (ptp_send_bulk_packets(r, length) != length) {
+		ptp_stats_end(r, cmd->code, PTP_IO_ERR);
 		ptp_mutex_unlock_thread(r);
-		ptp_verbose_log("Didn't send all packets\n");
+		ptp_log(PTP_LOG_ERR, PTP_LOG_CORE, "Didn't send all packets\n");
 		return PTP_IO_ERR;
 	}
 
-	int rc = ptp_receive_bulk_packets(r);
-	if (rc < 0) {
+	ptp_stats_sent(r, 0);
+
+	int rc;
+	if (file != NULL) {
+		rc = ptp_freceive_bulk_packets(r, file, 0);
+	} else if (sink == NULL) {
+		rc = ptp_receive_bulk_packets(r);
+	} else {
+		rc = ptp_receive_stream_packets(r, sink, arg);
+	}
+
+	if (rc < 0 && rc != PTP_CANCELED) {
+		ptp_stats_end(r, cmd->code, PTP_IO_ERR);
 		ptp_mutex_unlock_thread(r);
-		ptp_verbose_log("Failed to receive packets: %d\n", rc);
+		ptp_log(PTP_LOG_ERR, PTP_LOG_CORE, "Failed to receive packets: %d\n", rc);
 		return PTP_IO_ERR;
 	}
 
 	r->transaction++;
 
+	if (rc == PTP_CANCELED) {
+		ptp_stats_end(r, cmd->code, PTP_CANCELED);
+		ptp_mutex_unlock_thread(r);
+		return PTP_CANCELED;
+	}
+
 	if (ptp_get_return_code(r) != PTP_RC_OK) {
-		ptp_verbose_log("Invalid return code: %X\n", ptp_get_return_code(r));
+		ptp_log(PTP_LOG_WARN, PTP_LOG_CORE, "Invalid return code: %X\n", ptp_get_return_code(r));
+		ptp_stats_end(r, cmd->code, PTP_CHECK_CODE);
 		ptp_mutex_unlock_thread(r);
 		return PTP_CHECK_CODE;
 	}
-	
+
+	ptp_stats_end(r, cmd->code, 0);
 	ptp_mutex_unlock(r);
 	return 0;
 }
 
-// Perform a command request with a data phase to the camera
-int ptp_send_data(struct PtpRuntime *r, struct PtpCommand *cmd, void *data, int length) {
-	ptp_mutex_lock(r);
-
-	// Required for libWPD and PTP/IP
-	r->data_phase_length = length;
+// Perform a generic command transaction - no data phase
+int ptp_send(struct PtpRuntime *r, struct PtpCommand *cmd) {
+	return send_transaction(r, cmd, NULL, NULL, NULL);
+}
 
-	// These numbers are not exact, but it's fine
-	if (length + 50 > r->data_length) {
-		ptp_buffer_resize(r, 100 + length);
-	}
+// Same as ptp_send, but the incoming data phase is streamed to sink
+int ptp_send_stream(struct PtpRuntime *r, struct PtpCommand *cmd, ptp_data_sink *sink, void *arg) {
+	return send_transaction(r, cmd, sink, arg, NULL);
+}
 
-	//usleep(2000);
+// Same as ptp_send, but the incoming data phase is written to a file
+int ptp_send_to_file(struct PtpRuntime *r, struct PtpCommand *cmd, FILE *stream) {
+	return send_transaction(r, cmd, NULL, NULL, stream);
+}
 
-	// Send operation request (data phase later on)
-	int plength = ptp_new_cmd_packet(r, cmd);
-	if (ptp_send_bulk_packets(r, plength) != plength) {
-		ptp_mutex_unlock_thread(r);
-		return PTP_IO_ERR;
+int ptp_fd_sink(struct PtpRuntime *r, void *arg, uint8_t *data, int length) {
+	int fd = (int)(intptr_t)arg;
+	while (length > 0) {
+		int rc = write(fd, data, length);
+		if (rc <= 0) return PTP_IO_ERR;
+		data += rc;
+		length -= rc;
 	}
 
-	//usleep(2000);
+	return 0;
+}
 
-	if (r->connection_type == PTP_IP) {
-		// Send data start packet first (only has payload length)
-		plength = ptpip_data_start_packet(r, length);
-		if (ptp_send_bulk_packets(r, plength) != plength) {
-			ptp_mutex_unlock_thread(r);
-			return PTP_IO_ERR;
-		}
+// Send the command request, and build the data phase header in r->data. On sockets, the request
+// is left in front of the header so both go out with the payload in a single write.
+// Returns the length of r->data to send before the payload.
+static int send_data_request(struct PtpRuntime *r, struct PtpCommand *cmd, int length) {
+	// Required for libWPD and PTP/IP
+	r->data_phase_length = length;
 
-		// Send data end packet, with payload
-		plength = ptpip_data_end_packet(r, data, length);
-		if (ptp_send_bulk_packets(r, plength) != plength) {
-			ptp_mutex_unlock_thread(r);
-			return PTP_IO_ERR;
-		}
-	} else {
-		// Single data packet
-		plength = ptp_new_data_packet(r, cmd, data, length);
+	int plength = ptp_new_cmd_packet(r, cmd);
+
+	// USB needs the request in its own transfer
+	if (r->connection_type == PTP_USB) {
 		if (ptp_send_bulk_packets(r, plength) != plength) {
-			ptp_mutex_unlock_thread(r);
-			ptp_verbose_log("Failed to send data packet (%d)\n", plength);
 			return PTP_IO_ERR;
 		}
+		plength = 0;
 	}
 
+	return plength + ptp_new_data_header(r, plength, cmd, length);
+}
+
+static int finish_data_transaction(struct PtpRuntime *r, struct PtpCommand *cmd, int length) {
+	ptp_stats_sent(r, length);
+
 	if (ptp_receive_bulk_packets(r) < 0) {
+		ptp_stats_end(r, cmd->code, PTP_IO_ERR);
 		ptp_mutex_unlock_thread(r);
 		return PTP_IO_ERR;
 	}
@@ -233,17 +325,67 @@ int ptp_send_data(struct PtpRuntime *r, struct PtpCommand *cmd, void *data, int
 	r->transaction++;
 
 	if (ptp_get_return_code(r) != PTP_RC_OK) {
+		ptp_stats_end(r, cmd->code, PTP_CHECK_CODE);
 		ptp_mutex_unlock_thread(r);
 		return PTP_CHECK_CODE;
 	}
 
+	ptp_stats_end(r, cmd->code, 0);
 	ptp_mutex_unlock(r);
 	return 0;
 }
 
-int ptp_device_type(struct PtpRuntime *r) {
+// Perform a command request with a data phase to the camera. The payload is sent
+// straight from data, it's never copied into r->data.
+int ptp_send_data(struct PtpRuntime *r, struct PtpCommand *cmd, void *data, int length) {
+	ptp_mutex_lock(r);
+	ptp_stats_begin(r);
+
+	buffer_idle_check(r);
+
+	int plength = send_data_request(r, cmd, length);
+	if (plength < 0) {
+		ptp_stats_end(r, cmd->code, PTP_IO_ERR);
+		ptp_mutex_unlock_thread(r);
+		return PTP_IO_ERR;
+	}
+
+	if (ptp_send_data_packets(r, plength, data, length) != plength + length) {
+		ptp_stats_end(r, cmd->code, PTP_IO_ERR);
+		ptp_mutex_unlock_thread(r);
+		ptp_log(PTP_LOG_ERR, PTP_LOG_CORE, "Failed to send data phase (%d)\n", length);
+		return PTP_IO_ERR;
+	}
+
+	return finish_data_transaction(r, cmd, length);
+}
+
+// Perform a command request with a data phase read from a file, without buffering it all
+int ptp_send_data_file(struct PtpRuntime *r, struct PtpCommand *cmd, FILE *stream, int length) {
+	ptp_mutex_lock(r);
+	ptp_stats_begin(r);
+
+	buffer_idle_check(r);
+
+	int plength = send_data_request(r, cmd, length);
+	if (plength < 0) {
+		ptp_stats_end(r, cmd->code, PTP_IO_ERR);
+		ptp_mutex_unlock_thread(r);
+		return PTP_IO_ERR;
+	}
+
+	if (ptp_fsend_packets(r, plength, stream) != plength + length) {
+		ptp_stats_end(r, cmd->code, PTP_IO_ERR);
+		ptp_mutex_unlock_thread(r);
+		ptp_log(PTP_LOG_ERR, PTP_LOG_CORE, "Failed to send %d bytes of file data\n", length);
+		return PTP_IO_ERR;
+	}
+
+	return finish_data_transaction(r, cmd, length);
+}
+
+static int device_type(struct PtpRuntime *r) {
 	struct PtpDeviceInfo *di = r->di;
-	if (di == NULL) return PTP_DEV_EMPTY; // TODO: panic?
 	if (!strcmp(di->manufacturer, "Canon Inc.")) {
 		if (ptp_check_opcode(r, PTP_OC_EOS_GetStorageIDs)) {
 			return PTP_DEV_EOS;
@@ -261,10 +403,44 @@ int ptp_device_type(struct PtpRuntime *r) {
 	return PTP_DEV_EMPTY;
 }
 
-int ptp_check_opcode(struct PtpRuntime *r, int op) {
-	if (r->di == NULL) return 0;
-	for (int i = 0; i < r->di->ops_supported_length; i++) {
-		if (r->di->ops_supported[i] == op) {
+static int event_method(struct PtpRuntime *r, int vendor) {
+	if (vendor == PTP_DEV_EOS && ptp_check_opcode(r, PTP_OC_EOS_GetEvent)) {
+		return PTP_EVENTS_EOS;
+	}
+
+	if (r->di->events_supported_length) {
+		return PTP_EVENTS_STANDARD;
+	}
+
+	return PTP_EVENTS_NONE;
+}
+
+int ptp_device_type(struct PtpRuntime *r) {
+	return ptp_get_profile(r)->vendor;
+}
+
+// Bit for code in a PtpCaps bitmap, or -1 if code isn't in the category (high nibble minus the vendor bit)
+static int caps_bit(int code, int category) {
+	if ((code & 0x7000) != category) return -1;
+	return ((code & 0x8000) >> 3) | (code & 0xfff);
+}
+
+static void caps_add(uint32_t *map, int category, const uint16_t *codes, int length) {
+	for (int i = 0; i < length; i++) {
+		int bit = caps_bit(codes[i], category);
+		if (bit < 0) continue;
+		map[bit / 32] |= 1u << (bit % 32);
+	}
+}
+
+static int caps_has(struct PtpRuntime *r, const uint32_t *map, int category, const uint16_t *codes, int length, int code) {
+	int bit = caps_bit(code, category);
+	if (r->caps.di == r->di && bit >= 0) {
+		return (map[bit / 32] >> (bit % 32)) & 1;
+	}
+
+	for (int i = 0; i < length; i++) {
+		if (codes[i] == code) {
 			return 1;
 		}
 	}
@@ -272,15 +448,57 @@ int ptp_check_opcode(struct PtpRuntime *r, int op) {
 	return 0;
 }
 
+void ptp_update_caps(struct PtpRuntime *r) {
+	struct PtpCaps *c = &r->caps;
+	memset(c, 0, sizeof(struct PtpCaps));
+	c->profile.ops = ptp_get_vendor_ops(PTP_DEV_EMPTY);
+
+	struct PtpDeviceInfo *di = r->di;
+	if (di == NULL) return;
+
+	caps_add(c->ops, 0x1000, di->ops_supported, di->ops_supported_length);
+	caps_add(c->events, 0x4000, di->events_supported, di->events_supported_length);
+	caps_add(c->props, 0x5000, di->props_supported, di->props_supported_length);
+	caps_add(c->formats, 0x3000, di->capture_formats, di->capture_formats_length);
+	caps_add(c->formats, 0x3000, di->playback_formats, di->playback_formats_length);
+	c->di = di;
+
+	// Everything below goes through the bitmaps just built
+	struct PtpDeviceProfile *p = &c->profile;
+	p->vendor = device_type(r);
+	p->event_method = event_method(r, p->vendor);
+	p->ops = ptp_get_vendor_ops(p->vendor);
+	p->liveview_type = -1;
+	p->liveview_type = ptp_liveview_type(r);
+}
+
+const struct PtpDeviceProfile *ptp_get_profile(struct PtpRuntime *r) {
+	// r->di was changed without ptp_update_caps
+	if (r->caps.di != r->di) ptp_update_caps(r);
+	return &r->caps.profile;
+}
+
+int ptp_check_opcode(struct PtpRuntime *r, int op) {
+	if (r->di == NULL) return 0;
+	return caps_has(r, r->caps.ops, 0x1000, r->di->ops_supported, r->di->ops_supported_length, op);
+}
+
 int ptp_check_prop(struct PtpRuntime *r, int code) {
 	if (r->di == NULL) return 0;
-	for (int i = 0; i < r->di->props_supported_length; i++) {
-		if (r->di->props_supported[i] == code) {
-			return 1;
-		}
-	}
+	return caps_has(r, r->caps.props, 0x5000, r->di->props_supported, r->di->props_supported_length, code);
+}
 
-	return 0;
+int ptp_check_event(struct PtpRuntime *r, int code) {
+	if (r->di == NULL) return 0;
+	return caps_has(r, r->caps.events, 0x4000, r->di->events_supported, r->di->events_supported_length, code);
+}
+
+int ptp_check_format(struct PtpRuntime *r, int code) {
+	if (r->di == NULL) return 0;
+	struct PtpDeviceInfo *di = r->di;
+	// The bitmap has both lists, the second call only matters for the slow path
+	return caps_has(r, r->caps.formats, 0x3000, di->capture_formats, di->capture_formats_length, code)
+		|| caps_has(r, r->caps.formats, 0x3000, di->playback_formats, di->playback_formats_length, code);
 }
 
 const char *ptp_perror(int rc) {
@@ -294,6 +512,7 @@ const char *ptp_perror(int rc) {
 	case PTP_RUNTIME_ERR: return "Runtime error";
 	case PTP_UNSUPPORTED: return "Unsupported operation";
 	case PTP_CHECK_CODE: return "Check code";
+	case PTP_CANCELED: return "Operation canceled";
 	default: return "?";
 	}
 }
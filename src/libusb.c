@@ -10,6 +10,16 @@
 #include <camlib.h>
 #include <ptp.h>
 
+// Number of bulk-in transfers kept in flight for large data phases
+#ifndef CAMLIB_USB_TRANSFERS
+	#define CAMLIB_USB_TRANSFERS 4
+#endif
+
+// Size of each queued transfer - must be a multiple of the endpoint packet size (512/1024)
+#ifndef CAMLIB_USB_TRANSFER_SIZE
+	#define CAMLIB_USB_TRANSFER_SIZE (256 * 1024)
+#endif
+
 // Private struct
 struct LibUSBBackend {
 	uint32_t endpoint_in;
@@ -19,6 +29,19 @@ struct LibUSBBackend {
 	int fd;
 	libusb_context *ctx;
 	libusb_device_handle *handle;
+
+	// Allocated on first large read, reused after that
+	struct libusb_transfer *transfers[CAMLIB_USB_TRANSFERS];
+};
+
+// State shared by all transfers of a single pipelined read
+struct LibUSBPipeline {
+	uint8_t *buffer;
+	int length;
+	int submitted;
+	int received;
+	int pending;
+	int error;
 };
 
 // TODO: If this is accidentally called in the middle of a connection, it will cause a huge fault
@@ -34,7 +57,7 @@ int ptp_comm_init(struct PtpRuntime *r) {
 
 		struct LibUSBBackend *backend = (struct LibUSBBackend *)r->comm_backend;
 
-		ptp_verbose_log("Initializing libusb...\n");
+		ptp_log(PTP_LOG_DEBUG, PTP_LOG_USB, "Initializing libusb...\n");
 		libusb_init(&(backend->ctx));
 
 		//libusb_set_option(backend->ctx, LIBUSB_OPTION_LOG_LEVEL, LIBUSB_LOG_LEVEL_DEBUG);
@@ -45,12 +68,12 @@ int ptp_comm_init(struct PtpRuntime *r) {
 
 struct PtpDeviceEntry *ptpusb_device_list(struct PtpRuntime *r) {
 	if (r->comm_backend == NULL) {
-		ptp_verbose_log("comm_backend is NULL\n");
+		ptp_log(PTP_LOG_ERR, PTP_LOG_USB, "comm_backend is NULL\n");
 		return NULL;
 	}
 
 	if (!r->io_kill_switch) {
-		ptp_verbose_log("Connection is active\n");
+		ptp_log(PTP_LOG_DEBUG, PTP_LOG_USB, "Connection is active\n");
 		return NULL;
 	}
 
@@ -134,7 +157,7 @@ struct PtpDeviceEntry *ptpusb_device_list(struct PtpRuntime *r) {
 
 		valid_devices++;
 
-		ptp_verbose_log("Vendor ID: %X, Product ID: %X\n", desc.idVendor, desc.idProduct);
+		ptp_log(PTP_LOG_DEBUG, PTP_LOG_USB, "Vendor ID: %X, Product ID: %X\n", desc.idVendor, desc.idProduct);
 
 		curr_ent->id = d;
 		curr_ent->vendor_id = desc.idVendor;
@@ -144,14 +167,14 @@ struct PtpDeviceEntry *ptpusb_device_list(struct PtpRuntime *r) {
 			if (ep[i].bmAttributes == LIBUSB_ENDPOINT_TRANSFER_TYPE_BULK) {
 				if (ep[i].bEndpointAddress & LIBUSB_ENDPOINT_IN) {
 					curr_ent->endpoint_in = ep[i].bEndpointAddress;
-					ptp_verbose_log("Endpoint IN addr: 0x%X\n", ep[i].bEndpointAddress);
+					ptp_log(PTP_LOG_DEBUG, PTP_LOG_USB, "Endpoint IN addr: 0x%X\n", ep[i].bEndpointAddress);
 				} else {
 					curr_ent->endpoint_out = ep[i].bEndpointAddress;
-					ptp_verbose_log("Endpoint OUT addr: 0x%X\n", ep[i].bEndpointAddress);
+					ptp_log(PTP_LOG_DEBUG, PTP_LOG_USB, "Endpoint OUT addr: 0x%X\n", ep[i].bEndpointAddress);
 				}
 			} else if (ep[i].bmAttributes == LIBUSB_ENDPOINT_TRANSFER_TYPE_INTERRUPT) {
 				curr_ent->endpoint_int = ep[i].bEndpointAddress;
-				ptp_verbose_log("Endpoint INT addr: 0x%X\n", ep[i].bEndpointAddress);	
+				ptp_log(PTP_LOG_DEBUG, PTP_LOG_USB, "Endpoint INT addr: 0x%X\n", ep[i].bEndpointAddress);	
 			}
 		}
 
@@ -171,7 +194,7 @@ struct PtpDeviceEntry *ptpusb_device_list(struct PtpRuntime *r) {
 			strcpy(curr_ent->name, "?");
 		} else {
 			strncpy(curr_ent->name, buffer, sizeof(curr_ent->name) - 1);
-			ptp_verbose_log("Device name: %s\n", curr_ent->name);
+			ptp_log(PTP_LOG_DEBUG, PTP_LOG_USB, "Device name: %s\n", curr_ent->name);
 		}
 
 		rc = libusb_get_string_descriptor_ascii(handle, desc.iManufacturer, (unsigned char *)buffer, sizeof(buffer));
@@ -179,7 +202,7 @@ struct PtpDeviceEntry *ptpusb_device_list(struct PtpRuntime *r) {
 			strcpy(curr_ent->manufacturer, "?");
 		} else {
 			strncpy(curr_ent->manufacturer, buffer, sizeof(curr_ent->name) - 1);
-			ptp_verbose_log("Manufacturer: %s\n", curr_ent->manufacturer);
+			ptp_log(PTP_LOG_DEBUG, PTP_LOG_USB, "Manufacturer: %s\n", curr_ent->manufacturer);
 		}
 
 		libusb_free_config_descriptor(config);
@@ -201,13 +224,13 @@ struct PtpDeviceEntry *ptpusb_device_list(struct PtpRuntime *r) {
 int ptp_device_open(struct PtpRuntime *r, struct PtpDeviceEntry *entry) {
 	ptp_mutex_lock(r);
 	if (r->comm_backend == NULL) {
-		ptp_verbose_log("comm_backend is NULL\n");
+		ptp_log(PTP_LOG_ERR, PTP_LOG_USB, "comm_backend is NULL\n");
 		ptp_mutex_unlock(r);
 		return PTP_OPEN_FAIL;
 	}
 
 	if (!r->io_kill_switch) {
-		ptp_verbose_log("Connection is active\n");
+		ptp_log(PTP_LOG_DEBUG, PTP_LOG_USB, "Connection is active\n");
 		return PTP_OPEN_FAIL;
 	}
 
@@ -282,6 +305,13 @@ int ptp_device_init(struct PtpRuntime *r) {
 int ptp_device_close(struct PtpRuntime *r) {
 	r->io_kill_switch = 1;
 	struct LibUSBBackend *backend = (struct LibUSBBackend *)r->comm_backend;
+
+	for (int i = 0; i < CAMLIB_USB_TRANSFERS; i++) {
+		if (backend->transfers[i] == NULL) continue;
+		libusb_free_transfer(backend->transfers[i]);
+		backend->transfers[i] = NULL;
+	}
+
 	if (libusb_release_interface(backend->handle, 0)) {
 		return 1;
 	}
@@ -330,6 +360,228 @@ int ptp_cmd_read(struct PtpRuntime *r, void *to, int length) {
 	return transferred;
 }
 
+static int pipeline_submit(struct LibUSBPipeline *p, struct libusb_transfer *t) {
+	int size = p->length - p->submitted;
+	if (size > CAMLIB_USB_TRANSFER_SIZE) size = CAMLIB_USB_TRANSFER_SIZE;
+
+	t->buffer = p->buffer + p->submitted;
+	t->length = size;
+	if (libusb_submit_transfer(t)) {
+		return -1;
+	}
+
+	p->submitted += size;
+	p->pending++;
+	return 0;
+}
+
+static void LIBUSB_CALL pipeline_callback(struct libusb_transfer *t) {
+	struct LibUSBPipeline *p = (struct LibUSBPipeline *)t->user_data;
+	p->pending--;
+
+	if (t->status != LIBUSB_TRANSFER_COMPLETED) {
+		p->error = PTP_IO_ERR;
+		return;
+	}
+
+	p->received += t->actual_length;
+
+	// A short transfer before the end means the container ended early, and the
+	// transfers after this one may have eaten the response.
+	if (t->actual_length != t->length) {
+		if (p->received != p->length) p->error = PTP_IO_ERR;
+		return;
+	}
+
+	if (p->error == 0 && p->submitted < p->length) {
+		if (pipeline_submit(p, t)) p->error = PTP_IO_ERR;
+	}
+}
+
+// Keep CAMLIB_USB_TRANSFERS bulk-in transfers queued until the data container is complete,
+// so the host controller never idles between the synchronous calls.
+int ptpusb_read_data_phase(struct PtpRuntime *r, void *to, int length) {
+	struct LibUSBBackend *backend = (struct LibUSBBackend *)r->comm_backend;
+	if (backend == NULL || r->io_kill_switch) return PTP_IO_ERR;
+
+	// Not worth queueing anything for a single transfer
+	if (length <= CAMLIB_USB_TRANSFER_SIZE) {
+		int transferred = 0;
+		int rc = libusb_bulk_transfer(
+			backend->handle,
+			backend->endpoint_in,
+			(unsigned char *)to, length, &transferred, PTP_TIMEOUT);
+		if (rc) return PTP_IO_ERR;
+		return transferred;
+	}
+
+	struct LibUSBPipeline p = {0};
+	p.buffer = (uint8_t *)to;
+	p.length = length;
+
+	for (int i = 0; i < CAMLIB_USB_TRANSFERS; i++) {
+		if (backend->transfers[i] == NULL) {
+			backend->transfers[i] = libusb_alloc_transfer(0);
+			if (backend->transfers[i] == NULL) return PTP_OUT_OF_MEM;
+		}
+
+		if (p.submitted >= p.length) break;
+
+		libusb_fill_bulk_transfer(backend->transfers[i], backend->handle, backend->endpoint_in,
+			NULL, 0, pipeline_callback, &p, PTP_TIMEOUT);
+		if (pipeline_submit(&p, backend->transfers[i])) {
+			p.error = PTP_IO_ERR;
+			break;
+		}
+	}
+
+	int cancelled = 0;
+	while (p.pending) {
+		if (p.error && !cancelled) {
+			for (int i = 0; i < CAMLIB_USB_TRANSFERS; i++) {
+				if (backend->transfers[i] == NULL) continue;
+				libusb_cancel_transfer(backend->transfers[i]);
+			}
+			cancelled = 1;
+		}
+
+		struct timeval tv = {PTP_TIMEOUT / 1000, (PTP_TIMEOUT % 1000) * 1000};
+		int rc = libusb_handle_events_timeout_completed(backend->ctx, &tv, NULL);
+		if (rc && rc != LIBUSB_ERROR_TIMEOUT) {
+			ptp_log(PTP_LOG_ERR, PTP_LOG_USB, "%s: libusb_handle_events: %d\n", __func__, rc);
+			p.error = PTP_IO_ERR;
+		}
+	}
+
+	if (p.error) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_USB, "%s: Pipelined read failed after %d/%d bytes\n", __func__, p.received, p.length);
+		return p.error;
+	}
+
+	return p.received;
+}
+
+// Transfers of a streamed read each own a CAMLIB_USB_TRANSFER_SIZE slot of r->data, and are
+// handed to the sink in the order they were queued
+struct LibUSBStream {
+	uint8_t *base;
+	int length;
+	int submitted;
+	int pending;
+	int error;
+	int done[CAMLIB_USB_TRANSFERS];
+};
+
+static int stream_submit(struct LibUSBStream *s, struct libusb_transfer *t, int slot) {
+	int size = s->length - s->submitted;
+	if (size > CAMLIB_USB_TRANSFER_SIZE) size = CAMLIB_USB_TRANSFER_SIZE;
+
+	t->buffer = s->base + slot * CAMLIB_USB_TRANSFER_SIZE;
+	t->length = size;
+	if (libusb_submit_transfer(t)) {
+		return -1;
+	}
+
+	s->submitted += size;
+	s->pending++;
+	return 0;
+}
+
+static void LIBUSB_CALL stream_callback(struct libusb_transfer *t) {
+	struct LibUSBStream *s = (struct LibUSBStream *)t->user_data;
+	s->pending--;
+
+	// The container length is known, so every transfer has to come back full
+	if (t->status != LIBUSB_TRANSFER_COMPLETED || t->actual_length != t->length) {
+		if (s->error == 0) s->error = PTP_IO_ERR;
+		return;
+	}
+
+	s->done[(t->buffer - s->base) / CAMLIB_USB_TRANSFER_SIZE] = 1;
+}
+
+// Same pipeline as ptpusb_read_data_phase, but each transfer is handed to the sink as soon as it
+// completes and then queued again, so the rest stay in flight while the sink writes.
+int ptpusb_stream_data_phase(struct PtpRuntime *r, int length, ptp_data_sink *sink, void *arg) {
+	struct LibUSBBackend *backend = (struct LibUSBBackend *)r->comm_backend;
+	if (backend == NULL || r->io_kill_switch) return PTP_IO_ERR;
+
+	// A smaller buffer limit just means fewer slots
+	ptp_buffer_resize(r, CAMLIB_USB_TRANSFERS * CAMLIB_USB_TRANSFER_SIZE);
+	int slots = (int)(r->data_length / CAMLIB_USB_TRANSFER_SIZE);
+	if (slots > CAMLIB_USB_TRANSFERS) slots = CAMLIB_USB_TRANSFERS;
+	if (slots < 1) return PTP_OUT_OF_MEM;
+
+	struct LibUSBStream s = {0};
+	s.base = r->data;
+	s.length = length;
+
+	for (int i = 0; i < slots && s.submitted < s.length; i++) {
+		if (backend->transfers[i] == NULL) {
+			backend->transfers[i] = libusb_alloc_transfer(0);
+			if (backend->transfers[i] == NULL) {
+				s.error = PTP_OUT_OF_MEM;
+				break;
+			}
+		}
+
+		libusb_fill_bulk_transfer(backend->transfers[i], backend->handle, backend->endpoint_in,
+			NULL, 0, stream_callback, &s, PTP_TIMEOUT);
+		if (stream_submit(&s, backend->transfers[i], i)) {
+			s.error = PTP_IO_ERR;
+			break;
+		}
+	}
+
+	int next = 0;
+	int delivered = 0;
+	int cancelled = 0;
+	while (1) {
+		while (s.error == 0 && s.done[next]) {
+			s.done[next] = 0;
+			int size = s.length - delivered;
+			if (size > CAMLIB_USB_TRANSFER_SIZE) size = CAMLIB_USB_TRANSFER_SIZE;
+
+			int rc = sink(r, arg, s.base + next * CAMLIB_USB_TRANSFER_SIZE, size);
+			if (rc) {
+				s.error = rc;
+				break;
+			}
+			delivered += size;
+
+			if (s.submitted < s.length && stream_submit(&s, backend->transfers[next], next)) {
+				s.error = PTP_IO_ERR;
+				break;
+			}
+			next = (next + 1) % slots;
+		}
+
+		if (s.pending == 0) break;
+
+		if (s.error && !cancelled) {
+			for (int i = 0; i < slots; i++) {
+				if (backend->transfers[i] == NULL) continue;
+				libusb_cancel_transfer(backend->transfers[i]);
+			}
+			cancelled = 1;
+		}
+
+		struct timeval tv = {PTP_TIMEOUT / 1000, (PTP_TIMEOUT % 1000) * 1000};
+		int rc = libusb_handle_events_timeout_completed(backend->ctx, &tv, NULL);
+		if (rc && rc != LIBUSB_ERROR_TIMEOUT) {
+			ptp_log(PTP_LOG_ERR, PTP_LOG_USB, "%s: libusb_handle_events: %d\n", __func__, rc);
+			if (s.error == 0) s.error = PTP_IO_ERR;
+		}
+	}
+
+	if (s.error) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_USB, "%s: Streamed read failed after %d/%d bytes\n", __func__, delivered, length);
+		return s.error;
+	}
+
+	return delivered;
+}
+
 int ptp_read_int(struct PtpRuntime *r, void *to, int length) {
 	struct LibUSBBackend *backend = (struct LibUSBBackend *)r->comm_backend;
 	if (backend == NULL || r->io_kill_switch) return -1;
@@ -29,7 +29,7 @@ int ptp_comm_init(struct PtpRuntime *r) {
 
 int ptp_device_init(struct PtpRuntime *r) {
 	if (!r->io_kill_switch) {
-		ptp_verbose_log("Connection is active\n");
+		ptp_log(PTP_LOG_DEBUG, PTP_LOG_USB, "Connection is active\n");
 		return PTP_IO_ERR;
 	}
 
@@ -58,7 +58,7 @@ int ptp_device_init(struct PtpRuntime *r) {
 		}
 
 		int type = wpd_get_device_type(wpd);
-		ptp_verbose_log("Found device of type: %d\n", type);
+		ptp_log(PTP_LOG_DEBUG, PTP_LOG_USB, "Found device of type: %d\n", type);
 		if (type == WPD_DEVICE_TYPE_CAMERA) {
 			r->io_kill_switch = 0;
 			ptp_mutex_unlock(r);
@@ -199,6 +199,46 @@ int ptpusb_read_all_packets(struct PtpRuntime *r) {
 	return 0;
 }
 
+// WPD hands over the whole data phase at once, so buffer it and feed the sink afterwards
+int ptpusb_receive_stream(struct PtpRuntime *r, ptp_data_sink *sink, void *arg) {
+	int rc = ptpusb_read_all_packets(r);
+	if (rc < 0) return rc;
+
+	struct PtpBulkContainer *bulk = (struct PtpBulkContainer*)(r->data);
+	if (bulk->type != PTP_PACKET_TYPE_DATA) return 0;
+
+	int length = (int)bulk->length;
+	int canceled = sink(r, arg, (uint8_t *)(r->data + 12), length - 12);
+
+	// Leave the response at the start of the buffer, like the streaming backends do
+	memmove(r->data, r->data + length, 12);
+
+	if (canceled) return PTP_CANCELED;
+	return 0;
+}
+
+// WPD wants the whole data phase in one call, so the payload has to be copied after the header
+int ptpusb_send_data_packets(struct PtpRuntime *r, int length, void *data, int data_length) {
+	int rc = ptp_buffer_resize(r, length + data_length);
+	if (rc) return rc;
+
+	memcpy(r->data + length, data, data_length);
+	return ptpusb_send_bulk_packets(r, length + data_length);
+}
+
+// WPD wants the whole data phase in one call, so read the rest of the file into r->data
+int ptpusb_fsend_packets(struct PtpRuntime *r, int length, FILE *stream) {
+	struct PtpBulkContainer *bulk = (struct PtpBulkContainer*)(r->data);
+	int total = (int)bulk->length;
+	int rc = ptp_buffer_resize(r, total);
+	if (rc) return rc;
+
+	int read = (int)fread(r->data + length, 1, total - length, stream);
+	if (read != total - length) return PTP_IO_ERR;
+
+	return ptpusb_send_bulk_packets(r, total);
+}
+
 int ptp_read_int(struct PtpRuntime *r, void *to, int length) {
 	return 0;
 }
@@ -22,6 +22,172 @@
 #define PTP_ML_LvWidth 360
 #define PTP_ML_LvHeight 240
 
+#if !defined(CAMLIB_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define LV_SIMD_X86
+	#include <immintrin.h>
+#elif !defined(CAMLIB_NO_SIMD) && defined(__ARM_NEON)
+	#define LV_SIMD_NEON
+	#include <arm_neon.h>
+#endif
+
+// Converts as many leading pixels as it can from RGB to 4 byte pixels, returns how many
+typedef int rgb_kernel(uint8_t *out, const uint8_t *in, int pixels, int bgr);
+
+static void expand_rgb_scalar(uint8_t *out, const uint8_t *in, int pixels, int bgr) {
+	int r = bgr ? 2 : 0;
+	int b = bgr ? 0 : 2;
+	for (int i = 0; i < pixels; i++) {
+		out[r] = in[0];
+		out[1] = in[1];
+		out[b] = in[2];
+		out[3] = PTP_LV_TRANSPARENCY_PIXEL;
+		out += 4;
+		in += 3;
+	}
+}
+
+#ifdef LV_SIMD_X86
+// 16 pixels (3 loads, 4 stores) at a time, each shuffle spreads 12 bytes of RGB over 16
+__attribute__((target("ssse3")))
+static int expand_rgb_ssse3(uint8_t *out, const uint8_t *in, int pixels, int bgr) {
+	const __m128i mask = bgr
+		? _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+		: _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m128i alpha = _mm_set1_epi32((int)((uint32_t)PTP_LV_TRANSPARENCY_PIXEL << 24));
+
+	int i = 0;
+	for (; i + 16 <= pixels; i += 16) {
+		const uint8_t *p = in + i * 3;
+		__m128i a = _mm_loadu_si128((const __m128i *)p);
+		__m128i b = _mm_loadu_si128((const __m128i *)(p + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *)(p + 32));
+
+		__m128i *o = (__m128i *)(out + i * 4);
+		_mm_storeu_si128(o, _mm_or_si128(_mm_shuffle_epi8(a, mask), alpha));
+		_mm_storeu_si128(o + 1, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), mask), alpha));
+		_mm_storeu_si128(o + 2, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), mask), alpha));
+		_mm_storeu_si128(o + 3, _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), mask), alpha));
+	}
+
+	return i;
+}
+
+// Same shuffle, but shuffles can't cross 128 bit lanes, so each lane is loaded 12 bytes after the last
+__attribute__((target("avx2")))
+static int expand_rgb_avx2(uint8_t *out, const uint8_t *in, int pixels, int bgr) {
+	const __m256i mask = bgr
+		? _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+			2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1)
+		: _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+			0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+	const __m256i alpha = _mm256_set1_epi32((int)((uint32_t)PTP_LV_TRANSPARENCY_PIXEL << 24));
+
+	int i = 0;
+	// The last load reads 4 bytes past the 16 pixels, so stop early enough to stay in the buffer
+	for (; i + 18 <= pixels; i += 16) {
+		const uint8_t *p = in + i * 3;
+		__m256i lo = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)p)),
+			_mm_loadu_si128((const __m128i *)(p + 12)), 1);
+		__m256i hi = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(p + 24))),
+			_mm_loadu_si128((const __m128i *)(p + 36)), 1);
+
+		__m256i *o = (__m256i *)(out + i * 4);
+		_mm256_storeu_si256(o, _mm256_or_si256(_mm256_shuffle_epi8(lo, mask), alpha));
+		_mm256_storeu_si256(o + 1, _mm256_or_si256(_mm256_shuffle_epi8(hi, mask), alpha));
+	}
+
+	return i;
+}
+
+static rgb_kernel *rgb_expand = NULL;
+
+// Picked once at load time, so the frame loop never checks the CPU
+__attribute__((constructor))
+static void pick_rgb_kernel(void) {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		rgb_expand = expand_rgb_avx2;
+	} else if (__builtin_cpu_supports("ssse3")) {
+		rgb_expand = expand_rgb_ssse3;
+	}
+}
+#elif defined(LV_SIMD_NEON)
+// NEON is always there when the compiler targets it, no need to check at runtime
+static int expand_rgb_neon(uint8_t *out, const uint8_t *in, int pixels, int bgr) {
+	const uint8x16_t alpha = vdupq_n_u8(PTP_LV_TRANSPARENCY_PIXEL);
+
+	int i = 0;
+	for (; i + 16 <= pixels; i += 16) {
+		uint8x16x3_t rgb = vld3q_u8(in + i * 3);
+		uint8x16x4_t px;
+		px.val[0] = bgr ? rgb.val[2] : rgb.val[0];
+		px.val[1] = rgb.val[1];
+		px.val[2] = bgr ? rgb.val[0] : rgb.val[2];
+		px.val[3] = alpha;
+		vst4q_u8(out + i * 4, px);
+	}
+
+	return i;
+}
+
+static rgb_kernel *rgb_expand = expand_rgb_neon;
+#else
+static rgb_kernel *rgb_expand = NULL;
+#endif
+
+int ptp_liveview_convert_rgb(void *out, const void *in, int pixels, int format) {
+	if (format == PTP_LV_FORMAT_RGB) {
+		memcpy(out, in, pixels * 3);
+		return pixels * 3;
+	} else if (format != PTP_LV_FORMAT_RGBA && format != PTP_LV_FORMAT_BGRA) {
+		return PTP_RUNTIME_ERR;
+	}
+
+	int bgr = (format == PTP_LV_FORMAT_BGRA);
+
+	int done = 0;
+	if (rgb_expand != NULL) {
+		done = rgb_expand((uint8_t *)out, (const uint8_t *)in, pixels, bgr);
+	}
+
+	expand_rgb_scalar((uint8_t *)out + done * 4, (const uint8_t *)in + done * 3, pixels - done, bgr);
+	return pixels * 4;
+}
+
+int ptp_liveview_rgb_kernel(const char *name) {
+	if (name == NULL) {
+#if defined(LV_SIMD_X86)
+		rgb_expand = NULL;
+		pick_rgb_kernel();
+#elif defined(LV_SIMD_NEON)
+		rgb_expand = expand_rgb_neon;
+#endif
+		return 0;
+	}
+
+	if (!strcmp(name, "scalar")) {
+		rgb_expand = NULL;
+		return 0;
+	}
+#if defined(LV_SIMD_X86)
+	if (!strcmp(name, "avx2") && __builtin_cpu_supports("avx2")) {
+		rgb_expand = expand_rgb_avx2;
+		return 0;
+	}
+	if (!strcmp(name, "ssse3") && __builtin_cpu_supports("ssse3")) {
+		rgb_expand = expand_rgb_ssse3;
+		return 0;
+	}
+#elif defined(LV_SIMD_NEON)
+	if (!strcmp(name, "neon")) {
+		rgb_expand = expand_rgb_neon;
+		return 0;
+	}
+#endif
+
+	return PTP_UNSUPPORTED;
+}
+
 int ptp_get_ml_lv1(struct PtpRuntime *r) {
 	struct PtpCommand cmd;
 	cmd.code = PTP_OC_ML_Live360x240;
@@ -30,7 +196,7 @@ int ptp_get_ml_lv1(struct PtpRuntime *r) {
 	return ptp_send(r, &cmd);
 }
 
-int ptp_liveview_type(struct PtpRuntime *r) {
+static int liveview_type(struct PtpRuntime *r) {
 	int type = ptp_device_type(r);
 	if (type == PTP_DEV_CANON || type == PTP_DEV_EOS) {
 		#ifndef NO_ML_LV
@@ -55,9 +221,19 @@ int ptp_liveview_type(struct PtpRuntime *r) {
 	return PTP_LV_NONE;
 }
 
+int ptp_liveview_type(struct PtpRuntime *r) {
+	// Runs for every frame, so it's only worked out once per GetDeviceInfo, by ptp_update_caps
+	const struct PtpDeviceProfile *p = ptp_get_profile(r);
+	if (p->liveview_type < 0) r->caps.profile.liveview_type = liveview_type(r);
+	return r->caps.profile.liveview_type;
+}
+
 int ptp_liveview_size(struct PtpRuntime *r) {
 	switch (ptp_liveview_type(r)) {
 	case PTP_LV_ML:
+		if (r->liveview_format == PTP_LV_FORMAT_RGB) {
+			return PTP_ML_LvWidth * PTP_ML_LvHeight * 3;
+		}
 		return PTP_ML_LvWidth * PTP_ML_LvHeight * 4;
 	case PTP_LV_EOS:
 	case PTP_LV_EOS_ML_BMP:
@@ -75,36 +251,64 @@ int ptp_liveview_ml(struct PtpRuntime *r, uint8_t *buffer) {
         return PTP_CHECK_CODE;
     }
 
-    uint8_t *data = ptp_get_payload(r);
     int length = (PTP_ML_LvWidth * PTP_ML_LvHeight);
-
-    for (int i = 0; i < length; i++) {
-        buffer[0] = data[0];
-        buffer[1] = data[1];
-        buffer[2] = data[2];
-        buffer[3] = PTP_LV_TRANSPARENCY_PIXEL;
-        buffer += 4;
-        data += 3;
+    if (ptp_get_payload_length(r) < length * 3) {
+        return PTP_CHECK_CODE;
     }
 
-    return length * 4;
+    return ptp_liveview_convert_rgb(buffer, ptp_get_payload(r), length, r->liveview_format);
 }
 
-int ptp_liveview_eos(struct PtpRuntime *r, uint8_t *buffer) {
-	int x = ptp_eos_get_viewfinder_data(r);
-	if (x < 0) return x;
+static int eos_jpeg_block(struct PtpRuntime *r, const uint8_t **jpeg, int *length) {
+	// Nothing at all means there's no frame yet
+	if (ptp_get_payload_length(r) == 0) return 0;
 
-	if (ptp_get_return_code(r) == PTP_RC_CANON_NotReady) {
-		return 0;
+	struct PtpEOSViewFinderBlock b;
+	int rc = ptp_eos_vf_find_jpeg(r, &b);
+	if (rc) return rc;
+
+	*jpeg = b.data;
+	*length = b.length;
+	return 0;
+}
+
+int ptp_liveview_eos_borrow(struct PtpRuntime *r, const uint8_t **jpeg, int *length) {
+	*jpeg = NULL;
+	*length = 0;
+
+	// Taken before the transaction so no other thread can get in between and reuse the buffer
+	ptp_mutex_keep_locked(r);
+
+	int rc = ptp_eos_get_viewfinder_data(r);
+	if (rc) return rc; // Failed transactions already dropped the lock
+
+	rc = eos_jpeg_block(r, jpeg, length);
+	if (rc) {
+		ptp_mutex_unlock(r);
+		return rc;
 	}
 
-	struct PtpEOSViewFinderData *vfd = (struct PtpEOSViewFinderData *)(ptp_get_payload(r));
-	if (MAX_EOS_JPEG_SIZE < vfd->length) {
-		return 0;
+	return 0;
+}
+
+void ptp_liveview_release(struct PtpRuntime *r) {
+	ptp_mutex_unlock(r);
+}
+
+int ptp_liveview_eos(struct PtpRuntime *r, uint8_t *buffer) {
+	const uint8_t *jpeg;
+	int length;
+	int rc = ptp_liveview_eos_borrow(r, &jpeg, &length);
+	if (rc) return rc;
+
+	if (length > MAX_EOS_JPEG_SIZE) {
+		ptp_log(PTP_LOG_WARN, PTP_LOG_VENDOR, "Dropped %d byte frame, use ptp_liveview_eos_borrow\n", length);
+		length = 0;
 	}
 
-	memcpy(buffer, ptp_get_payload(r) + 8, vfd->length);
-	return vfd->length;
+	memcpy(buffer, jpeg, length);
+	ptp_liveview_release(r);
+	return length;
 }
 
 int ptp_liveview_init(struct PtpRuntime *r) {
@@ -3,19 +3,219 @@
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
+#include <stdatomic.h>
+#include <pthread.h>
 #include <camlib.h>
 
+#if CAMLIB_LOG_SLOTS & (CAMLIB_LOG_SLOTS - 1)
+	#error "CAMLIB_LOG_SLOTS must be a power of 2"
+#endif
+
+#ifdef VERBOSE
+static atomic_int log_level = PTP_LOG_TRACE;
+#else
+static atomic_int log_level = PTP_LOG_WARN;
+#endif
+static atomic_uint log_categories = ~0u;
+
+static void stdout_sink(int level, int category, const char *msg) {
+	fputs(msg, stdout);
+}
+
+static ptp_log_sink *_Atomic log_sink = stdout_sink;
+
+// Bounded multi producer queue, each slot's sequence number tells whose turn it is:
+// seq == pos means free for the producer claiming pos, seq == pos + 1 means ready to drain.
+struct LogSlot {
+	atomic_uint seq;
+	int level;
+	int category;
+	char msg[CAMLIB_LOG_LINE];
+};
+
+static struct LogSlot ring[CAMLIB_LOG_SLOTS];
+static atomic_uint ring_head;
+// Only touched by the drain thread, or by ptp_log_stop_async once it's gone
+static unsigned int ring_tail;
+static atomic_uint ring_dropped;
+
+static atomic_int async_on = 0;
+static atomic_int async_stop = 0;
+static pthread_t async_thread;
+// Serializes ptp_log_start_async and ptp_log_stop_async
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t ring_once = PTHREAD_ONCE_INIT;
+
+// How long the drain thread sleeps when the ring is empty
+#ifndef CAMLIB_LOG_DRAIN_MS
+	#define CAMLIB_LOG_DRAIN_MS 5
+#endif
+
+static void ring_push(int level, int category, const char *fmt, va_list args) {
+	unsigned int pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+	struct LogSlot *slot;
+	while (1) {
+		slot = &ring[pos & (CAMLIB_LOG_SLOTS - 1)];
+		unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		int diff = (int)(seq - pos);
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&ring_head, &pos, pos + 1,
+					memory_order_relaxed, memory_order_relaxed)) break;
+		} else if (diff < 0) {
+			// Full, the caller must never wait on the sink
+			atomic_fetch_add_explicit(&ring_dropped, 1, memory_order_relaxed);
+			return;
+		} else {
+			pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+		}
+	}
+
+	slot->level = level;
+	slot->category = category;
+	vsnprintf(slot->msg, sizeof(slot->msg), fmt, args);
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+}
+
+// Hand everything that's ready to the sink, returns the number of messages
+static int ring_drain(void) {
+	ptp_log_sink *sink = atomic_load(&log_sink);
+	int n = 0;
+	while (1) {
+		struct LogSlot *slot = &ring[ring_tail & (CAMLIB_LOG_SLOTS - 1)];
+		unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		if (seq != ring_tail + 1) break;
+
+		sink(slot->level, slot->category, slot->msg);
+
+		atomic_store_explicit(&slot->seq, ring_tail + CAMLIB_LOG_SLOTS, memory_order_release);
+		ring_tail++;
+		n++;
+	}
+
+	return n;
+}
+
+static void *drain_thread(void *arg) {
+	unsigned int reported = 0;
+	while (1) {
+		int n = ring_drain();
+
+		unsigned int dropped = atomic_load_explicit(&ring_dropped, memory_order_relaxed);
+		if (dropped != reported) {
+			char msg[64];
+			snprintf(msg, sizeof(msg), "log: dropped %u messages\n", dropped - reported);
+			atomic_load(&log_sink)(PTP_LOG_WARN, PTP_LOG_CORE, msg);
+			reported = dropped;
+		}
+
+		if (n == 0) {
+			if (atomic_load(&async_stop)) break;
+			CAMLIB_SLEEP(CAMLIB_LOG_DRAIN_MS);
+		}
+	}
+
+	return NULL;
+}
+
+static void log_vwrite(int level, int category, const char *fmt, va_list args) {
+	if (level > atomic_load_explicit(&log_level, memory_order_relaxed)) return;
+	if (category < 0 || category >= PTP_LOG_CATEGORY_COUNT) category = PTP_LOG_CORE;
+	if (!(atomic_load_explicit(&log_categories, memory_order_relaxed) & (1u << category))) return;
+
+	if (atomic_load_explicit(&async_on, memory_order_acquire)) {
+		ring_push(level, category, fmt, args);
+		return;
+	}
+
+	char msg[CAMLIB_LOG_LINE];
+	vsnprintf(msg, sizeof(msg), fmt, args);
+	atomic_load(&log_sink)(level, category, msg);
+}
+
+void ptp_log_write(int level, int category, const char *fmt, ...) {
+	va_list args;
+	va_start(args, fmt);
+	log_vwrite(level, category, fmt, args);
+	va_end(args);
+}
+
+void ptp_log_set_level(int level) {
+	atomic_store(&log_level, level);
+}
+
+void ptp_log_set_categories(unsigned int mask) {
+	atomic_store(&log_categories, mask);
+}
+
+void ptp_log_set_sink(ptp_log_sink *sink) {
+	atomic_store(&log_sink, sink ? sink : stdout_sink);
+}
+
+// Slot sequence numbers are only set up once. A producer that saw async_on just before a stop
+// can still be writing its slot, so a restart carries on from where the ring was left.
+static void ring_init(void) {
+	for (unsigned int i = 0; i < CAMLIB_LOG_SLOTS; i++) {
+		atomic_store_explicit(&ring[i].seq, i, memory_order_relaxed);
+	}
+}
+
+int ptp_log_start_async(void) {
+	pthread_once(&ring_once, ring_init);
+
+	pthread_mutex_lock(&async_lock);
+	if (atomic_load(&async_on)) {
+		pthread_mutex_unlock(&async_lock);
+		return 0;
+	}
+
+	atomic_store(&async_stop, 0);
+	if (pthread_create(&async_thread, NULL, drain_thread, NULL)) {
+		pthread_mutex_unlock(&async_lock);
+		return PTP_RUNTIME_ERR;
+	}
+
+	atomic_store_explicit(&async_on, 1, memory_order_release);
+	pthread_mutex_unlock(&async_lock);
+	return 0;
+}
+
+void ptp_log_stop_async(void) {
+	if (!atomic_load(&async_on)) return;
+	// A sink that panics can't wait on itself
+	if (pthread_equal(pthread_self(), async_thread)) return;
+
+	pthread_mutex_lock(&async_lock);
+	if (!atomic_load(&async_on)) {
+		pthread_mutex_unlock(&async_lock);
+		return;
+	}
+
+	// New messages go straight to the sink from here on
+	atomic_store(&async_on, 0);
+	atomic_store(&async_stop, 1);
+	pthread_join(async_thread, NULL);
+
+	// Anything a producer claimed while we were stopping
+	ring_drain();
+	pthread_mutex_unlock(&async_lock);
+}
+
+unsigned int ptp_log_dropped(void) {
+	return atomic_load(&ring_dropped);
+}
+
 void ptp_verbose_log(char *fmt, ...) {
 #ifdef VERBOSE
 	va_list args;
 	va_start(args, fmt);
-	vprintf(fmt, args);
+	log_vwrite(PTP_LOG_DEBUG, PTP_LOG_CORE, fmt, args);
 	va_end(args);
 #endif
 }
 
 __attribute__ ((noreturn))
 void ptp_panic(char *fmt, ...) {
+	ptp_log_stop_async();
 	printf("PTP abort: ");
 	va_list args;
 	va_start(args, fmt);
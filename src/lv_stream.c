@@ -0,0 +1,250 @@
+// Liveview streaming engine: frames are fetched on a background thread into three buffers,
+// consumers only ever see the newest one.
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include <camlib.h>
+#include <ptp.h>
+
+// Bounds for the poll interval, the start value is a guess at 30fps
+#define LV_MIN_INTERVAL_US 1000
+#define LV_MAX_INTERVAL_US 200000
+#define LV_START_INTERVAL_US 33000
+
+// Longest single sleep, so ptp_lv_stream_stop doesn't wait long
+#define LV_SLEEP_SLICE_MS 10
+
+struct PtpLvStream {
+	pthread_t thread;
+	atomic_int stop;
+
+	int type;
+	ptp_lv_callback *callback;
+	void *arg;
+
+	// Guards the slot roles and the counters below
+	pthread_mutex_t lock;
+	// The thread fills back, the newest finished frame waits in ready, the consumer holds front
+	struct PtpLvFrame slots[3];
+	struct PtpLvFrame *back;
+	struct PtpLvFrame *ready;
+	struct PtpLvFrame *front;
+	// Set when ready holds a frame the consumer hasn't taken
+	int fresh;
+
+	struct PtpLvStreamInfo info;
+	// Set when the thread gave up, returned to the consumer from then on
+	int rc;
+};
+
+static uint64_t now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void lv_sleep(struct PtpLvStream *s, uint64_t us) {
+	int ms = (int)(us / 1000);
+	while (ms > 0 && !atomic_load(&s->stop)) {
+		int slice = ms < LV_SLEEP_SLICE_MS ? ms : LV_SLEEP_SLICE_MS;
+		CAMLIB_SLEEP(slice);
+		ms -= slice;
+	}
+}
+
+static int frame_reserve(struct PtpLvFrame *f, int size) {
+	if (f->size >= size) return 0;
+	uint8_t *data = realloc(f->data, size);
+	if (data == NULL) return PTP_OUT_OF_MEM;
+	f->data = data;
+	f->size = size;
+	return 0;
+}
+
+// Fetch one frame into s->back. Returns 0 with length 0 if the camera had nothing new.
+static int lv_fetch(struct PtpRuntime *r, struct PtpLvStream *s) {
+	struct PtpLvFrame *f = s->back;
+	f->length = 0;
+
+	if (s->type == PTP_LV_ML) {
+		int rc = frame_reserve(f, ptp_liveview_size(r));
+		if (rc) return rc;
+		rc = ptp_liveview_ml(r, f->data);
+		if (rc < 0) return rc;
+		f->length = rc;
+		return 0;
+	}
+
+	const uint8_t *jpeg;
+	int length;
+	int rc = ptp_liveview_eos_borrow(r, &jpeg, &length);
+	if (rc) return rc;
+
+	rc = frame_reserve(f, length);
+	if (rc == 0) {
+		memcpy(f->data, jpeg, length);
+		f->length = length;
+	}
+
+	ptp_liveview_release(r);
+	return rc;
+}
+
+static void lv_publish(struct PtpRuntime *r, struct PtpLvStream *s, uint64_t time) {
+	struct PtpLvFrame *f = s->back;
+
+	pthread_mutex_lock(&s->lock);
+	f->seq = ++s->info.frames;
+	f->time_us = time;
+	pthread_mutex_unlock(&s->lock);
+
+	// back is still ours, so the callback can read it without holding anything
+	if (s->callback != NULL) {
+		s->callback(r, f, s->arg);
+	}
+
+	pthread_mutex_lock(&s->lock);
+	if (s->fresh) s->info.dropped++;
+	s->back = s->ready;
+	s->ready = f;
+	s->fresh = 1;
+	pthread_mutex_unlock(&s->lock);
+}
+
+static void *lv_thread(void *arg) {
+	struct PtpRuntime *r = (struct PtpRuntime *)arg;
+	struct PtpLvStream *s = r->lv_stream;
+
+	// Average time between frames the camera actually had ready
+	uint64_t interval = LV_START_INTERVAL_US;
+	uint64_t last_frame = 0;
+
+	while (!atomic_load(&s->stop)) {
+		uint64_t start = now_us();
+		int rc = lv_fetch(r, s);
+
+		if (rc == PTP_CHECK_CODE || (rc == 0 && s->back->length == 0)) {
+			// Too early (or liveview is off), try again a fraction of a frame later
+			pthread_mutex_lock(&s->lock);
+			s->info.not_ready++;
+			pthread_mutex_unlock(&s->lock);
+			lv_sleep(s, interval / 4 > LV_MIN_INTERVAL_US ? interval / 4 : LV_MIN_INTERVAL_US);
+			continue;
+		} else if (rc) {
+			ptp_log(PTP_LOG_ERR, PTP_LOG_CORE, "lv_stream: stopping on %d\n", rc);
+			pthread_mutex_lock(&s->lock);
+			s->rc = rc;
+			pthread_mutex_unlock(&s->lock);
+			break;
+		}
+
+		uint64_t now = now_us();
+		if (last_frame != 0) {
+			uint64_t measured = now - last_frame;
+			if (measured < LV_MIN_INTERVAL_US) measured = LV_MIN_INTERVAL_US;
+			if (measured > LV_MAX_INTERVAL_US) measured = LV_MAX_INTERVAL_US;
+			interval = (interval * 7 + measured) / 8;
+		}
+		last_frame = now;
+
+		pthread_mutex_lock(&s->lock);
+		s->info.interval_us = (uint32_t)interval;
+		pthread_mutex_unlock(&s->lock);
+
+		lv_publish(r, s, now);
+
+		// Aim a little before the next frame is due, the not ready path covers the rest.
+		// A camera that always has a frame ready settles at back to back polls.
+		uint64_t spent = now_us() - start;
+		uint64_t due = interval * 3 / 4;
+		if (due > spent) lv_sleep(s, due - spent);
+	}
+
+	return NULL;
+}
+
+int ptp_lv_stream_start(struct PtpRuntime *r, ptp_lv_callback *callback, void *arg) {
+	if (r->lv_stream != NULL) return PTP_RUNTIME_ERR;
+
+	int type = ptp_liveview_type(r);
+	if (type != PTP_LV_ML && type != PTP_LV_EOS && type != PTP_LV_EOS_ML_BMP) {
+		return PTP_UNSUPPORTED;
+	}
+
+	struct PtpLvStream *s = calloc(1, sizeof(struct PtpLvStream));
+	if (s == NULL) return PTP_OUT_OF_MEM;
+
+	s->type = type;
+	s->callback = callback;
+	s->arg = arg;
+	s->back = &s->slots[0];
+	s->ready = &s->slots[1];
+	s->front = &s->slots[2];
+	s->info.interval_us = LV_START_INTERVAL_US;
+	pthread_mutex_init(&s->lock, NULL);
+
+	r->lv_stream = s;
+	if (pthread_create(&s->thread, NULL, lv_thread, r)) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_CORE, "Failed to start liveview thread\n");
+		r->lv_stream = NULL;
+		pthread_mutex_destroy(&s->lock);
+		free(s);
+		return PTP_RUNTIME_ERR;
+	}
+
+	return 0;
+}
+
+void ptp_lv_stream_stop(struct PtpRuntime *r) {
+	struct PtpLvStream *s = r->lv_stream;
+	if (s == NULL) return;
+
+	atomic_store(&s->stop, 1);
+	pthread_join(s->thread, NULL);
+
+	r->lv_stream = NULL;
+	for (int i = 0; i < 3; i++) {
+		free(s->slots[i].data);
+	}
+	pthread_mutex_destroy(&s->lock);
+	free(s);
+}
+
+int ptp_lv_stream_latest(struct PtpRuntime *r, struct PtpLvFrame **frame) {
+	struct PtpLvStream *s = r->lv_stream;
+	*frame = NULL;
+	if (s == NULL) return PTP_RUNTIME_ERR;
+
+	pthread_mutex_lock(&s->lock);
+	int rc = 0;
+	if (s->fresh) {
+		struct PtpLvFrame *f = s->front;
+		s->front = s->ready;
+		s->ready = f;
+		s->fresh = 0;
+		rc = 1;
+	} else if (s->rc) {
+		rc = s->rc;
+	}
+
+	if (s->front->seq != 0) *frame = s->front;
+	pthread_mutex_unlock(&s->lock);
+
+	return rc;
+}
+
+void ptp_lv_stream_info(struct PtpRuntime *r, struct PtpLvStreamInfo *info) {
+	struct PtpLvStream *s = r->lv_stream;
+	if (s == NULL) {
+		memset(info, 0, sizeof(struct PtpLvStreamInfo));
+		return;
+	}
+
+	pthread_mutex_lock(&s->lock);
+	memcpy(info, &s->info, sizeof(struct PtpLvStreamInfo));
+	pthread_mutex_unlock(&s->lock);
+}
@@ -9,8 +9,8 @@
 #include <ptp.h>
 
 // Destination buffer size
-#define SCREEN_WIDTH 720
-#define SCREEN_HEIGHT 480
+#define SCREEN_WIDTH PTP_ML_BMP_LV_WIDTH
+#define SCREEN_HEIGHT PTP_ML_BMP_LV_HEIGHT
 
 // BMP VRAM is a little oversized, will be cropped
 #define BMP_VRAM_WIDTH 960
@@ -52,6 +52,74 @@ void yuv2rgb(uint8_t Y, uint8_t U, uint8_t V, uint8_t *R, uint8_t *G, uint8_t *B
     *B = coerce(v, 0, 255);
 }
 
+#if !defined(CAMLIB_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	#define ML_SIMD_X86
+	#include <immintrin.h>
+#endif
+
+// Palette resolved to the final BGRA pixels, rebuilt whenever lv_info is
+static uint32_t lv_lut[256];
+
+static void build_lut(void) {
+	for (int color = 0; color < 256; color++) {
+		uint32_t pal = lv_info.lcd_palette[color];
+		if (color == 0 || color == 4) {
+			pal = 0x00FF0000;
+		}
+
+		uint8_t Y, U, V;
+		Y = (pal >> 16) & 0xFF;
+		U = (pal >>  8) & 0xFF;
+		V = (pal >>  0) & 0xFF;
+
+		// Note: alpha layer is special, and needs more research done (it's fine for now)
+		// pal 0x00FF0000 == fully transparent. A == 0 || A == 1 is semi-transparent.
+
+		uint8_t px[4];
+		yuv2rgb(Y, U, V, &px[2], &px[1], &px[0]);
+
+		if (pal == 0x00FF0000) {
+			px[3] = 0xFF; // fully transparent
+		} else {
+			px[3] = 0x0; // not transparent
+		} // TODO: semi-transparent
+
+		memcpy(&lv_lut[color], px, 4);
+	}
+}
+
+static void lut_row_scalar(uint32_t *out, const uint8_t *in, int length) {
+	for (int x = 0; x < length; x++) {
+		out[x] = lv_lut[in[x]];
+	}
+}
+
+#ifdef ML_SIMD_X86
+// 8 pixels per gather, the LUT is 1K so it stays in L1
+__attribute__((target("avx2")))
+static void lut_row_avx2(uint32_t *out, const uint8_t *in, int length) {
+	int x = 0;
+	for (; x + 8 <= length; x += 8) {
+		__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(in + x)));
+		_mm256_storeu_si256((__m256i *)(out + x), _mm256_i32gather_epi32((const int *)lv_lut, idx, 4));
+	}
+
+	lut_row_scalar(out + x, in + x, length - x);
+}
+
+static void (*lut_row)(uint32_t *out, const uint8_t *in, int length) = lut_row_scalar;
+
+__attribute__((constructor))
+static void pick_lut_kernel(void) {
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		lut_row = lut_row_avx2;
+	}
+}
+#else
+static void (*lut_row)(uint32_t *out, const uint8_t *in, int length) = lut_row_scalar;
+#endif
+
 int ptp_ml_init_bmp_lv(struct PtpRuntime *r) {
 	precompute_yuv2rgb();
 
@@ -66,13 +134,12 @@ int ptp_ml_init_bmp_lv(struct PtpRuntime *r) {
 	}
 
 	memcpy(&lv_info, ptp_get_payload(r), sizeof(lv_info));
+	build_lut();
 
 	return 0;
 }
 
-int ptp_ml_get_bmp_lv(struct PtpRuntime *r, uint32_t **buffer_ptr) {
-	buffer_ptr[0] = NULL;
-
+int ptp_ml_get_bmp_lv_frame(struct PtpRuntime *r, uint32_t *frame) {
 	static int toggle = 0;
 
 	toggle++;
@@ -88,58 +155,36 @@ int ptp_ml_get_bmp_lv(struct PtpRuntime *r, uint32_t **buffer_ptr) {
 
 	int rc = ptp_send(r, &cmd);
 	if (rc) {
-		buffer_ptr[0] = NULL;
 		return rc;
 	}
 
-	uint32_t *frame = malloc(SCREEN_WIDTH * SCREEN_HEIGHT * 4);
-	if (frame == NULL) return PTP_RUNTIME_ERR;
+	if (ptp_get_payload_length(r) < BMP_VRAM_WIDTH * BMP_VRAM_HEIGHT) {
+		return PTP_CHECK_CODE;
+	}
 
 	// TODO: parse ver info from header
 	//struct PtpMlLvHeader *header = (struct PtpMlLvHeader *)(ptp_get_payload(r));
 
 	uint8_t *bmp = (uint8_t *)(ptp_get_payload(r));
 
-	int i = 0;
-	for (int y = 0; y < BMP_VRAM_HEIGHT; y++) {
-		for (int x = 0; x < BMP_VRAM_WIDTH; x++) {
-			if (x > SCREEN_WIDTH) {
-				i++;
-				continue;
-			}
-
-			int i2 = y * SCREEN_WIDTH + x;
-
-			uint8_t color = bmp[i];
-			uint32_t pal = lv_info.lcd_palette[color];
-			i++;
-			if (color == 0 || color == 4) {
-				pal = 0x00FF0000;
-			}
-
-			uint8_t Y, U, V, A;
-			A = (pal >> 24) & 0xFF;
-			Y = (pal >> 16) & 0xFF;
-			U = (pal >>  8) & 0xFF;
-			V = (pal >>  0) & 0xFF;
-
-			// Note: alpha layer is special, and needs more research done (it's fine for now)
-			// pal 0x00FF0000 == fully transparent. A == 0 || A == 1 is semi-transparent.
-
-			uint8_t R, G, B;
-			yuv2rgb(Y, U, V, &R, &G, &B);
-
-			if (pal == 0x00FF0000) {
-				A = 0xFF; // fully transparent
-			} else {
-				A = 0x0; // not transparent
-			} // TODO: semi-transparent
-
-			((uint8_t *)&frame[i2])[0] = B;
-			((uint8_t *)&frame[i2])[1] = G;
-			((uint8_t *)&frame[i2])[2] = R;
-			((uint8_t *)&frame[i2])[3] = A;
-		}
+	// VRAM rows are wider than the screen, the rest of each row is cropped
+	for (int y = 0; y < SCREEN_HEIGHT; y++) {
+		lut_row(frame + y * SCREEN_WIDTH, bmp + y * BMP_VRAM_WIDTH, SCREEN_WIDTH);
+	}
+
+	return 0;
+}
+
+int ptp_ml_get_bmp_lv(struct PtpRuntime *r, uint32_t **buffer_ptr) {
+	buffer_ptr[0] = NULL;
+
+	uint32_t *frame = malloc(SCREEN_WIDTH * SCREEN_HEIGHT * 4);
+	if (frame == NULL) return PTP_RUNTIME_ERR;
+
+	int rc = ptp_ml_get_bmp_lv_frame(r, frame);
+	if (rc) {
+		free(frame);
+		return rc;
 	}
 
 	buffer_ptr[0] = frame;
@@ -27,6 +27,18 @@ int ptpip_cmd_read(struct PtpRuntime *r, void *data, int size) {
 	return -1;
 }
 
+int ptpip_cmd_writev(struct PtpRuntime *r, void *header, int header_length, void *payload, int payload_length) {
+	return -1;
+}
+
+int ptpip_cmd_sendfile(struct PtpRuntime *r, int fd, int size) {
+	return PTP_UNSUPPORTED;
+}
+
+int ptpip_cmd_splice(struct PtpRuntime *r, int fd, int size) {
+	return PTP_UNSUPPORTED;
+}
+
 int ptpip_event_send(struct PtpRuntime *r, void *data, int size) {
 	return -1;
 }
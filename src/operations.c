@@ -40,12 +40,15 @@ int ptpip_init_command_request(struct PtpRuntime *r, char *device_name) {
 	ptp_write_unicode_string(p->device_name, "cam");
 
 	if (ptpip_cmd_write(r, r->data, p->length) != p->length) return PTP_IO_ERR;
+	ptp_trace_io(r, 0, r->data, p->length);
 
 	// Read the packet size, then receive the rest
 	int x = ptpip_cmd_read(r, r->data, 4);
 	if (x < 0) return PTP_IO_ERR;
+	ptp_trace_io(r, PTP_TRACE_IN, r->data, x);
 	x = ptpip_cmd_read(r, r->data + 4, p->length - 4);
 	if (x < 0) return PTP_IO_ERR;
+	ptp_trace_io(r, PTP_TRACE_IN, r->data + 4, x);
 
 	struct PtpIpHeader *hdr = (struct PtpIpHeader *)r->data;
 	if (hdr->type == PTPIP_INIT_FAIL) {
@@ -58,10 +61,14 @@ int ptpip_init_command_request(struct PtpRuntime *r, char *device_name) {
 // Experimental, not for use yet - none of my devices seem to use this endpoint
 int ptp_get_event(struct PtpRuntime *r, struct PtpEventContainer *ec) {
 	int rc = ptp_read_int(r, r->data, r->max_packet_size);
-	if (rc) return rc;
+	if (rc <= 0) return rc;
 
 	memcpy(ec, r->data, sizeof(struct PtpEventContainer));
 
+	if (ec->code == PTP_EC_DevicePropChanged) {
+		ptp_prop_store_invalidate(r, ec->params[0]);
+	}
+
 	return rc;
 }
 
@@ -73,11 +80,13 @@ int ptpip_init_events(struct PtpRuntime *r) {
 	if (ptpip_event_send(r, &h, h.length) != h.length) {
 		return PTP_IO_ERR;
 	}
+	ptp_trace_io(r, PTP_TRACE_EVENT, &h, h.length);
 
 	// ack is always 4 bytes
 	if (ptpip_event_read(r, r->data, 8) != 8) {
 		return PTP_IO_ERR;
 	}
+	ptp_trace_io(r, PTP_TRACE_IN | PTP_TRACE_EVENT, r->data, 8);
 
 	return 0;
 }
@@ -332,6 +341,23 @@ int ptp_get_object(struct PtpRuntime *r, int handle) {
 	return ptp_send(r, &cmd);	
 }
 
+int ptp_get_object_file(struct PtpRuntime *r, int handle, FILE *stream) {
+	struct PtpCommand cmd;
+	cmd.code = PTP_OC_GetObject;
+	cmd.param_length = 1;
+	cmd.params[0] = handle;
+
+	return ptp_send_to_file(r, &cmd, stream);
+}
+
+int ptp_send_object_file(struct PtpRuntime *r, FILE *stream, int length) {
+	struct PtpCommand cmd;
+	cmd.code = PTP_OC_SendObject;
+	cmd.param_length = 0;
+
+	return ptp_send_data_file(r, &cmd, stream, length);
+}
+
 int ptp_download_object(struct PtpRuntime *r, int handle, FILE *f, size_t max) {
 	int read = 0;
 	while (1) {
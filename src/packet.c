@@ -68,6 +68,7 @@ int ptp_read_uint16_array_s(uint8_t *bs, uint8_t *be, uint16_t *buf, int max, in
 			of += ptp_read_u16(bs + of, &buf[i]);
 		}
 	}
+	(*length) = n < (uint32_t)max ? (int)n : max;
 	return of;	
 }
 
@@ -168,7 +169,7 @@ int ptpip_bulk_packet(struct PtpRuntime *r, struct PtpCommand *cmd, int type) {
 
 int ptpip_data_start_packet(struct PtpRuntime *r, int data_length) {
 	struct PtpIpStartDataPacket *pkt = (struct PtpIpStartDataPacket *)(r->data);
-	pkt->length = 0x20;
+	pkt->length = sizeof(struct PtpIpStartDataPacket);
 	pkt->type = PTPIP_DATA_PACKET_START;
 	pkt->transaction = r->transaction;
 	pkt->data_phase_length = (uint64_t)data_length;	
@@ -187,6 +188,33 @@ int ptpip_data_end_packet(struct PtpRuntime *r, void *data, int data_length) {
 	return pkt->length;
 }
 
+// Build the headers that go in front of a data phase payload at r->data + of:
+// START and END packet headers for PTP/IP, a data container header for USB.
+int ptp_new_data_header(struct PtpRuntime *r, int of, struct PtpCommand *cmd, int data_length) {
+	if (r->connection_type == PTP_IP) {
+		struct PtpIpStartDataPacket *start = (struct PtpIpStartDataPacket *)(r->data + of);
+		start->length = sizeof(struct PtpIpStartDataPacket);
+		start->type = PTPIP_DATA_PACKET_START;
+		start->transaction = r->transaction;
+		start->data_phase_length = (uint64_t)data_length;
+
+		struct PtpIpEndDataPacket *end = (struct PtpIpEndDataPacket *)(r->data + of + start->length);
+		end->length = sizeof(struct PtpIpEndDataPacket) + data_length;
+		end->type = PTPIP_DATA_PACKET_END;
+		end->transaction = r->transaction;
+
+		return sizeof(struct PtpIpStartDataPacket) + sizeof(struct PtpIpEndDataPacket);
+	} else {
+		struct PtpBulkContainer *c = (struct PtpBulkContainer *)(r->data + of);
+		c->length = 12 + data_length;
+		c->type = PTP_PACKET_TYPE_DATA;
+		c->code = cmd->code;
+		c->transaction = r->transaction;
+
+		return 12;
+	}
+}
+
 // Generate a USB-only BulkContainer packet
 int ptpusb_bulk_packet(struct PtpRuntime *r, struct PtpCommand *cmd, int type) {
 	if (cmd->param_length > 5) ptp_panic("cmd->param_length more than 5");
@@ -0,0 +1,264 @@
+// Property state kept up to date from events, so applications don't have to ask the camera
+#include <stdlib.h>
+#include <string.h>
+
+#include <camlib.h>
+#include <ptp.h>
+
+struct StoreEntry {
+	struct PtpProp prop;
+	// Neighbours in the change list, entry indexes or -1
+	int newer;
+	int older;
+};
+
+struct PtpPropStore {
+	uint32_t seq;
+
+	// Entry index plus one for every code, 0 if the code has no entry yet. See prop_bit.
+	uint16_t index[PTP_CAPS_BITS];
+	struct StoreEntry *entries;
+	int length;
+	int size;
+
+	// Entries ordered by their last change, newest first
+	int newest;
+	int oldest;
+};
+
+// Same layout as the PtpCaps bitmaps, -1 if code can't be a property
+static int prop_bit(int code) {
+	if (code < 0 || code > 0xffff || (code & 0x7000) != 0x5000) return -1;
+	return ((code & 0x8000) >> 3) | (code & 0xfff);
+}
+
+static struct StoreEntry *find(struct PtpPropStore *s, int code) {
+	int bit = prop_bit(code);
+	if (bit < 0 || s->index[bit] == 0) return NULL;
+	return &s->entries[s->index[bit] - 1];
+}
+
+static struct StoreEntry *find_or_add(struct PtpPropStore *s, int code) {
+	struct StoreEntry *e = find(s, code);
+	if (e != NULL) return e;
+
+	int bit = prop_bit(code);
+	if (bit < 0) return NULL;
+
+	if (s->length == s->size) {
+		int size = s->size ? s->size * 2 : 64;
+		struct StoreEntry *entries = realloc(s->entries, sizeof(struct StoreEntry) * size);
+		if (entries == NULL) return NULL;
+		s->entries = entries;
+		s->size = size;
+	}
+
+	e = &s->entries[s->length];
+	memset(e, 0, sizeof(struct StoreEntry));
+	e->prop.code = code;
+	e->newer = -1;
+	e->older = -1;
+	s->index[bit] = (uint16_t)(++s->length);
+	return e;
+}
+
+// Give e a new sequence number and move it to the front of the change list
+static void touch(struct PtpPropStore *s, struct StoreEntry *e) {
+	int i = (int)(e - s->entries);
+	e->prop.seq = ++s->seq;
+	if (s->newest == i) return;
+
+	// Unlink, if it was ever linked
+	if (e->newer != -1) s->entries[e->newer].older = e->older;
+	if (e->older != -1) s->entries[e->older].newer = e->newer;
+	if (s->oldest == i) s->oldest = e->newer;
+
+	e->newer = -1;
+	e->older = s->newest;
+	if (s->newest != -1) s->entries[s->newest].newer = i;
+	s->newest = i;
+	if (s->oldest == -1) s->oldest = i;
+}
+
+static void update_value(struct PtpPropStore *s, int code, uint32_t value) {
+	struct StoreEntry *e = find_or_add(s, code);
+	if (e == NULL) return;
+	if (e->prop.valid && e->prop.value == value) return;
+
+	e->prop.value = value;
+	e->prop.valid = 1;
+	touch(s, e);
+}
+
+static void update_avail(struct PtpPropStore *s, int code, int memb_size, int count, uint8_t *d) {
+	struct StoreEntry *e = find_or_add(s, code);
+	if (e == NULL) return;
+
+	uint32_t *avail = malloc(sizeof(uint32_t) * count);
+	if (avail == NULL) return;
+
+	// Wider members (like image formats) only keep their first 32 bits
+	for (int i = 0; i < count; i++) {
+		uint8_t *m = d + i * memb_size;
+		if (memb_size == 1) {
+			uint8_t v;
+			ptp_read_u8(m, &v);
+			avail[i] = v;
+		} else if (memb_size == 2 || memb_size == 3) {
+			uint16_t v;
+			ptp_read_u16(m, &v);
+			avail[i] = v;
+		} else {
+			ptp_read_u32(m, &avail[i]);
+		}
+	}
+
+	if (e->prop.avail_length == count && !memcmp(e->prop.avail, avail, sizeof(uint32_t) * count)) {
+		free(avail);
+		return;
+	}
+
+	free(e->prop.avail);
+	e->prop.avail = avail;
+	e->prop.avail_length = count;
+	touch(s, e);
+}
+
+int ptp_prop_store_enable(struct PtpRuntime *r) {
+	if (r->prop_store != NULL) return 0;
+
+	struct PtpPropStore *s = calloc(1, sizeof(struct PtpPropStore));
+	if (s == NULL) return PTP_OUT_OF_MEM;
+	s->newest = -1;
+	s->oldest = -1;
+
+	ptp_mutex_lock(r);
+	r->prop_store = s;
+	ptp_mutex_unlock(r);
+	return 0;
+}
+
+void ptp_prop_store_disable(struct PtpRuntime *r) {
+	ptp_mutex_lock(r);
+	struct PtpPropStore *s = r->prop_store;
+	r->prop_store = NULL;
+	ptp_mutex_unlock(r);
+
+	if (s == NULL) return;
+	for (int i = 0; i < s->length; i++) {
+		free(s->entries[i].prop.avail);
+	}
+	free(s->entries);
+	free(s);
+}
+
+// Entries move and avail lists are freed as events come in, so readers copy out under the lock
+int ptp_prop_store_get(struct PtpRuntime *r, int code, struct PtpProp *out, uint32_t *avail, int max) {
+	int rc = -1;
+	ptp_mutex_lock(r);
+	struct StoreEntry *e = r->prop_store ? find(r->prop_store, code) : NULL;
+	if (e != NULL) {
+		memcpy(out, &e->prop, sizeof(struct PtpProp));
+		out->avail = NULL;
+		if (avail != NULL && e->prop.avail != NULL) {
+			int n = e->prop.avail_length < max ? e->prop.avail_length : max;
+			memcpy(avail, e->prop.avail, sizeof(uint32_t) * n);
+			out->avail = avail;
+		}
+		rc = 0;
+	}
+	ptp_mutex_unlock(r);
+	return rc;
+}
+
+uint32_t ptp_prop_store_seq(struct PtpRuntime *r) {
+	ptp_mutex_lock(r);
+	uint32_t seq = r->prop_store ? r->prop_store->seq : 0;
+	ptp_mutex_unlock(r);
+	return seq;
+}
+
+int ptp_prop_store_changed(struct PtpRuntime *r, uint32_t since, int *codes, int max) {
+	ptp_mutex_lock(r);
+	struct PtpPropStore *s = r->prop_store;
+	int n = 0;
+	if (s != NULL) {
+		for (int i = s->newest; i != -1 && n < max; i = s->entries[i].older) {
+			if (s->entries[i].prop.seq <= since) break;
+			codes[n++] = s->entries[i].prop.code;
+		}
+	}
+	ptp_mutex_unlock(r);
+	return n;
+}
+
+int ptp_prop_store_refresh(struct PtpRuntime *r, int code) {
+	if (r->prop_store == NULL) return PTP_RUNTIME_ERR;
+	if (prop_bit(code) < 0) return PTP_UNSUPPORTED;
+
+	// Hold the payload until it's parsed
+	ptp_mutex_keep_locked(r);
+	int rc = ptp_get_prop_value(r, code);
+	if (rc) return rc;
+
+	switch (ptp_get_payload_length(r)) {
+	case 1:
+	case 2:
+	case 4:
+		update_value(r->prop_store, code, (uint32_t)ptp_parse_prop_value(r));
+		break;
+	default:
+		rc = PTP_UNSUPPORTED;
+	}
+
+	ptp_mutex_unlock(r);
+	return rc;
+}
+
+void ptp_prop_store_eos_events(struct PtpRuntime *r) {
+	ptp_mutex_lock(r);
+	struct PtpPropStore *s = r->prop_store;
+	if (s == NULL) {
+		ptp_mutex_unlock(r);
+		return;
+	}
+
+	uint8_t *d = ptp_get_payload(r);
+	uint8_t *end = d + ptp_get_payload_length(r);
+	while (end - d >= 8) {
+		uint32_t size, type;
+		ptp_read_u32(d, &size);
+		ptp_read_u32(d + 4, &type);
+		if (type == 0 || size < 8 || size > (uint32_t)(end - d)) break;
+
+		if (type == PTP_EC_EOS_PropValueChanged && size >= 16) {
+			uint32_t code, value;
+			ptp_read_u32(d + 8, &code);
+			ptp_read_u32(d + 12, &value);
+			update_value(s, (int)code, value);
+		} else if (type == PTP_EC_EOS_AvailListChanged && size >= 20) {
+			uint32_t code, count;
+			ptp_read_u32(d + 8, &code);
+			ptp_read_u32(d + 16, &count);
+			uint32_t payload_size = size - 20;
+			if (count != 0 && payload_size / count != 0) {
+				update_avail(s, (int)code, (int)(payload_size / count), (int)count, d + 20);
+			}
+		}
+
+		d += size;
+	}
+
+	ptp_mutex_unlock(r);
+}
+
+void ptp_prop_store_invalidate(struct PtpRuntime *r, int code) {
+	ptp_mutex_lock(r);
+	struct PtpPropStore *s = r->prop_store;
+	struct StoreEntry *e = s ? find_or_add(s, code) : NULL;
+	if (e != NULL) {
+		e->prop.valid = 0;
+		touch(s, e);
+	}
+	ptp_mutex_unlock(r);
+}
@@ -0,0 +1,344 @@
+// Comm backend that plays back a trace written by ptp_trace_start (trace.c), link it instead of libusb.c and ip.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <camlib.h>
+#include <ptp.h>
+
+struct ReplayRecord {
+	// Microseconds since the start of the trace
+	uint64_t time;
+	int flags;
+	int length;
+	uint8_t *data;
+};
+
+// Position in the trace, the command and event channels are read independently
+struct ReplayCursor {
+	int i;
+	int of;
+};
+
+struct Replay {
+	int mode;
+	uint8_t *file;
+	struct ReplayRecord *records;
+	int length;
+
+	struct ReplayCursor cmd;
+	struct ReplayCursor ev;
+
+	// When the last write was matched, in replay time and trace time. Replies are
+	// held back relative to it, so a slow host doesn't make the camera look slow too.
+	uint64_t anchor_now;
+	uint64_t anchor_time;
+
+	int mismatches;
+};
+
+static uint64_t now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void replay_free(struct PtpRuntime *r) {
+	struct Replay *rp = (struct Replay *)r->comm_backend;
+	if (rp == NULL) return;
+	free(rp->records);
+	free(rp->file);
+	free(rp);
+	r->comm_backend = NULL;
+}
+
+static int replay_parse(struct Replay *rp, int size) {
+	if (size < PTP_TRACE_HEADER_SIZE) return PTP_RUNTIME_ERR;
+
+	uint32_t magic;
+	uint16_t version;
+	ptp_read_u32(rp->file, &magic);
+	ptp_read_u16(rp->file + 4, &version);
+	if (magic != PTP_TRACE_MAGIC || version != PTP_TRACE_VERSION) return PTP_RUNTIME_ERR;
+
+	// Count first, then fill
+	for (int pass = 0; pass < 2; pass++) {
+		int of = PTP_TRACE_HEADER_SIZE;
+		int n = 0;
+		uint64_t time = 0;
+		while (of + PTP_TRACE_RECORD_SIZE <= size) {
+			uint32_t delta, length;
+			uint8_t flags;
+			ptp_read_u32(rp->file + of, &delta);
+			ptp_read_u8(rp->file + of + 4, &flags);
+			ptp_read_u32(rp->file + of + 5, &length);
+			of += PTP_TRACE_RECORD_SIZE;
+
+			// A trace cut off mid record still replays up to that point
+			if (length > (uint32_t)(size - of)) break;
+
+			time += delta;
+			if (pass == 1) {
+				rp->records[n].time = time;
+				rp->records[n].flags = flags;
+				rp->records[n].length = (int)length;
+				rp->records[n].data = rp->file + of;
+			}
+
+			of += (int)length;
+			n++;
+		}
+
+		if (pass == 0) {
+			rp->records = malloc(sizeof(struct ReplayRecord) * (n ? n : 1));
+			if (rp->records == NULL) return PTP_OUT_OF_MEM;
+		}
+		rp->length = n;
+	}
+
+	return 0;
+}
+
+int ptp_replay_open(struct PtpRuntime *r, const char *path, int mode) {
+	replay_free(r);
+
+	FILE *f = fopen(path, "rb");
+	if (f == NULL) return PTP_NO_DEVICE;
+
+	fseek(f, 0, SEEK_END);
+	long size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (size <= 0 || size > INT32_MAX) {
+		fclose(f);
+		return PTP_RUNTIME_ERR;
+	}
+
+	struct Replay *rp = calloc(1, sizeof(struct Replay));
+	if (rp == NULL) {
+		fclose(f);
+		return PTP_OUT_OF_MEM;
+	}
+	rp->mode = mode;
+
+	rp->file = malloc(size);
+	if (rp->file == NULL || fread(rp->file, 1, size, f) != (size_t)size) {
+		fclose(f);
+		free(rp->file);
+		free(rp);
+		return PTP_IO_ERR;
+	}
+	fclose(f);
+
+	int rc = replay_parse(rp, (int)size);
+	if (rc) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_CORE, "%s is not a camlib trace\n", path);
+		free(rp->records);
+		free(rp->file);
+		free(rp);
+		return rc;
+	}
+
+	uint16_t type;
+	uint32_t max_packet_size;
+	ptp_read_u16(rp->file + 6, &type);
+	ptp_read_u32(rp->file + 8, &max_packet_size);
+	r->connection_type = (uint8_t)type;
+	r->max_packet_size = max_packet_size ? (int)max_packet_size : 512;
+
+	r->comm_backend = rp;
+	ptp_log(PTP_LOG_INFO, PTP_LOG_CORE, "Replaying %d records from %s\n", rp->length, path);
+	return 0;
+}
+
+int ptp_replay_mismatches(struct PtpRuntime *r) {
+	struct Replay *rp = (struct Replay *)r->comm_backend;
+	if (rp == NULL) return 0;
+	return rp->mismatches;
+}
+
+// Next record on this channel, or NULL at the end of the trace
+static struct ReplayRecord *replay_seek(struct Replay *rp, struct ReplayCursor *c, int event) {
+	while (c->i < rp->length) {
+		struct ReplayRecord *rec = &rp->records[c->i];
+		if (((rec->flags & PTP_TRACE_EVENT) != 0) == event) return rec;
+		c->i++;
+		c->of = 0;
+	}
+
+	return NULL;
+}
+
+static void replay_next(struct ReplayCursor *c, struct ReplayRecord *rec, int n) {
+	c->of += n;
+	if (c->of == rec->length) {
+		c->i++;
+		c->of = 0;
+	}
+}
+
+static int replay_write(struct PtpRuntime *r, int event, const void *data, int length) {
+	struct Replay *rp = (struct Replay *)r->comm_backend;
+	if (rp == NULL || r->io_kill_switch) return -1;
+	struct ReplayCursor *c = event ? &rp->ev : &rp->cmd;
+
+	// Outgoing records are matched by content, whatever size pieces they were written in
+	int mismatch = 0;
+	int done = 0;
+	while (done < length) {
+		struct ReplayRecord *rec = replay_seek(rp, c, event);
+		if (rec == NULL || (rec->flags & PTP_TRACE_IN)) {
+			mismatch = 1;
+			break;
+		}
+
+		int n = rec->length - c->of;
+		if (n > length - done) n = length - done;
+		if (memcmp(rec->data + c->of, (const uint8_t *)data + done, n)) mismatch = 1;
+
+		rp->anchor_time = rec->time;
+		replay_next(c, rec, n);
+		done += n;
+	}
+
+	if (mismatch) {
+		if (rp->mismatches == 0) ptp_log(PTP_LOG_WARN, PTP_LOG_CORE, "replay: host diverged from the trace\n");
+		rp->mismatches++;
+	}
+
+	rp->anchor_now = now_us();
+	return length;
+}
+
+static int replay_read(struct PtpRuntime *r, int event, void *to, int length) {
+	struct Replay *rp = (struct Replay *)r->comm_backend;
+	if (rp == NULL || r->io_kill_switch) return -1;
+	struct ReplayCursor *c = event ? &rp->ev : &rp->cmd;
+
+	struct ReplayRecord *rec;
+	while ((rec = replay_seek(rp, c, event)) != NULL && !(rec->flags & PTP_TRACE_IN)) {
+		// The host skipped something it wrote when the trace was recorded
+		rp->mismatches++;
+		c->i++;
+		c->of = 0;
+	}
+
+	if (rec == NULL) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_CORE, "replay: end of trace\n");
+		return -1;
+	}
+
+	if (c->of == 0 && rp->mode == PTP_REPLAY_REALTIME && rec->time > rp->anchor_time) {
+		uint64_t due = rp->anchor_now + (rec->time - rp->anchor_time);
+		uint64_t now = now_us();
+		if (due > now) usleep(due - now);
+	}
+
+	// Never more than one record, so USB reads come back as the same transfers
+	int n = rec->length - c->of;
+	if (n > length) n = length;
+	memcpy(to, rec->data + c->of, n);
+	replay_next(c, rec, n);
+	return n;
+}
+
+int ptp_comm_init(struct PtpRuntime *r) {
+	if (r->comm_backend == NULL) return PTP_NO_DEVICE;
+	return 0;
+}
+
+struct PtpDeviceEntry *ptpusb_device_list(struct PtpRuntime *r) {
+	if (r->comm_backend == NULL) return NULL;
+
+	struct PtpDeviceEntry *e = calloc(1, sizeof(struct PtpDeviceEntry));
+	if (e == NULL) return NULL;
+
+	e->endpoint_in = 0x81;
+	e->endpoint_out = 0x2;
+	e->endpoint_int = 0x83;
+	strcpy(e->name, "Replay");
+	strcpy(e->manufacturer, "camlib");
+
+	return e;
+}
+
+int ptp_device_open(struct PtpRuntime *r, struct PtpDeviceEntry *entry) {
+	if (ptp_comm_init(r)) return PTP_NO_DEVICE;
+	r->io_kill_switch = 0;
+	return 0;
+}
+
+int ptp_device_init(struct PtpRuntime *r) {
+	return ptp_device_open(r, NULL);
+}
+
+int ptp_device_close(struct PtpRuntime *r) {
+	r->io_kill_switch = 1;
+	replay_free(r);
+	return 0;
+}
+
+int ptp_device_reset(struct PtpRuntime *r) {
+	return 0;
+}
+
+int ptp_cmd_write(struct PtpRuntime *r, void *to, int length) {
+	return replay_write(r, 0, to, length);
+}
+
+int ptp_cmd_read(struct PtpRuntime *r, void *to, int length) {
+	return replay_read(r, 0, to, length);
+}
+
+int ptp_read_int(struct PtpRuntime *r, void *to, int length) {
+	return replay_read(r, 1, to, length);
+}
+
+int ptpip_connect(struct PtpRuntime *r, const char *addr, int port) {
+	if (r->comm_backend == NULL) return PTP_NO_DEVICE;
+	r->io_kill_switch = 0;
+	return 0;
+}
+
+int ptpip_connect_events(struct PtpRuntime *r, const char *addr, int port) {
+	if (r->comm_backend == NULL) return PTP_NO_DEVICE;
+	return 0;
+}
+
+int ptpip_close(struct PtpRuntime *r) {
+	replay_free(r);
+	return 0;
+}
+
+int ptpip_cmd_write(struct PtpRuntime *r, void *data, int size) {
+	return replay_write(r, 0, data, size);
+}
+
+int ptpip_cmd_read(struct PtpRuntime *r, void *data, int size) {
+	return replay_read(r, 0, data, size);
+}
+
+int ptpip_cmd_writev(struct PtpRuntime *r, void *header, int header_length, void *payload, int payload_length) {
+	if (replay_write(r, 0, header, header_length) < 0) return PTP_IO_ERR;
+	if (payload_length && replay_write(r, 0, payload, payload_length) < 0) return PTP_IO_ERR;
+	return header_length + payload_length;
+}
+
+// Traces are recorded without these, callers fall back to normal reads and writes
+int ptpip_cmd_sendfile(struct PtpRuntime *r, int fd, int size) {
+	return PTP_UNSUPPORTED;
+}
+
+int ptpip_cmd_splice(struct PtpRuntime *r, int fd, int size) {
+	return PTP_UNSUPPORTED;
+}
+
+int ptpip_event_send(struct PtpRuntime *r, void *data, int size) {
+	return replay_write(r, 1, data, size);
+}
+
+int ptpip_event_read(struct PtpRuntime *r, void *data, int size) {
+	return replay_read(r, 1, data, size);
+}
@@ -0,0 +1,1038 @@
+// In-memory simulated camera: an EOS body behind a byte stream in each direction, spoken in
+// PTP/USB, PTP/IP or PTP/IP-USB framing. sim_backend.c plugs it in place of libusb.c and ip.c,
+// src/simcam serves it over real sockets.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <camlib.h>
+#include <ptp.h>
+
+// Room left in front of every outgoing payload for the container header
+#define SIM_HEADROOM 12
+
+// Largest non-data packet we accept from the host
+#define SIM_HEADER_MAX 128
+
+#define SIM_STORAGE_ID 0x10001
+#define SIM_TEST_HANDLE 0xdeadbeef
+#define SIM_TEST_SIZE 1234
+
+// One transfer from the camera to the host
+struct SimSegment {
+	struct SimSegment *next;
+	uint8_t *data;
+	int length;
+	int read;
+	// Freed with the segment. NULL when data points into a buffer owned by a later segment.
+	void *alloc;
+};
+
+struct SimProp {
+	uint16_t code;
+	uint16_t type;
+	uint32_t value;
+	uint32_t default_value;
+	int min;
+	int max;
+	int step;
+	// Reported through EOS GetEvent rather than the standard property ops
+	int eos;
+	int changed;
+};
+
+struct PtpSim {
+	struct PtpSimConfig config;
+
+	// Host to camera: partial packet header, and the data phase being received
+	uint8_t hdr[SIM_HEADER_MAX];
+	int hdr_length;
+	int data_left;
+	int data_end;
+	int receiving;
+	uint8_t *in_data;
+	int in_data_length;
+	int in_data_size;
+
+	// Command waiting for its data phase, it runs on the next read
+	int pending;
+	// One of enum PtpConnType, from the last write
+	int framing;
+	uint16_t code;
+	uint32_t transaction;
+	uint32_t params[5];
+	int param_length;
+
+	// Data phase and response of the command being run
+	uint8_t *payload;
+	int payload_size;
+	int payload_length;
+	int has_data;
+	uint32_t resp_params[5];
+	int resp_param_length;
+
+	// Camera to host
+	struct SimSegment *head;
+	struct SimSegment *tail;
+	// Bytes read from the stream so far, for ip_segment
+	uint64_t stream_read;
+
+	// Artificial delay owed, slept off in whole milliseconds
+	uint64_t owed_ns;
+
+	// Device state
+	int session;
+	int avail_changed;
+	int event_cursor;
+	uint32_t lv_frame;
+	// When the next frame is due with lv_fps, in nanoseconds
+	uint64_t lv_next;
+	struct SimProp props[8];
+	int props_length;
+};
+
+static const struct SimProp default_props[] = {
+	{PTP_PC_BatteryLevel, PTP_TC_UINT8, 50, 50, 0, 100, 1, 0, 0},
+	{PTP_PC_ImageSize, PTP_TC_STRING, 0, 0, 0, 0, 0, 0, 0},
+	{PTP_PC_EOS_Aperture, PTP_TC_UINT32, 0x30, 0x30, 0, 0xff, 1, 1, 1},
+	{PTP_PC_EOS_ShutterSpeed, PTP_TC_UINT32, 0x68, 0x68, 0, 0xff, 1, 1, 1},
+	{PTP_PC_EOS_ISOSpeed, PTP_TC_UINT32, 0x48, 0x48, 0, 0xff, 1, 1, 1},
+	{PTP_PC_EOS_BatteryPower, PTP_TC_UINT32, 2, 2, 0, 3, 1, 1, 1},
+	{PTP_PC_EOS_CaptureDestination, PTP_TC_UINT32, 2, 2, 0, 4, 1, 1, 1},
+	{PTP_PC_EOS_VF_Output, PTP_TC_UINT32, 0, 0, 0, 3, 1, 1, 1},
+};
+
+static char sim_image_size[] = "640x480";
+
+static const uint32_t avail_aperture[] = {0x20, 0x23, 0x28, 0x2b, 0x30, 0x35, 0x38, 0x40};
+static const uint32_t avail_shutter[] = {0x48, 0x50, 0x58, 0x60, 0x68, 0x70, 0x78, 0x80};
+static const uint32_t avail_iso[] = {0x48, 0x50, 0x58, 0x60, 0x68};
+
+static const uint16_t sim_ops[] = {
+	PTP_OC_GetDeviceInfo, PTP_OC_OpenSession, PTP_OC_CloseSession,
+	PTP_OC_GetStorageIDs, PTP_OC_GetStorageInfo, PTP_OC_GetNumObjects,
+	PTP_OC_GetObjectHandles, PTP_OC_GetObjectInfo, PTP_OC_GetObject,
+	PTP_OC_GetPartialObject, PTP_OC_GetDevicePropDesc, PTP_OC_GetDevicePropValue,
+	PTP_OC_SetDevicePropValue,
+	PTP_OC_EOS_GetStorageIDs, PTP_OC_EOS_SetDevicePropValueEx, PTP_OC_EOS_SetRemoteMode,
+	PTP_OC_EOS_SetEventMode, PTP_OC_EOS_GetEvent, PTP_OC_EOS_KeepDeviceOn,
+	PTP_OC_EOS_GetViewFinderData, PTP_OC_EOS_RemoteReleaseOn, PTP_OC_EOS_RemoteReleaseOff,
+	PTP_OC_EOS_PCHDDCapacity, PTP_OC_EOS_SetUILock, PTP_OC_EOS_ResetUILock,
+	PTP_OC_EOS_ExecuteEventProc, PTP_OC_EOS_GetEventProcReturnData,
+};
+
+static const uint16_t sim_events[] = {
+	PTP_EC_EOS_PropValueChanged, PTP_EC_EOS_AvailListChanged,
+};
+
+static struct PtpSimConfig sim_config;
+static int sim_config_set = 0;
+
+void ptpsim_default_config(struct PtpSimConfig *c) {
+	memset(c, 0, sizeof(struct PtpSimConfig));
+	c->max_packet_size = 512;
+	c->num_objects = 4;
+	c->object_size = 1024 * 1024;
+	c->lv_frame_size = 100000;
+}
+
+void ptpsim_set_config(const struct PtpSimConfig *c) {
+	memcpy(&sim_config, c, sizeof(struct PtpSimConfig));
+	sim_config_set = 1;
+}
+
+static void sim_delay(struct PtpSim *b, uint64_t ns) {
+	b->owed_ns += ns;
+	if (b->owed_ns < 1000000) return;
+
+	struct timespec ts;
+	ts.tv_sec = b->owed_ns / 1000000000;
+	ts.tv_nsec = b->owed_ns % 1000000000;
+	nanosleep(&ts, NULL);
+	b->owed_ns = 0;
+}
+
+static void sim_transfer_delay(struct PtpSim *b, int bytes) {
+	if (b->config.bandwidth <= 0 || bytes <= 0) return;
+	sim_delay(b, (uint64_t)bytes * 1000000000 / (uint64_t)b->config.bandwidth);
+}
+
+static void sim_reset_device(struct PtpSim *b) {
+	b->session = 0;
+	b->avail_changed = 1;
+	b->event_cursor = 0;
+	b->lv_frame = 0;
+	b->props_length = sizeof(default_props) / sizeof(default_props[0]);
+	memcpy(b->props, default_props, sizeof(default_props));
+}
+
+struct PtpSim *ptpsim_new(const struct PtpSimConfig *c) {
+	struct PtpSim *b = calloc(1, sizeof(struct PtpSim));
+	if (b == NULL) return NULL;
+
+	if (c != NULL) {
+		memcpy(&b->config, c, sizeof(struct PtpSimConfig));
+	} else if (sim_config_set) {
+		memcpy(&b->config, &sim_config, sizeof(struct PtpSimConfig));
+	} else {
+		ptpsim_default_config(&b->config);
+	}
+	if (b->config.max_packet_size <= 0) b->config.max_packet_size = 512;
+
+	sim_reset_device(b);
+	return b;
+}
+
+int ptpsim_max_packet_size(struct PtpSim *b) {
+	return b->config.max_packet_size;
+}
+
+void ptpsim_free(struct PtpSim *b) {
+	if (b == NULL) return;
+
+	while (b->head != NULL) {
+		struct SimSegment *next = b->head->next;
+		free(b->head->alloc);
+		free(b->head);
+		b->head = next;
+	}
+
+	free(b->in_data);
+	free(b->payload);
+	free(b);
+}
+
+static int sim_push(struct PtpSim *b, uint8_t *data, int length, void *alloc) {
+	struct SimSegment *s = malloc(sizeof(struct SimSegment));
+	if (s == NULL) {
+		free(alloc);
+		return PTP_OUT_OF_MEM;
+	}
+
+	s->next = NULL;
+	s->data = data;
+	s->length = length;
+	s->read = 0;
+	s->alloc = alloc;
+
+	if (b->tail == NULL) {
+		b->head = s;
+	} else {
+		b->tail->next = s;
+	}
+	b->tail = s;
+
+	return 0;
+}
+
+// Queue a small packet that owns a copy of its bytes
+static int sim_push_copy(struct PtpSim *b, const void *data, int length) {
+	uint8_t *copy = malloc(length);
+	if (copy == NULL) return PTP_OUT_OF_MEM;
+	memcpy(copy, data, length);
+	return sim_push(b, copy, length, copy);
+}
+
+// Space for the data phase of the current command, after SIM_HEADROOM
+static uint8_t *sim_payload(struct PtpSim *b, int size) {
+	if (b->payload == NULL || b->payload_size < SIM_HEADROOM + size) {
+		free(b->payload);
+		b->payload = malloc(SIM_HEADROOM + size);
+		if (b->payload == NULL) {
+			b->payload_size = 0;
+			return NULL;
+		}
+		b->payload_size = SIM_HEADROOM + size;
+	}
+
+	b->has_data = 1;
+	b->payload_length = size;
+	return b->payload + SIM_HEADROOM;
+}
+
+static int sim_in_data_reserve(struct PtpSim *b, int size) {
+	if (size <= b->in_data_size) return 0;
+	uint8_t *d = realloc(b->in_data, size);
+	if (d == NULL) return PTP_OUT_OF_MEM;
+	b->in_data = d;
+	b->in_data_size = size;
+	return 0;
+}
+
+// Deterministic object contents, repeats every 256 bytes
+static void sim_object_fill(uint32_t handle, uint32_t offset, uint8_t *buf, int length) {
+	int first = length < 256 ? length : 256;
+	for (int i = 0; i < first; i++) {
+		buf[i] = (uint8_t)(handle + offset + i);
+	}
+
+	for (int done = first; done < length;) {
+		int n = done;
+		if (n > length - done) n = length - done;
+		memcpy(buf + done, buf, n);
+		done += n;
+	}
+}
+
+static int sim_object_size(struct PtpSim *b, uint32_t handle) {
+	if (handle == SIM_TEST_HANDLE) return SIM_TEST_SIZE;
+	if (handle >= 1 && handle <= (uint32_t)b->config.num_objects) return b->config.object_size;
+	return -1;
+}
+
+static struct SimProp *sim_find_prop(struct PtpSim *b, int code) {
+	for (int i = 0; i < b->props_length; i++) {
+		if (b->props[i].code == code) return &b->props[i];
+	}
+	return NULL;
+}
+
+static int sim_write_value(uint8_t *d, int type, uint32_t value) {
+	switch (type) {
+	case PTP_TC_INT8:
+	case PTP_TC_UINT8:
+		return ptp_write_u8(d, value);
+	case PTP_TC_INT16:
+	case PTP_TC_UINT16:
+		return ptp_write_u16(d, value);
+	default:
+		return ptp_write_u32(d, value);
+	}
+}
+
+static int sim_write_u16_array(uint8_t *d, const uint16_t *array, int length) {
+	int of = ptp_write_u32(d, length);
+	for (int i = 0; i < length; i++) {
+		of += ptp_write_u16(d + of, array[i]);
+	}
+	return of;
+}
+
+static int op_get_device_info(struct PtpSim *b) {
+	uint8_t *d = sim_payload(b, 2048);
+	if (d == NULL) return PTP_RC_GeneralError;
+
+	uint16_t props[8];
+	for (int i = 0; i < b->props_length; i++) props[i] = b->props[i].code;
+	uint16_t capture[] = {PTP_OF_JPEG};
+	uint16_t playback[] = {PTP_OF_JPEG, PTP_OF_PNG};
+
+	int of = 0;
+	of += ptp_write_u16(d + of, 100);
+	of += ptp_write_u32(d + of, 11);
+	of += ptp_write_u16(d + of, 100);
+	of += ptp_write_string(d + of, "G-V: 1.0;");
+	of += ptp_write_u16(d + of, 0);
+	of += sim_write_u16_array(d + of, sim_ops, sizeof(sim_ops) / sizeof(sim_ops[0]));
+	of += sim_write_u16_array(d + of, sim_events, sizeof(sim_events) / sizeof(sim_events[0]));
+	of += sim_write_u16_array(d + of, props, b->props_length);
+	of += sim_write_u16_array(d + of, capture, 1);
+	of += sim_write_u16_array(d + of, playback, 2);
+	of += ptp_write_string(d + of, "Canon Inc.");
+	of += ptp_write_string(d + of, "Canon EOS Rebel T6");
+	of += ptp_write_string(d + of, "3-1.1.0");
+	of += ptp_write_string(d + of, "sim0001");
+
+	b->payload_length = of;
+	return PTP_RC_OK;
+}
+
+static int op_get_storage_ids(struct PtpSim *b) {
+	uint8_t *d = sim_payload(b, 8);
+	if (d == NULL) return PTP_RC_GeneralError;
+	ptp_write_u32(d, 1);
+	ptp_write_u32(d + 4, SIM_STORAGE_ID);
+	return PTP_RC_OK;
+}
+
+static int op_get_storage_info(struct PtpSim *b) {
+	if (b->params[0] != SIM_STORAGE_ID) return PTP_RC_InvalidStorageId;
+
+	uint8_t *d = sim_payload(b, 64);
+	if (d == NULL) return PTP_RC_GeneralError;
+
+	uint64_t capacity = 32ULL * 1024 * 1024 * 1024;
+	int of = 0;
+	of += ptp_write_u16(d + of, 0x4); // removable RAM
+	of += ptp_write_u16(d + of, 0x2); // generic hierarchical
+	of += ptp_write_u16(d + of, 0x0);
+	memcpy(d + of, &capacity, 8); of += 8;
+	capacity /= 2;
+	memcpy(d + of, &capacity, 8); of += 8;
+	of += ptp_write_u32(d + of, 0xffffffff);
+	of += ptp_write_string(d + of, "SD");
+	of += ptp_write_string(d + of, "");
+
+	b->payload_length = of;
+	return PTP_RC_OK;
+}
+
+static int op_get_object_handles(struct PtpSim *b) {
+	int n = b->config.num_objects + 1;
+	uint8_t *d = sim_payload(b, 4 + 4 * n);
+	if (d == NULL) return PTP_RC_GeneralError;
+
+	int of = ptp_write_u32(d, n);
+	of += ptp_write_u32(d + of, SIM_TEST_HANDLE);
+	for (int i = 1; i < n; i++) {
+		of += ptp_write_u32(d + of, i);
+	}
+
+	return PTP_RC_OK;
+}
+
+static int op_get_object_info(struct PtpSim *b) {
+	uint32_t handle = b->params[0];
+	int size = sim_object_size(b, handle);
+	if (size < 0) return PTP_RC_InvalidObjectHandle;
+
+	struct PtpObjectInfo oi;
+	memset(&oi, 0, sizeof(oi));
+	oi.storage_id = SIM_STORAGE_ID;
+	oi.compressed_size = size;
+	if (handle == SIM_TEST_HANDLE) {
+		oi.obj_format = PTP_OF_PNG;
+		strcpy(oi.filename, "test.png");
+	} else {
+		oi.obj_format = PTP_OF_JPEG;
+		oi.img_width = 6000;
+		oi.img_height = 4000;
+		snprintf(oi.filename, sizeof(oi.filename), "IMG_%04u.JPG", handle);
+	}
+	strcpy(oi.date_created, "20240101T000000");
+
+	uint8_t *d = sim_payload(b, 1024);
+	if (d == NULL) return PTP_RC_GeneralError;
+	b->payload_length = ptp_pack_object_info(NULL, &oi, d, 1024);
+
+	return PTP_RC_OK;
+}
+
+static int op_get_object(struct PtpSim *b, uint32_t offset, uint32_t max) {
+	uint32_t handle = b->params[0];
+	int size = sim_object_size(b, handle);
+	if (size < 0) return PTP_RC_InvalidObjectHandle;
+
+	if (offset > (uint32_t)size) offset = size;
+	uint32_t length = size - offset;
+	if (length > max) length = max;
+
+	uint8_t *d = sim_payload(b, length);
+	if (d == NULL) return PTP_RC_GeneralError;
+	sim_object_fill(handle, offset, d, length);
+
+	b->resp_params[0] = length;
+	b->resp_param_length = 1;
+	return PTP_RC_OK;
+}
+
+static int op_get_prop_desc(struct PtpSim *b) {
+	struct SimProp *p = sim_find_prop(b, b->params[0]);
+	if (p == NULL) return PTP_RC_DevicePropNotSupported;
+
+	uint8_t *d = sim_payload(b, 128);
+	if (d == NULL) return PTP_RC_GeneralError;
+
+	int of = 0;
+	of += ptp_write_u16(d + of, p->code);
+	of += ptp_write_u16(d + of, p->type);
+	of += ptp_write_u8(d + of, 1);
+
+	if (p->type == PTP_TC_STRING) {
+		of += ptp_write_string(d + of, sim_image_size);
+		of += ptp_write_string(d + of, sim_image_size);
+		of += ptp_write_u8(d + of, PTP_EnumerationForm);
+		of += ptp_write_u16(d + of, 1);
+		of += ptp_write_string(d + of, sim_image_size);
+	} else {
+		of += sim_write_value(d + of, p->type, p->default_value);
+		of += sim_write_value(d + of, p->type, p->value);
+		of += ptp_write_u8(d + of, PTP_RangeForm);
+		of += sim_write_value(d + of, p->type, p->min);
+		of += sim_write_value(d + of, p->type, p->max);
+		of += sim_write_value(d + of, p->type, p->step);
+	}
+
+	b->payload_length = of;
+	return PTP_RC_OK;
+}
+
+static int op_get_prop_value(struct PtpSim *b) {
+	struct SimProp *p = sim_find_prop(b, b->params[0]);
+	if (p == NULL) return PTP_RC_DevicePropNotSupported;
+
+	uint8_t *d = sim_payload(b, 64);
+	if (d == NULL) return PTP_RC_GeneralError;
+
+	if (p->type == PTP_TC_STRING) {
+		b->payload_length = ptp_write_string(d, sim_image_size);
+	} else {
+		b->payload_length = sim_write_value(d, p->type, p->value);
+	}
+
+	return PTP_RC_OK;
+}
+
+static int op_set_prop_value(struct PtpSim *b) {
+	struct SimProp *p = sim_find_prop(b, b->params[0]);
+	if (p == NULL) return PTP_RC_DevicePropNotSupported;
+	if (p->type == PTP_TC_STRING) return PTP_RC_InvalidParameter;
+
+	uint32_t value = 0;
+	memcpy(&value, b->in_data, b->in_data_length < 4 ? b->in_data_length : 4);
+	p->value = value;
+	p->changed = 1;
+	return PTP_RC_OK;
+}
+
+// Data is {size (0xc), code, value}
+static int op_eos_set_prop_value(struct PtpSim *b) {
+	if (b->in_data_length < 12) return PTP_RC_InvalidParameter;
+
+	uint32_t code, value;
+	ptp_read_u32(b->in_data + 4, &code);
+	ptp_read_u32(b->in_data + 8, &value);
+
+	struct SimProp *p = sim_find_prop(b, code);
+	if (p == NULL) return PTP_RC_DevicePropNotSupported;
+
+	p->value = value;
+	p->changed = 1;
+	return PTP_RC_OK;
+}
+
+static int write_prop_event(uint8_t *d, struct SimProp *p) {
+	int of = 0;
+	of += ptp_write_u32(d + of, 16);
+	of += ptp_write_u32(d + of, PTP_EC_EOS_PropValueChanged);
+	of += ptp_write_u32(d + of, p->code);
+	of += ptp_write_u32(d + of, p->value);
+	return of;
+}
+
+static int write_avail_event(uint8_t *d, int code, const uint32_t *list, int length) {
+	int of = 0;
+	of += ptp_write_u32(d + of, 20 + 4 * length);
+	of += ptp_write_u32(d + of, PTP_EC_EOS_AvailListChanged);
+	of += ptp_write_u32(d + of, code);
+	of += ptp_write_u32(d + of, PTP_TC_UINT32);
+	of += ptp_write_u32(d + of, length);
+	for (int i = 0; i < length; i++) {
+		of += ptp_write_u32(d + of, list[i]);
+	}
+	return of;
+}
+
+// Changed props and avail lists, then events_per_poll extra prop reports, then the {8, 0} terminator
+static int op_eos_get_event(struct PtpSim *b) {
+	int max = 512 + 16 * b->props_length + 16 * b->config.events_per_poll;
+	uint8_t *d = sim_payload(b, max);
+	if (d == NULL) return PTP_RC_GeneralError;
+
+	int of = 0;
+	for (int i = 0; i < b->props_length; i++) {
+		struct SimProp *p = &b->props[i];
+		if (!p->eos || !p->changed) continue;
+		of += write_prop_event(d + of, p);
+		p->changed = 0;
+	}
+
+	if (b->avail_changed) {
+		of += write_avail_event(d + of, PTP_PC_EOS_Aperture, avail_aperture, sizeof(avail_aperture) / 4);
+		of += write_avail_event(d + of, PTP_PC_EOS_ShutterSpeed, avail_shutter, sizeof(avail_shutter) / 4);
+		of += write_avail_event(d + of, PTP_PC_EOS_ISOSpeed, avail_iso, sizeof(avail_iso) / 4);
+		b->avail_changed = 0;
+	}
+
+	for (int i = 0; i < b->config.events_per_poll; i++) {
+		struct SimProp *p;
+		do {
+			p = &b->props[b->event_cursor];
+			b->event_cursor = (b->event_cursor + 1) % b->props_length;
+		} while (!p->eos);
+		of += write_prop_event(d + of, p);
+	}
+
+	of += ptp_write_u32(d + of, 8);
+	of += ptp_write_u32(d + of, 0);
+
+	b->payload_length = of;
+	return PTP_RC_OK;
+}
+
+// Blocks of {length (including this header), type, data}: made up metadata on both sides of the
+// JPEG (type 1), so hosts can't get away with assuming the frame is first
+#define SIM_VF_META_TYPE 4
+#define SIM_VF_META_SIZE 16
+static int write_vf_meta(uint8_t *d, uint32_t frame) {
+	int of = 0;
+	of += ptp_write_u32(d + of, 8 + SIM_VF_META_SIZE);
+	of += ptp_write_u32(d + of, SIM_VF_META_TYPE);
+	for (int i = 0; i < SIM_VF_META_SIZE; i += 4) {
+		of += ptp_write_u32(d + of, frame);
+	}
+	return of;
+}
+
+static int op_eos_get_viewfinder(struct PtpSim *b) {
+	struct SimProp *vf = sim_find_prop(b, PTP_PC_EOS_VF_Output);
+	if (vf->value == 0) return PTP_RC_CANON_NotReady;
+
+	if (b->config.lv_fps > 0) {
+		struct timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		uint64_t now = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+		if (now < b->lv_next) return PTP_RC_CANON_NotReady;
+		uint64_t period = 1000000000 / b->config.lv_fps;
+		// Frames come off the sensor on a fixed clock, a late poll doesn't push the next one back
+		b->lv_next = (b->lv_next != 0 && now - b->lv_next < period) ? b->lv_next + period : now + period;
+	}
+
+	int size = b->config.lv_frame_size;
+	if (size < 4) size = 4;
+
+	uint8_t *d = sim_payload(b, 2 * (8 + SIM_VF_META_SIZE) + 8 + size);
+	if (d == NULL) return PTP_RC_GeneralError;
+
+	int of = write_vf_meta(d, b->lv_frame);
+	of += ptp_write_u32(d + of, 8 + size);
+	of += ptp_write_u32(d + of, 1);
+
+	uint8_t *jpeg = d + of;
+	sim_object_fill(b->lv_frame, 0, jpeg, size);
+	jpeg[0] = 0xff;
+	jpeg[1] = 0xd8;
+	jpeg[size - 2] = 0xff;
+	jpeg[size - 1] = 0xd9;
+	of += size;
+
+	of += write_vf_meta(d + of, b->lv_frame);
+
+	b->payload_length = of;
+	b->lv_frame++;
+	return PTP_RC_OK;
+}
+
+// Magic Lantern 360x240 RGB liveview
+static int op_ml_live(struct PtpSim *b) {
+	int size = 360 * 240 * 3;
+	uint8_t *d = sim_payload(b, size);
+	if (d == NULL) return PTP_RC_GeneralError;
+	sim_object_fill(b->lv_frame++, 0, d, size);
+	return PTP_RC_OK;
+}
+
+// Magic Lantern BMP overlay, 960x480 palette indexes and a YUV palette to go with them
+static int op_ml_bmp_lv(struct PtpSim *b) {
+	if (b->params[0] == PTP_ML_BMP_LV_GET_SPEC) {
+		struct PtpMlLvInfo *info = (struct PtpMlLvInfo *)sim_payload(b, sizeof(struct PtpMlLvInfo));
+		if (info == NULL) return PTP_RC_GeneralError;
+		info->lv_pitch = 960;
+		info->lv_width = 720;
+		for (int i = 0; i < 256; i++) {
+			info->lcd_palette[i] = ((uint32_t)i << 16) | ((uint32_t)(i * 7) << 8) | (uint8_t)(i * 13);
+		}
+		return PTP_RC_OK;
+	}
+
+	int size = 960 * 480;
+	uint8_t *d = sim_payload(b, size);
+	if (d == NULL) return PTP_RC_GeneralError;
+	sim_object_fill(b->lv_frame++, 0, d, size);
+	return PTP_RC_OK;
+}
+
+// Sum of the data phase must match param 0, same as vcam
+static int op_checksum(struct PtpSim *b) {
+	int checksum = 0;
+	for (int i = 0; i < b->in_data_length; i++) {
+		checksum += b->in_data[i];
+	}
+
+	if (checksum != (int)b->params[0]) {
+		ptp_log(PTP_LOG_WARN, PTP_LOG_SIM, "sim: bad checksum %d/%d\n", checksum, (int)b->params[0]);
+		return PTP_RC_GeneralError;
+	}
+
+	return PTP_RC_OK;
+}
+
+static int sim_dispatch(struct PtpSim *b) {
+	switch (b->code) {
+	case PTP_OC_GetDeviceInfo:
+		return op_get_device_info(b);
+	case PTP_OC_OpenSession:
+		b->session = b->params[0];
+		return PTP_RC_OK;
+	}
+
+	if (b->session == 0) return PTP_RC_SessionNotOpen;
+
+	switch (b->code) {
+	case PTP_OC_CloseSession:
+		b->session = 0;
+		return PTP_RC_OK;
+	case PTP_OC_GetStorageIDs:
+	case PTP_OC_EOS_GetStorageIDs:
+		return op_get_storage_ids(b);
+	case PTP_OC_GetStorageInfo:
+		return op_get_storage_info(b);
+	case PTP_OC_GetNumObjects:
+		b->resp_params[0] = b->config.num_objects + 1;
+		b->resp_param_length = 1;
+		return PTP_RC_OK;
+	case PTP_OC_GetObjectHandles:
+		return op_get_object_handles(b);
+	case PTP_OC_GetObjectInfo:
+		return op_get_object_info(b);
+	case PTP_OC_GetObject:
+		return op_get_object(b, 0, 0xffffffff);
+	case PTP_OC_GetPartialObject:
+		return op_get_object(b, b->params[1], b->params[2]);
+	case PTP_OC_GetDevicePropDesc:
+		return op_get_prop_desc(b);
+	case PTP_OC_GetDevicePropValue:
+		return op_get_prop_value(b);
+	case PTP_OC_SetDevicePropValue:
+		return op_set_prop_value(b);
+	case PTP_OC_EOS_SetDevicePropValueEx:
+		return op_eos_set_prop_value(b);
+	case PTP_OC_EOS_GetEvent:
+		return op_eos_get_event(b);
+	case PTP_OC_EOS_GetViewFinderData:
+		return op_eos_get_viewfinder(b);
+	case PTP_OC_EOS_SetRemoteMode:
+	case PTP_OC_EOS_SetEventMode:
+	case PTP_OC_EOS_KeepDeviceOn:
+	case PTP_OC_EOS_RemoteReleaseOn:
+	case PTP_OC_EOS_RemoteReleaseOff:
+	case PTP_OC_EOS_PCHDDCapacity:
+	case PTP_OC_EOS_SetUILock:
+	case PTP_OC_EOS_ResetUILock:
+	case PTP_OC_EOS_ExecuteEventProc:
+	case PTP_OC_EOS_GetEventProcReturnData:
+		return PTP_RC_OK;
+	// Answered, but not in GetDeviceInfo, so liveview still picks EOS
+	case PTP_OC_ML_Live360x240:
+		return op_ml_live(b);
+	case PTP_OC_ML_LiveBmpRam:
+		return op_ml_bmp_lv(b);
+	case 0xBEEF:
+		return op_checksum(b);
+	}
+
+	return PTP_RC_OperationNotSupported;
+}
+
+static int sim_respond_usb(struct PtpSim *b, int rc) {
+	if (b->has_data) {
+		int length = 12 + b->payload_length;
+		uint8_t *c = b->payload + SIM_HEADROOM - 12;
+		ptp_write_u32(c, length);
+		ptp_write_u16(c + 4, PTP_PACKET_TYPE_DATA);
+		ptp_write_u16(c + 6, b->code);
+		ptp_write_u32(c + 8, b->transaction);
+
+		int x = sim_push(b, c, length, b->payload);
+		b->payload = NULL;
+		if (x) return x;
+
+		// USB terminates data phases that end on a packet boundary with a zero length packet
+		if (b->framing == PTP_USB && length % b->config.max_packet_size == 0) {
+			x = sim_push(b, NULL, 0, NULL);
+			if (x) return x;
+		}
+	}
+
+	uint8_t resp[32];
+	int of = 0;
+	of += ptp_write_u32(resp + of, 12 + 4 * b->resp_param_length);
+	of += ptp_write_u16(resp + of, PTP_PACKET_TYPE_RESPONSE);
+	of += ptp_write_u16(resp + of, rc);
+	of += ptp_write_u32(resp + of, b->transaction);
+	for (int i = 0; i < b->resp_param_length; i++) {
+		of += ptp_write_u32(resp + of, b->resp_params[i]);
+	}
+
+	return sim_push_copy(b, resp, of);
+}
+
+static int sim_respond_ip(struct PtpSim *b, int rc) {
+	int x;
+	if (b->has_data) {
+		uint8_t start[20];
+		uint64_t total = b->payload_length;
+		ptp_write_u32(start, 20);
+		ptp_write_u32(start + 4, PTPIP_DATA_PACKET_START);
+		ptp_write_u32(start + 8, b->transaction);
+		memcpy(start + 12, &total, 8);
+		x = sim_push_copy(b, start, 20);
+		if (x) return x;
+
+		uint8_t *payload = b->payload;
+		b->payload = NULL;
+		uint8_t *d = payload + SIM_HEADROOM;
+		int left = b->payload_length;
+		int chunk = b->config.ip_data_chunk > 0 ? b->config.ip_data_chunk : left;
+
+		while (1) {
+			int size = left < chunk ? left : chunk;
+			int end = (size == left);
+
+			uint8_t h[12];
+			ptp_write_u32(h, 12 + size);
+			ptp_write_u32(h + 4, end ? PTPIP_DATA_PACKET_END : PTPIP_DATA_PACKET);
+			ptp_write_u32(h + 8, b->transaction);
+			x = sim_push_copy(b, h, 12);
+			if (x) { free(payload); return x; }
+
+			// The last piece frees the payload buffer
+			x = sim_push(b, d, size, end ? payload : NULL);
+			if (x) { if (!end) free(payload); return x; }
+
+			d += size;
+			left -= size;
+			if (end) break;
+		}
+	}
+
+	uint8_t resp[40];
+	int of = 0;
+	of += ptp_write_u32(resp + of, 14 + 4 * b->resp_param_length);
+	of += ptp_write_u32(resp + of, PTPIP_COMMAND_RESPONSE);
+	of += ptp_write_u16(resp + of, rc);
+	of += ptp_write_u32(resp + of, b->transaction);
+	for (int i = 0; i < b->resp_param_length; i++) {
+		of += ptp_write_u32(resp + of, b->resp_params[i]);
+	}
+
+	return sim_push_copy(b, resp, of);
+}
+
+static int sim_run_pending(struct PtpSim *b) {
+	b->pending = 0;
+	b->has_data = 0;
+	b->payload_length = 0;
+	b->resp_param_length = 0;
+
+	if (b->config.latency_us > 0) {
+		sim_delay(b, (uint64_t)b->config.latency_us * 1000);
+	}
+
+	int rc = sim_dispatch(b);
+	if (rc != PTP_RC_OK) b->has_data = 0;
+
+	ptp_log(PTP_LOG_TRACE, PTP_LOG_SIM, "sim: op 0x%X -> 0x%X, %d bytes in, %d bytes out\n", b->code, rc,
+		b->in_data_length, b->has_data ? b->payload_length : 0);
+
+	if (b->framing == PTP_IP) {
+		return sim_respond_ip(b, rc);
+	} else {
+		return sim_respond_usb(b, rc);
+	}
+}
+
+static int sim_command(struct PtpSim *b, int framing, uint16_t code, uint32_t transaction, const uint8_t *params, int param_length) {
+	// Previous command had no data phase
+	if (b->pending) {
+		int rc = sim_run_pending(b);
+		if (rc) return rc;
+	}
+
+	if (param_length > 5) param_length = 5;
+
+	b->pending = 1;
+	b->framing = framing;
+	b->code = code;
+	b->transaction = transaction;
+	b->param_length = param_length;
+	memset(b->params, 0, sizeof(b->params));
+	memcpy(b->params, params, param_length * 4);
+	b->in_data_length = 0;
+	return 0;
+}
+
+// Header is complete, act on it
+static int sim_handle_header(struct PtpSim *b, int framing) {
+	uint32_t length;
+	ptp_read_u32(b->hdr, &length);
+
+	if (framing == PTP_IP) {
+		uint32_t type;
+		ptp_read_u32(b->hdr + 4, &type);
+		switch (type) {
+		case PTPIP_INIT_COMMAND_REQ: {
+			uint8_t ack[36];
+			memset(ack, 0, sizeof(ack));
+			ptp_write_u32(ack, sizeof(ack));
+			ptp_write_u32(ack + 4, PTPIP_INIT_COMMAND_ACK);
+			ptp_write_u32(ack + 8, 1);
+			ptp_write_unicode_string((char *)ack + 28, "sim");
+			return sim_push_copy(b, ack, sizeof(ack));
+			}
+		case PTPIP_COMMAND_REQUEST: {
+			uint32_t data_phase;
+			uint16_t code;
+			uint32_t transaction;
+			ptp_read_u32(b->hdr + 8, &data_phase);
+			ptp_read_u16(b->hdr + 12, &code);
+			ptp_read_u32(b->hdr + 14, &transaction);
+			int rc = sim_command(b, framing, code, transaction, b->hdr + 18, ((int)length - 18) / 4);
+			// Hold the command until the data phase it announced is in
+			if (data_phase == 2) b->receiving = 1;
+			return rc;
+			}
+		case PTPIP_DATA_PACKET_START: {
+			uint64_t total;
+			memcpy(&total, b->hdr + 12, 8);
+			if (total > 0x7fffffff) return PTP_IO_ERR;
+			b->receiving = 1;
+			b->in_data_length = 0;
+			return sim_in_data_reserve(b, (int)total);
+			}
+		case PTPIP_DATA_PACKET:
+		case PTPIP_DATA_PACKET_END:
+			b->receiving = 1;
+			b->data_end = (type == PTPIP_DATA_PACKET_END);
+			b->data_left = length - 12;
+			if (b->data_left == 0 && b->data_end) b->receiving = 0;
+			return sim_in_data_reserve(b, b->in_data_length + b->data_left);
+		}
+
+		ptp_log(PTP_LOG_ERR, PTP_LOG_SIM, "sim: unhandled PTP/IP packet type %X\n", type);
+		return 0;
+	}
+
+	uint16_t type, code;
+	uint32_t transaction;
+	ptp_read_u16(b->hdr + 4, &type);
+	ptp_read_u16(b->hdr + 6, &code);
+	ptp_read_u32(b->hdr + 8, &transaction);
+
+	if (type == PTP_PACKET_TYPE_COMMAND) {
+		return sim_command(b, framing, code, transaction, b->hdr + 12, ((int)length - 12) / 4);
+	} else if (type == PTP_PACKET_TYPE_DATA) {
+		b->receiving = 1;
+		b->data_end = 1;
+		b->in_data_length = 0;
+		b->data_left = length - 12;
+		if (b->data_left == 0) b->receiving = 0;
+		return sim_in_data_reserve(b, b->data_left);
+	}
+
+	ptp_log(PTP_LOG_ERR, PTP_LOG_SIM, "sim: unhandled container type %X\n", type);
+	return 0;
+}
+
+// Bytes needed for the header of the packet being collected in b->hdr
+static int sim_header_need(struct PtpSim *b, int framing) {
+	if (b->hdr_length < 8) return 8;
+
+	uint32_t length;
+	ptp_read_u32(b->hdr, &length);
+
+	int data;
+	if (framing == PTP_IP) {
+		uint32_t type;
+		ptp_read_u32(b->hdr + 4, &type);
+		data = (type == PTPIP_DATA_PACKET || type == PTPIP_DATA_PACKET_END);
+	} else {
+		uint16_t type;
+		ptp_read_u16(b->hdr + 4, &type);
+		data = (type == PTP_PACKET_TYPE_DATA);
+	}
+
+	if (length < 8) return PTP_IO_ERR;
+	if (data) return length < 12 ? PTP_IO_ERR : 12;
+	if (length > SIM_HEADER_MAX) return PTP_IO_ERR;
+	return length;
+}
+
+// Host to camera bytes, in whatever pieces the transport writes them
+static int sim_feed(struct PtpSim *b, int framing, const uint8_t *d, int length) {
+	while (length > 0) {
+		if (b->data_left) {
+			int n = length < b->data_left ? length : b->data_left;
+			memcpy(b->in_data + b->in_data_length, d, n);
+			b->in_data_length += n;
+			b->data_left -= n;
+			d += n;
+			length -= n;
+			if (b->data_left == 0 && b->data_end) b->receiving = 0;
+			continue;
+		}
+
+		int need = sim_header_need(b, framing);
+		if (need < 0) {
+			ptp_log(PTP_LOG_ERR, PTP_LOG_SIM, "sim: bad packet from host\n");
+			return need;
+		}
+
+		int n = need - b->hdr_length;
+		if (n > length) n = length;
+		memcpy(b->hdr + b->hdr_length, d, n);
+		b->hdr_length += n;
+		d += n;
+		length -= n;
+
+		// Header might need more than the first 8 bytes told us about
+		need = sim_header_need(b, framing);
+		if (need < 0) return need;
+		if (b->hdr_length < need) continue;
+
+		b->hdr_length = 0;
+		int rc = sim_handle_header(b, framing);
+		if (rc) return rc;
+	}
+
+	return 0;
+}
+
+int ptpsim_write(struct PtpSim *b, int framing, const void *data, int length) {
+	b->framing = framing;
+	if (sim_feed(b, framing, data, length)) return PTP_IO_ERR;
+	sim_transfer_delay(b, length);
+	return length;
+}
+
+// USB reads return one transfer at most, stream reads take as much as is queued
+int ptpsim_read(struct PtpSim *b, void *to, int length) {
+	int stream = (b->framing != PTP_USB);
+
+	if (b->pending && !b->receiving) {
+		if (sim_run_pending(b)) return PTP_IO_ERR;
+	}
+
+	if (stream && b->config.max_read > 0 && length > b->config.max_read) {
+		length = b->config.max_read;
+	}
+
+	if (stream && b->config.ip_segment > 0) {
+		int left = b->config.ip_segment - (int)(b->stream_read % b->config.ip_segment);
+		if (length > left) length = left;
+	}
+
+	int read = 0;
+	while (b->head != NULL && read < length) {
+		struct SimSegment *s = b->head;
+		int n = s->length - s->read;
+		if (n > length - read) n = length - read;
+		memcpy((uint8_t *)to + read, s->data + s->read, n);
+		s->read += n;
+		read += n;
+
+		if (s->read == s->length) {
+			b->head = s->next;
+			if (b->head == NULL) b->tail = NULL;
+			free(s->alloc);
+			free(s);
+			if (!stream) break;
+		}
+	}
+
+	if (stream) b->stream_read += read;
+	sim_transfer_delay(b, read);
+	return read;
+}
@@ -0,0 +1,168 @@
+// Comm backend for the simulated camera (sim.c), link it instead of libusb.c and ip.c
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <camlib.h>
+#include <ptp.h>
+
+struct SimBackend {
+	struct PtpSim *sim;
+	// Only the event channel handshake is emulated
+	uint8_t ev_out[8];
+	int ev_out_length;
+};
+
+static struct SimBackend *sim_init(struct PtpRuntime *r) {
+	if (r->comm_backend == NULL) {
+		struct SimBackend *b = calloc(1, sizeof(struct SimBackend));
+		if (b == NULL) return NULL;
+		b->sim = ptpsim_new(NULL);
+		if (b->sim == NULL) {
+			free(b);
+			return NULL;
+		}
+		r->comm_backend = b;
+	}
+
+	return (struct SimBackend *)r->comm_backend;
+}
+
+static void sim_free(struct PtpRuntime *r) {
+	struct SimBackend *b = (struct SimBackend *)r->comm_backend;
+	if (b == NULL) return;
+	ptpsim_free(b->sim);
+	free(b);
+	r->comm_backend = NULL;
+}
+
+static int sim_write(struct PtpRuntime *r, int framing, void *data, int length) {
+	struct SimBackend *b = (struct SimBackend *)r->comm_backend;
+	if (b == NULL || r->io_kill_switch) return -1;
+	return ptpsim_write(b->sim, framing, data, length);
+}
+
+static int sim_read(struct PtpRuntime *r, void *to, int length) {
+	struct SimBackend *b = (struct SimBackend *)r->comm_backend;
+	if (b == NULL || r->io_kill_switch) return -1;
+	return ptpsim_read(b->sim, to, length);
+}
+
+int ptp_comm_init(struct PtpRuntime *r) {
+	struct SimBackend *b = sim_init(r);
+	if (b == NULL) return PTP_OUT_OF_MEM;
+	r->max_packet_size = ptpsim_max_packet_size(b->sim);
+	return 0;
+}
+
+struct PtpDeviceEntry *ptpusb_device_list(struct PtpRuntime *r) {
+	struct PtpDeviceEntry *e = calloc(1, sizeof(struct PtpDeviceEntry));
+	if (e == NULL) return NULL;
+
+	e->vendor_id = 0x04a9;
+	e->product_id = 0x32d9;
+	e->endpoint_in = 0x81;
+	e->endpoint_out = 0x2;
+	e->endpoint_int = 0x83;
+	strcpy(e->name, "EOS Rebel T6");
+	strcpy(e->manufacturer, "Canon Inc.");
+
+	return e;
+}
+
+int ptp_device_open(struct PtpRuntime *r, struct PtpDeviceEntry *entry) {
+	if (ptp_comm_init(r)) return PTP_OPEN_FAIL;
+	r->io_kill_switch = 0;
+	return 0;
+}
+
+int ptp_device_init(struct PtpRuntime *r) {
+	return ptp_device_open(r, NULL);
+}
+
+int ptp_device_close(struct PtpRuntime *r) {
+	r->io_kill_switch = 1;
+	sim_free(r);
+	return 0;
+}
+
+int ptp_device_reset(struct PtpRuntime *r) {
+	return 0;
+}
+
+int ptp_cmd_write(struct PtpRuntime *r, void *to, int length) {
+	return sim_write(r, PTP_USB, to, length);
+}
+
+int ptp_cmd_read(struct PtpRuntime *r, void *to, int length) {
+	return sim_read(r, to, length);
+}
+
+// No interrupt events, EOS events are polled with GetEvent
+int ptp_read_int(struct PtpRuntime *r, void *to, int length) {
+	return 0;
+}
+
+int ptpip_connect(struct PtpRuntime *r, const char *addr, int port) {
+	if (sim_init(r) == NULL) return PTP_OUT_OF_MEM;
+	r->io_kill_switch = 0;
+	return 0;
+}
+
+int ptpip_connect_events(struct PtpRuntime *r, const char *addr, int port) {
+	if (sim_init(r) == NULL) return PTP_OUT_OF_MEM;
+	return 0;
+}
+
+int ptpip_close(struct PtpRuntime *r) {
+	sim_free(r);
+	return 0;
+}
+
+int ptpip_cmd_write(struct PtpRuntime *r, void *data, int size) {
+	return sim_write(r, r->connection_type == PTP_IP_USB ? PTP_IP_USB : PTP_IP, data, size);
+}
+
+int ptpip_cmd_read(struct PtpRuntime *r, void *data, int size) {
+	return sim_read(r, data, size);
+}
+
+int ptpip_cmd_writev(struct PtpRuntime *r, void *header, int header_length, void *payload, int payload_length) {
+	if (ptpip_cmd_write(r, header, header_length) != header_length) return PTP_IO_ERR;
+	if (payload_length == 0) return header_length;
+	if (ptpip_cmd_write(r, payload, payload_length) != payload_length) return PTP_IO_ERR;
+	return header_length + payload_length;
+}
+
+// No file descriptor to move data through, callers fall back to normal reads and writes
+int ptpip_cmd_sendfile(struct PtpRuntime *r, int fd, int size) {
+	return PTP_UNSUPPORTED;
+}
+
+int ptpip_cmd_splice(struct PtpRuntime *r, int fd, int size) {
+	return PTP_UNSUPPORTED;
+}
+
+int ptpip_event_send(struct PtpRuntime *r, void *data, int size) {
+	struct SimBackend *b = (struct SimBackend *)r->comm_backend;
+	if (b == NULL) return -1;
+
+	if (size >= 8 && ((struct PtpIpHeader *)data)->type == PTPIP_INIT_EVENT_REQ) {
+		ptp_write_u32(b->ev_out, 8);
+		ptp_write_u32(b->ev_out + 4, PTPIP_INIT_EVENT_ACK);
+		b->ev_out_length = 8;
+	}
+
+	return size;
+}
+
+int ptpip_event_read(struct PtpRuntime *r, void *data, int size) {
+	struct SimBackend *b = (struct SimBackend *)r->comm_backend;
+	if (b == NULL) return -1;
+
+	int n = b->ev_out_length < size ? b->ev_out_length : size;
+	memcpy(data, b->ev_out, n);
+	memmove(b->ev_out, b->ev_out + n, b->ev_out_length - n);
+	b->ev_out_length -= n;
+	return n;
+}
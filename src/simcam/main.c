@@ -0,0 +1,216 @@
+// Loopback PTP/IP camera, serves the simulator (sim.c) on both channels of a real socket
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <camlib.h>
+#include <ptp.h>
+
+static struct PtpSimConfig config;
+
+// Milliseconds between PTP/IP events on the event channel, 0 for none
+static int event_interval = 0;
+
+// Exit once the first command connection closes
+static int once = 0;
+
+static int write_all(int fd, const uint8_t *data, int length) {
+	while (length > 0) {
+		int rc = write(fd, data, length);
+		if (rc <= 0) return -1;
+		data += rc;
+		length -= rc;
+	}
+
+	return 0;
+}
+
+static int read_all(int fd, uint8_t *data, int length) {
+	while (length > 0) {
+		int rc = read(fd, data, length);
+		if (rc <= 0) return -1;
+		data += rc;
+		length -= rc;
+	}
+
+	return 0;
+}
+
+static void serve_commands(int fd) {
+	struct PtpSim *sim = ptpsim_new(&config);
+	if (sim == NULL) return;
+
+	int size = 256 * 1024;
+	uint8_t *buffer = malloc(size);
+	if (buffer == NULL) goto end;
+
+	while (1) {
+		int rc = read(fd, buffer, size);
+		if (rc <= 0) break;
+
+		if (ptpsim_write(sim, PTP_IP, buffer, rc) < 0) {
+			printf("simcam: bad packet from client\n");
+			break;
+		}
+
+		// Send back whatever the camera has ready, nothing if it is still waiting on a data phase
+		while ((rc = ptpsim_read(sim, buffer, size)) > 0) {
+			if (write_all(fd, buffer, rc)) goto end;
+		}
+		if (rc < 0) break;
+	}
+
+	end:;
+	free(buffer);
+	ptpsim_free(sim);
+}
+
+static void serve_events(int fd) {
+	struct PtpIpHeader h;
+	if (read_all(fd, (uint8_t *)&h, 8)) return;
+	if (h.length < 8 || h.length > 256) return;
+
+	uint8_t rest[256];
+	if (read_all(fd, rest, h.length - 8)) return;
+
+	uint8_t ack[8];
+	ptp_write_u32(ack, 8);
+	ptp_write_u32(ack + 4, PTPIP_INIT_EVENT_ACK);
+	if (write_all(fd, ack, sizeof(ack))) return;
+
+	uint32_t transaction = 0;
+	while (1) {
+		struct pollfd p = {fd, POLLIN, 0};
+		int rc = poll(&p, 1, event_interval ? event_interval : -1);
+		if (rc < 0) return;
+		if (rc > 0) {
+			// Nothing is expected from the client, drain it and notice when it hangs up
+			if (read(fd, rest, sizeof(rest)) <= 0) return;
+			continue;
+		}
+
+		uint8_t ev[18];
+		int of = 0;
+		of += ptp_write_u32(ev + of, sizeof(ev));
+		of += ptp_write_u32(ev + of, PTPIP_EVENT);
+		of += ptp_write_u16(ev + of, PTP_EC_DevicePropChanged);
+		of += ptp_write_u32(ev + of, transaction++);
+		of += ptp_write_u32(ev + of, PTP_PC_BatteryLevel);
+		if (write_all(fd, ev, of)) return;
+	}
+}
+
+static void *connection(void *arg) {
+	int fd = (int)(intptr_t)arg;
+
+	// The first packet tells which channel this is
+	struct PtpIpHeader h;
+	int rc = recv(fd, &h, 8, MSG_PEEK | MSG_WAITALL);
+	if (rc == 8 && h.type == PTPIP_INIT_EVENT_REQ) {
+		serve_events(fd);
+		close(fd);
+	} else if (rc == 8) {
+		serve_commands(fd);
+		close(fd);
+		if (once) exit(0);
+	} else {
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static int usage(void) {
+	puts(
+		"Usage:\n"
+		"simcam [options]\n"
+		"  -p <port>       Listen on 127.0.0.1:port (15740)\n"
+		"  -n <count>      Number of objects (4)\n"
+		"  -s <bytes>      Object size (1048576)\n"
+		"  -f <bytes>      Liveview frame size (100000)\n"
+		"  -e <count>      Extra EOS events per GetEvent (0)\n"
+		"  -i <ms>         Event channel packet interval, 0 for none (0)\n"
+		"  -l <us>         Latency added to every transaction (0)\n"
+		"  -b <bytes/s>    Bandwidth limit, 0 for none (0)\n"
+		"  -c <bytes>      Split data phases into DATA packets of this size (0)\n"
+		"  -1              Exit when the first client disconnects");
+	return 1;
+}
+
+int main(int argc, char *argv[]) {
+	ptpsim_default_config(&config);
+	int port = 15740;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-1")) {
+			once = 1;
+			continue;
+		}
+
+		if (argv[i][0] != '-' || i + 1 >= argc) return usage();
+		int value = atoi(argv[i + 1]);
+		switch (argv[i][1]) {
+		case 'p': port = value; break;
+		case 'n': config.num_objects = value; break;
+		case 's': config.object_size = value; break;
+		case 'f': config.lv_frame_size = value; break;
+		case 'e': config.events_per_poll = value; break;
+		case 'i': event_interval = value; break;
+		case 'l': config.latency_us = value; break;
+		case 'b': config.bandwidth = value; break;
+		case 'c': config.ip_data_chunk = value; break;
+		default: return usage();
+		}
+		i++;
+	}
+
+	int sockfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (sockfd < 0) {
+		perror("socket");
+		return 1;
+	}
+
+	int yes = 1;
+	setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) || listen(sockfd, 8)) {
+		perror("bind");
+		return 1;
+	}
+
+	printf("simcam: listening on 127.0.0.1:%d\n", port);
+	fflush(stdout);
+
+	while (1) {
+		int fd = accept(sockfd, NULL, NULL);
+		if (fd < 0) {
+			perror("accept");
+			continue;
+		}
+
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, connection, (void *)(intptr_t)fd)) {
+			close(fd);
+			continue;
+		}
+		pthread_detach(thread);
+	}
+
+	return 0;
+}
@@ -0,0 +1,179 @@
+// Per opcode transaction counters and latency histograms
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <camlib.h>
+
+static uint64_t now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int ptp_stats_enable(struct PtpRuntime *r) {
+	ptp_mutex_lock(r);
+	if (r->stats == NULL) {
+		r->stats = calloc(1, sizeof(struct PtpStats));
+	}
+	ptp_mutex_unlock(r);
+
+	if (r->stats == NULL) return PTP_OUT_OF_MEM;
+	return 0;
+}
+
+void ptp_stats_disable(struct PtpRuntime *r) {
+	ptp_mutex_lock(r);
+	free(r->stats);
+	r->stats = NULL;
+	ptp_mutex_unlock(r);
+}
+
+void ptp_stats_reset(struct PtpRuntime *r) {
+	ptp_mutex_lock(r);
+	if (r->stats != NULL) {
+		memset(r->stats, 0, sizeof(struct PtpStats));
+	}
+	ptp_mutex_unlock(r);
+}
+
+static struct PtpOpStats *find_op(struct PtpStats *s, int code) {
+	for (int i = 0; i < s->ops_length; i++) {
+		if (s->ops[i].code == code) return &s->ops[i];
+	}
+
+	if (s->ops_length >= PTP_STATS_MAX_OPS) return NULL;
+
+	struct PtpOpStats *op = &s->ops[s->ops_length++];
+	op->code = code;
+	return op;
+}
+
+int ptp_stats_op(struct PtpRuntime *r, int code, struct PtpOpStats *out) {
+	int rc = -1;
+	ptp_mutex_lock(r);
+	if (r->stats != NULL) {
+		for (int i = 0; i < r->stats->ops_length; i++) {
+			if (r->stats->ops[i].code != code) continue;
+			memcpy(out, &r->stats->ops[i], sizeof(struct PtpOpStats));
+			rc = 0;
+			break;
+		}
+	}
+	ptp_mutex_unlock(r);
+	return rc;
+}
+
+void ptp_stats_begin(struct PtpRuntime *r) {
+	struct PtpStats *s = r->stats;
+	if (s == NULL) return;
+	s->start = now_us();
+	s->sent = 0;
+	s->data_done = 0;
+	s->data_in = 0;
+	s->data_out = 0;
+}
+
+void ptp_stats_sent(struct PtpRuntime *r, int bytes_out) {
+	struct PtpStats *s = r->stats;
+	if (s == NULL) return;
+	s->sent = now_us();
+	s->bytes_out += bytes_out;
+	s->data_out += bytes_out;
+}
+
+void ptp_stats_data_done(struct PtpRuntime *r, int bytes_in) {
+	struct PtpStats *s = r->stats;
+	if (s == NULL) return;
+	s->data_done = now_us();
+	s->bytes_in += bytes_in;
+	s->data_in += bytes_in;
+}
+
+void ptp_stats_retry(struct PtpRuntime *r) {
+	if (r->stats == NULL) return;
+	r->stats->retries++;
+}
+
+void ptp_stats_end(struct PtpRuntime *r, int code, int rc) {
+	struct PtpStats *s = r->stats;
+	if (s == NULL) return;
+
+	uint64_t end = now_us();
+	uint64_t sent = s->sent ? s->sent : end;
+	uint64_t data_done = s->data_done ? s->data_done : sent;
+
+	s->transactions++;
+
+	struct PtpOpStats *op = find_op(s, code);
+	if (op == NULL) return;
+
+	op->count++;
+	if (rc == PTP_CHECK_CODE) {
+		op->bad_responses++;
+	} else if (rc != 0 && rc != PTP_CANCELED) {
+		op->errors++;
+	}
+
+	op->bytes_in += s->data_in;
+	op->bytes_out += s->data_out;
+
+	op->send_us += sent - s->start;
+	op->data_us += data_done - sent;
+	op->response_us += end - data_done;
+
+	uint64_t total = end - s->start;
+	if (total > op->max_us) op->max_us = total;
+
+	int bucket = 0;
+	while (bucket < PTP_STATS_BUCKETS - 1 && total >= (1ULL << bucket)) bucket++;
+	op->histogram[bucket]++;
+}
+
+int ptp_stats_json(struct PtpRuntime *r, char *buffer, int max) {
+	if (max <= 0) return 0;
+
+	ptp_mutex_lock(r);
+
+	struct PtpStats *s = r->stats;
+	if (s == NULL) {
+		ptp_mutex_unlock(r);
+		return osnprintf(buffer, 0, max, "{}");
+	}
+
+	struct PtpBufferStats *b = &r->buffer_stats;
+
+	int curr = osnprintf(buffer, 0, max, "{\n");
+	curr += osnprintf(buffer, curr, max, "\"transactions\": %u,\n", s->transactions);
+	curr += osnprintf(buffer, curr, max, "\"bytesIn\": %llu,\n", (unsigned long long)s->bytes_in);
+	curr += osnprintf(buffer, curr, max, "\"bytesOut\": %llu,\n", (unsigned long long)s->bytes_out);
+	curr += osnprintf(buffer, curr, max, "\"retries\": %u,\n", s->retries);
+	curr += osnprintf(buffer, curr, max, "\"buffer\": {\"reallocs\": %d, \"shrinks\": %d, \"peakSize\": %zu, \"currentSize\": %zu},\n",
+		b->reallocs, b->shrinks, b->peak_size, b->current_size);
+	curr += osnprintf(buffer, curr, max, "\"ops\": [");
+
+	for (int i = 0; i < s->ops_length; i++) {
+		struct PtpOpStats *op = &s->ops[i];
+		const char *name = ptp_get_enum(PTP_OC, ptp_device_type(r), op->code);
+
+		curr += osnprintf(buffer, curr, max, "%s\n{\"code\": %d, \"name\": \"%s\", ", i ? "," : "", op->code, name);
+		curr += osnprintf(buffer, curr, max, "\"count\": %u, \"errors\": %u, \"badResponses\": %u, ",
+			op->count, op->errors, op->bad_responses);
+		curr += osnprintf(buffer, curr, max, "\"bytesIn\": %llu, \"bytesOut\": %llu, ",
+			(unsigned long long)op->bytes_in, (unsigned long long)op->bytes_out);
+		curr += osnprintf(buffer, curr, max, "\"sendUs\": %llu, \"dataUs\": %llu, \"responseUs\": %llu, \"maxUs\": %llu, ",
+			(unsigned long long)op->send_us, (unsigned long long)op->data_us,
+			(unsigned long long)op->response_us, (unsigned long long)op->max_us);
+		curr += osnprintf(buffer, curr, max, "\"histogram\": [");
+		for (int j = 0; j < PTP_STATS_BUCKETS; j++) {
+			curr += osnprintf(buffer, curr, max, "%s%u", j ? ", " : "", op->histogram[j]);
+		}
+		curr += osnprintf(buffer, curr, max, "]}");
+	}
+
+	curr += osnprintf(buffer, curr, max, "\n]\n}");
+
+	ptp_mutex_unlock(r);
+	return curr;
+}
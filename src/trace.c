@@ -0,0 +1,101 @@
+// Binary trace of everything going through the comm backend, see replay_backend.c
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <camlib.h>
+
+struct PtpTrace {
+	FILE *f;
+	uint64_t last;
+	int failed;
+};
+
+static uint64_t now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int ptp_trace_start(struct PtpRuntime *r, const char *path) {
+	if (r->trace != NULL) return PTP_RUNTIME_ERR;
+
+	struct PtpTrace *t = calloc(1, sizeof(struct PtpTrace));
+	if (t == NULL) return PTP_OUT_OF_MEM;
+
+	t->f = fopen(path, "wb");
+	if (t->f == NULL) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_CORE, "Failed to open trace %s\n", path);
+		free(t);
+		return PTP_RUNTIME_ERR;
+	}
+
+	// Records are small and frequent, let stdio batch them
+	setvbuf(t->f, NULL, _IOFBF, 256 * 1024);
+
+	uint8_t h[PTP_TRACE_HEADER_SIZE];
+	int of = 0;
+	of += ptp_write_u32(h + of, PTP_TRACE_MAGIC);
+	of += ptp_write_u16(h + of, PTP_TRACE_VERSION);
+	of += ptp_write_u16(h + of, r->connection_type);
+	of += ptp_write_u32(h + of, r->max_packet_size);
+	of += ptp_write_u32(h + of, 0);
+	if (fwrite(h, 1, of, t->f) != (size_t)of) {
+		fclose(t->f);
+		free(t);
+		return PTP_IO_ERR;
+	}
+
+	t->last = now_us();
+
+	ptp_mutex_lock(r);
+	r->trace = t;
+	ptp_mutex_unlock(r);
+	return 0;
+}
+
+int ptp_trace_stop(struct PtpRuntime *r) {
+	ptp_mutex_lock(r);
+	struct PtpTrace *t = r->trace;
+	r->trace = NULL;
+	ptp_mutex_unlock(r);
+
+	if (t == NULL) return 0;
+
+	// Backends set the packet size when they connect, which may have been after the trace started
+	uint8_t mps[4];
+	ptp_write_u32(mps, r->max_packet_size);
+	if (fseek(t->f, 8, SEEK_SET) || fwrite(mps, 1, 4, t->f) != 4) t->failed = 1;
+
+	int rc = t->failed ? PTP_IO_ERR : 0;
+	if (fclose(t->f)) rc = PTP_IO_ERR;
+	free(t);
+	return rc;
+}
+
+void ptp_trace_io(struct PtpRuntime *r, int flags, const void *data, int length) {
+	struct PtpTrace *t = r->trace;
+	if (t == NULL || length <= 0) return;
+
+	// The event channel can be read from another thread
+	flockfile(t->f);
+
+	uint64_t now = now_us();
+	uint64_t delta = now - t->last;
+	if (delta > UINT32_MAX) delta = UINT32_MAX;
+	t->last = now;
+
+	uint8_t h[PTP_TRACE_RECORD_SIZE];
+	int of = 0;
+	of += ptp_write_u32(h + of, (uint32_t)delta);
+	of += ptp_write_u8(h + of, (uint8_t)flags);
+	of += ptp_write_u32(h + of, (uint32_t)length);
+
+	if (fwrite(h, 1, of, t->f) != (size_t)of || fwrite(data, 1, length, t->f) != (size_t)length) {
+		if (!t->failed) ptp_log(PTP_LOG_ERR, PTP_LOG_CORE, "Failed to write trace\n");
+		t->failed = 1;
+	}
+
+	funlockfile(t->f);
+}
@@ -7,6 +7,8 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
 
 #include <camlib.h>
 
@@ -18,17 +20,18 @@ int ptpusb_send_bulk_packets(struct PtpRuntime *r, int length) {
 		x = ptp_cmd_write(r, r->data + sent, length);
 
 		if (x < 0) {
-			ptp_verbose_log("send_bulk_packet: %d\n", __func__, x);
+			ptp_log(PTP_LOG_ERR, PTP_LOG_USB, "%s: write failed: %d\n", __func__, x);
 			return PTP_IO_ERR;
 		}
-		
+
+		ptp_trace_io(r, 0, r->data + sent, x);
 		sent += x;
 		
 		if (sent > length) {
-			ptp_verbose_log("%s: Sent too many bytes: %d\n", __func__, sent);
+			ptp_log(PTP_LOG_ERR, PTP_LOG_USB, "%s: Sent too many bytes: %d\n", __func__, sent);
 			return sent;
 		} else if (sent == length) {
-			ptp_verbose_log("%s: Sent %d/%d bytes\n", __func__, sent, length);
+			ptp_log(PTP_LOG_TRACE, PTP_LOG_USB, "%s: Sent %d/%d bytes\n", __func__, sent, length);
 			return sent;			
 		}
 	}
@@ -46,35 +49,55 @@ int ptp_send_bulk_packets(struct PtpRuntime *r, int length) {
 		}
 
 		if (x < 0) {
-			ptp_verbose_log("send_bulk_packet: %d\n", __func__, x);
+			ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "%s: write failed: %d\n", __func__, x);
 			return PTP_IO_ERR;
 		}
-		
+
+		ptp_trace_io(r, 0, r->data + sent, x);
 		sent += x;
 		
 		if (sent > length) {
-			ptp_verbose_log("%s: Sent too many bytes: %d\n", __func__, sent);
+			ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "%s: Sent too many bytes: %d\n", __func__, sent);
 			return sent;
 		} else if (sent == length) {
-			ptp_verbose_log("%s: Sent %d/%d bytes\n", __func__, sent, length);
+			ptp_log(PTP_LOG_TRACE, PTP_LOG_IP, "%s: Sent %d/%d bytes\n", __func__, sent, length);
 			return sent;			
 		}
 	}
 }
 
-int ptpip_read_packet(struct PtpRuntime *r, int of) {
-	int rc = 0;
+// Read exactly length bytes from the socket
+static int ptpip_read_exact(struct PtpRuntime *r, void *to, int length) {
 	int read = 0;
+	while (read < length) {
+		int rc = ptpip_cmd_read(r, (uint8_t *)to + read, length - read);
+		if (rc <= 0) {
+			ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Read error: %d\n", rc);
+			return PTP_IO_ERR;
+		}
+
+		ptp_trace_io(r, PTP_TRACE_IN, (uint8_t *)to + read, rc);
+		read += rc;
+	}
+
+	return read;
+}
+
+// Read the 4 byte packet length that starts every PTP/IP and PTP/IP-USB packet,
+// retrying up to r->wait_for_response times
+static int ptpip_read_length(struct PtpRuntime *r, int of) {
+	int rc = 0;
 
 	while (r->wait_for_response) {
-		rc = ptpip_cmd_read(r, r->data + of + read, 4);
+		rc = ptpip_cmd_read(r, r->data + of, 4);
 
 		r->wait_for_response--;
 
 		if (rc > 0) break;
 
 		if (r->wait_for_response) {
-			ptp_verbose_log("Trying again...\n");
+			ptp_log(PTP_LOG_WARN, PTP_LOG_IP, "Trying again...\n");
+			ptp_stats_retry(r);
 			CAMLIB_SLEEP(CAMLIB_WAIT_MS);
 		}
 	}
@@ -82,45 +105,84 @@ int ptpip_read_packet(struct PtpRuntime *r, int of) {
 	r->wait_for_response = r->response_wait_default;
 
 	if (rc < 0) {
-		ptp_verbose_log("Failed to read packet length: %d\n", rc);
+		ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Failed to read packet length: %d\n", rc);
 		return PTP_IO_ERR;
 	}
 
+	ptp_trace_io(r, PTP_TRACE_IN, r->data + of, rc);
+
+	// The length can be split across two socket reads
 	if (rc < 4) {
-		ptp_verbose_log("Failed to read at least packet length: %d\n", rc);
-		return PTP_IO_ERR;
+		if (ptpip_read_exact(r, r->data + of + rc, 4 - rc) < 0) {
+			ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Failed to read at least packet length: %d\n", rc);
+			return PTP_IO_ERR;
+		}
+		rc = 4;
 	}
 
-	read += rc;
+	return rc;
+}
 
-	struct PtpIpHeader *h = (struct PtpIpHeader *)(r->data + of);
+// Write all of length bytes to the socket
+static int ptpip_write_exact(struct PtpRuntime *r, void *from, int length) {
+	int sent = 0;
+	while (sent < length) {
+		int rc = ptpip_cmd_write(r, (uint8_t *)from + sent, length - sent);
+		if (rc <= 0) {
+			ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Write error: %d\n", rc);
+			return PTP_IO_ERR;
+		}
+
+		ptp_trace_io(r, 0, (uint8_t *)from + sent, rc);
+		sent += rc;
+	}
+
+	return sent;
+}
+
+int ptpip_read_packet(struct PtpRuntime *r, int of) {
+	// Packets after the first one (response after a data phase) may start right at the end of the buffer
+	int rc = ptp_buffer_resize(r, of + 4);
+	if (rc) return rc;
+
+	rc = ptpip_read_length(r, of);
+	if (rc < 0) return rc;
 
-	if (h->length - read == 0) {
+	int read = rc;
+
+	uint32_t length;
+	ptp_read_u32(r->data + of, &length);
+
+	if (length - read == 0) {
 		return read;
 	}
 
 	// Ensure data buffer is large enough for the rest of the packet
-	if (of + read + h->length >= r->data_length) {
-		rc = ptp_buffer_resize(r, of + read + h->length);
-		if (rc) return rc;
-	}
+	rc = ptp_buffer_resize(r, of + read + length);
+	if (rc) return rc;
 
-	h = (struct PtpIpHeader *)(r->data + of);
+	rc = ptpip_read_exact(r, r->data + of + read, length - read);
+	if (rc < 0) return rc;
 
-	while (1) {
-		rc = ptpip_cmd_read(r, r->data + of + read, h->length - read);
+	return read + rc;
+}
 
-		if (rc < 0) {
-			ptp_verbose_log("Read error: %d\n", rc);
-			return PTP_IO_ERR;
-		}
+// Read a DATA or END packet header after START, the payload is left on the socket
+static int ptpip_read_data_header(struct PtpRuntime *r, struct PtpIpEndDataPacket *h) {
+	int rc = ptpip_read_exact(r, h, sizeof(struct PtpIpEndDataPacket));
+	if (rc < 0) return rc;
 
-		read += rc;
+	if (h->type != PTPIP_DATA_PACKET && h->type != PTPIP_DATA_PACKET_END) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Expected a DATA or END DATA packet, got %d\n", h->type);
+		return PTP_IO_ERR;
+	}
 
-		if (h->length - read == 0) {
-			return read;
-		}
+	if (h->length < sizeof(struct PtpIpEndDataPacket)) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Bad data packet length: %u\n", h->length);
+		return PTP_IO_ERR;
 	}
+
+	return rc;
 }
 
 int ptpip_receive_bulk_packets(struct PtpRuntime *r) {
@@ -134,29 +196,47 @@ int ptpip_receive_bulk_packets(struct PtpRuntime *r) {
 	struct PtpIpHeader *h = (struct PtpIpHeader *)(r->data);
 
 	if (h->type == PTPIP_DATA_PACKET_START) {
-		rc = ptpip_read_packet(r, pk1_of);
-		h = (struct PtpIpHeader *)(r->data + pk1_of);
-		if (h->type != PTPIP_DATA_PACKET_END) {
-			ptp_verbose_log("Didn't receive an END DATA packet (%d)\n", h->type);
-			return PTP_IO_ERR;
-		}
+		// Payload of any number of DATA packets and the END packet is joined into a single
+		// END packet at pk1_of, so it looks the same as a camera that sends one END packet.
+		int payload = 0;
+		struct PtpIpEndDataPacket dh;
+		do {
+			rc = ptpip_read_data_header(r, &dh);
+			if (rc < 0) return rc;
+
+			int size = (int)dh.length - (int)sizeof(dh);
+			rc = ptp_buffer_resize(r, pk1_of + sizeof(dh) + payload + size);
+			if (rc) return rc;
 
-		int pk2_of = pk1_of + h->length;
+			rc = ptpip_read_exact(r, r->data + pk1_of + sizeof(dh) + payload, size);
+			if (rc < 0) return rc;
+			payload += size;
+		} while (dh.type == PTPIP_DATA_PACKET);
+
+		struct PtpIpEndDataPacket *end = (struct PtpIpEndDataPacket *)(r->data + pk1_of);
+		end->length = sizeof(dh) + payload;
+		end->type = PTPIP_DATA_PACKET_END;
+		end->transaction = dh.transaction;
+
+		ptp_stats_data_done(r, payload);
+
+		int pk2_of = pk1_of + end->length;
 
 		rc = ptpip_read_packet(r, pk2_of);
+		if (rc < 0) return rc;
 		h = (struct PtpIpHeader *)(r->data + pk2_of);
 		if (h->type != PTPIP_COMMAND_RESPONSE) {
-			ptp_verbose_log("Non response packet after data end packet (%d)\n", h->type);
+			ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Non response packet after data end packet (%d)\n", h->type);
 			return PTP_IO_ERR;
 		}
 	} else if (h->type == PTPIP_COMMAND_RESPONSE) {
-		ptp_verbose_log("Received response packet\n");
+		ptp_log(PTP_LOG_TRACE, PTP_LOG_IP, "Received response packet\n");
 	} else {
-		ptp_verbose_log("Unexpected packet: %X\n", h->type);
+		ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Unexpected packet: %X\n", h->type);
 		return PTP_IO_ERR;
 	}
 
-	ptp_verbose_log("ptpip_receive_bulk_packets: Return code: 0x%X\n", ptp_get_return_code(r));
+	ptp_log(PTP_LOG_TRACE, PTP_LOG_IP, "ptpip_receive_bulk_packets: Return code: 0x%X\n", ptp_get_return_code(r));
 
 	return 0;
 }
@@ -171,45 +251,102 @@ int ptpip_write_packet(struct PtpRuntime *r, int of) {
 		return PTP_IO_ERR;
 	}
 
+	ptp_trace_io(r, 0, r->data + of, rc);
 	return rc;
 }
 
+// Read the rest of a data container, in max_packet_size chunks. Backends that can
+// queue transfers (libusb.c) override this to keep the bus busy.
+__attribute__((weak))
+int ptpusb_read_data_phase(struct PtpRuntime *r, void *to, int length) {
+	int read = 0;
+	while (read < length) {
+		int size = length - read;
+		if (size > r->max_packet_size) size = r->max_packet_size;
+		int rc = ptp_cmd_read(r, (uint8_t *)to + read, size);
+		if (rc <= 0) return PTP_IO_ERR;
+		read += rc;
+	}
+
+	return read;
+}
+
+__attribute__((weak))
+int ptpusb_stream_data_phase(struct PtpRuntime *r, int length, ptp_data_sink *sink, void *arg) {
+	int read = 0;
+	while (read < length) {
+		int size = length - read;
+		if (size > CAMLIB_STREAM_CHUNK) size = CAMLIB_STREAM_CHUNK;
+
+		int rc = ptpusb_read_data_phase(r, r->data, size);
+		if (rc <= 0) return PTP_IO_ERR;
+
+		int x = sink(r, arg, r->data, rc);
+		if (x) return x;
+		read += rc;
+	}
+
+	return read;
+}
+
 // Quirk of LibUSB/LibWPD - we can allowed read 512 bytes over and over again
 // until we don't, then packet is over. This makes the code simpler and gives a reduces
 // calls to the backend, which increases performance. This isn't possible with sockets - 
 // the read will time out in most cases.
-__attribute__((weak))
-int ptpusb_read_all_packets(struct PtpRuntime *r) {
-	int read = 0;
-
+static int ptpusb_read_first_packet(struct PtpRuntime *r) {
 	// Try and get the first 512 bytes
 	int rc = 0;
 	while (rc <= 0 && r->wait_for_response) {
-		rc = ptp_cmd_read(r, r->data + read, r->max_packet_size);
+		rc = ptp_cmd_read(r, r->data, r->max_packet_size);
 
 		r->wait_for_response--;
 
 		if (rc < 0) break;
 
 		if (r->wait_for_response) {
-			ptp_verbose_log("Trying again...\n");
+			ptp_log(PTP_LOG_WARN, PTP_LOG_USB, "Trying again...\n");
+			ptp_stats_retry(r);
 			CAMLIB_SLEEP(CAMLIB_WAIT_MS);
 		}
 	}
 	r->wait_for_response = r->response_wait_default;
 
 	if (rc < 0) {
-		ptp_verbose_log("Failed to read packets: %d\n", rc);
+		ptp_log(PTP_LOG_ERR, PTP_LOG_USB, "Failed to read packets: %d\n", rc);
 		return PTP_IO_ERR;
 	}
 
-	read += rc;
-
-	if (read < 12) {
-		ptp_verbose_log("Couldn't get basic packet: %d\n", rc);
+	if (rc < 12) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_USB, "Couldn't get basic packet: %d\n", rc);
 		return PTP_IO_ERR;
 	}
 
+	ptp_trace_io(r, PTP_TRACE_IN, r->data, rc);
+	return rc;
+}
+
+// Read the response container that follows a data phase
+static int ptpusb_read_response(struct PtpRuntime *r, int of) {
+	int rc = ptp_cmd_read(r, r->data + of, r->max_packet_size);
+	if (rc < 0) return PTP_IO_ERR;
+
+	// Data phases ending on a packet boundary are terminated by a zero length packet
+	if (rc == 0) {
+		rc = ptp_cmd_read(r, r->data + of, r->max_packet_size);
+		if (rc < 0) return PTP_IO_ERR;
+	}
+
+	ptp_trace_io(r, PTP_TRACE_IN, r->data + of, rc);
+	return rc;
+}
+
+__attribute__((weak))
+int ptpusb_read_all_packets(struct PtpRuntime *r) {
+	int rc = ptpusb_read_first_packet(r);
+	if (rc < 0) return rc;
+
+	int read = rc;
+
 	struct PtpBulkContainer *c = (struct PtpBulkContainer *)(r->data);
 
 	// 512 is always enough for the response packet
@@ -218,128 +355,526 @@ int ptpusb_read_all_packets(struct PtpRuntime *r) {
 	}
 
 	// Reallocate enough to fill the rest of data and response packet
-	if (c->type == PTP_PACKET_TYPE_DATA && r->data_length < (c->length + r->max_packet_size)) {
+	if (c->type == PTP_PACKET_TYPE_DATA) {
 		rc = ptp_buffer_resize(r, c->length + r->max_packet_size);
 		c = (struct PtpBulkContainer *)(r->data);
 		if (rc) return rc;
 	}
 
-	while (read < c->length) {
-		rc = ptp_cmd_read(r, r->data + read, r->max_packet_size);
+	if (read < c->length) {
+		rc = ptpusb_read_data_phase(r, r->data + read, c->length - read);
 		if (rc < 0) return PTP_IO_ERR;
+		ptp_trace_io(r, PTP_TRACE_IN, r->data + read, rc);
 		read += rc;
 	}
 
-	ptp_verbose_log("Read %d bytes\n", read);
+	ptp_log(PTP_LOG_TRACE, PTP_LOG_USB, "Read %d bytes\n", read);
+	ptp_stats_data_done(r, read - 12);
 
-	rc = ptp_cmd_read(r, r->data + read, r->max_packet_size);
-	if (rc < 0) return PTP_IO_ERR;
+	rc = ptpusb_read_response(r, read);
+	if (rc < 0) return rc;
 
 	return 0;
 }
 
 // For USB packets over IP, we can't do any LibUSB/LibWPD performance tricks. reads will just time out.
+// Both packet styles start with a 4 byte length, so the reading logic is shared.
 int ptpipusb_read_packet(struct PtpRuntime *r, int of) {
-	int rc = 0;
-	int read = 0;
+	return ptpip_read_packet(r, of);
+}
 
-	while (r->wait_for_response) {
-		rc = ptpip_cmd_read(r, r->data + of + read, 4);
+// For reading USB style packets over sockets
+int ptpipusb_receive_bulk_packets(struct PtpRuntime *r) {
+	int read = 0;
+	int rc = 0;
 
-		r->wait_for_response--;
+	rc = ptpipusb_read_packet(r, read);
+	if (rc < 0) return rc;
 
-		if (rc > 0) break;
+	struct PtpBulkContainer *c = (struct PtpBulkContainer *)(r->data + read);
 
-		if (r->wait_for_response) {
-			ptp_verbose_log("Trying again...\n");
-			CAMLIB_SLEEP(CAMLIB_WAIT_MS);
-		}
+	if (c->length < rc) {
+		ptp_log(PTP_LOG_DEBUG, PTP_LOG_IP, "Already read enough bytes\n");
+		return read;
 	}
 
-	r->wait_for_response = r->response_wait_default;
+	read += rc;
 
-	if (rc < 0) {
-		ptp_verbose_log("Failed to read packet length: %d\n", rc);
-		return PTP_IO_ERR;
+	// Handle data phase
+	if (c->type == PTP_PACKET_TYPE_DATA) {
+		ptp_stats_data_done(r, read - 12);
+		rc = ptpipusb_read_packet(r, read);
+		if (rc < 0) return rc;
+
+		read += rc;
 	}
 
-	if (rc < 4) {
-		ptp_verbose_log("Failed to read at least packet length: %d\n", rc);
+	ptp_log(PTP_LOG_TRACE, PTP_LOG_IP, "ptpipusb_receive_bulk_packets: Read %d bytes\n", read);
+	ptp_log(PTP_LOG_TRACE, PTP_LOG_IP, "ptpipusb_receive_bulk_packets: Return code: 0x%X\n", ptp_get_return_code(r));
+
+	return read;
+}
+
+int ptp_receive_bulk_packets(struct PtpRuntime *r) {
+	if (r->io_kill_switch) return -1;
+	if (r->connection_type == PTP_IP) {
+		return ptpip_receive_bulk_packets(r);
+	} else if (r->connection_type == PTP_USB) {
+		return ptpusb_read_all_packets(r);
+	} else if (r->connection_type == PTP_IP_USB) {
+		return ptpipusb_receive_bulk_packets(r);
+	} else {
 		return PTP_IO_ERR;
 	}
+}
 
-	read += rc;
+// Where a streamed data phase is going. If file is set, socket transports may move the
+// payload to it with ptpip_cmd_splice instead of going through the sink.
+struct StreamState {
+	ptp_data_sink *sink;
+	void *arg;
+	struct FileTarget *file;
+	int canceled;
+};
+
+struct FileTarget {
+	FILE *stream;
+	int skip;
+};
+
+static int file_sink(struct PtpRuntime *r, void *arg, uint8_t *data, int length) {
+	struct FileTarget *f = (struct FileTarget *)arg;
+	if (f->skip) {
+		int n = length < f->skip ? length : f->skip;
+		f->skip -= n;
+		data += n;
+		length -= n;
+	}
 
-	struct PtpBulkContainer *h = (struct PtpBulkContainer *)(r->data + of);
+	if (length == 0) return 0;
+	if (fwrite(data, 1, length, f->stream) != (size_t)length) return PTP_IO_ERR;
+	return 0;
+}
 
-	if (h->length - read == 0) {
-		return read;
+// Hand a chunk of payload to the sink, unless it asked to stop earlier
+static void stream_feed(struct PtpRuntime *r, struct StreamState *s, uint8_t *data, int length) {
+	if (s->canceled || length == 0) return;
+	if (s->sink(r, s->arg, data, length)) {
+		ptp_log(PTP_LOG_INFO, PTP_LOG_CORE, "Sink canceled the data phase, draining the rest\n");
+		s->canceled = 1;
 	}
+}
 
-	// Ensure data buffer is large enough for the rest of the packet
-	if (of + read + h->length >= r->data_length) {
-		rc = ptp_buffer_resize(r, of + read + h->length);
-		if (rc) return rc;
+// Move up to length bytes from the socket straight into the target file.
+// Stops early if the kernel can't splice into this file, so the caller can fall back to reads.
+static int stream_splice(struct PtpRuntime *r, struct StreamState *s, int length) {
+	FILE *f = s->file->stream;
+	if (fflush(f)) return PTP_IO_ERR;
+
+	int fd = fileno(f);
+	int moved = 0;
+	while (moved < length) {
+		int rc = ptpip_cmd_splice(r, fd, length - moved);
+		if (rc == PTP_UNSUPPORTED) break;
+		if (rc <= 0) return PTP_IO_ERR;
+		moved += rc;
 	}
 
-	// Update struct after resize
-	h = (struct PtpBulkContainer *)(r->data + of);
+	// stdio doesn't know the descriptor offset moved
+	off_t pos = lseek(fd, 0, SEEK_CUR);
+	if (pos >= 0) fseeko(f, pos, SEEK_SET);
 
-	while (1) {
-		rc = ptpip_cmd_read(r, r->data + of + read, h->length - read);
+	return moved;
+}
 
-		if (rc < 0) {
-			ptp_verbose_log("Read error: %d\n", rc);
-			return PTP_IO_ERR;
-		}
+static int usb_stream_chunk(struct PtpRuntime *r, void *arg, uint8_t *data, int length) {
+	ptp_trace_io(r, PTP_TRACE_IN, data, length);
+	stream_feed(r, (struct StreamState *)arg, data, length);
+	return 0;
+}
 
-		read += rc;
+// Read the rest of a data container in CAMLIB_STREAM_CHUNK pieces, always to the start of r->data
+static int stream_read_chunks(struct PtpRuntime *r, struct StreamState *s, int length) {
+	if (r->connection_type == PTP_USB) {
+		// Let the backend read ahead while the sink is busy
+		return ptpusb_stream_data_phase(r, length, usb_stream_chunk, s);
+	}
 
-		if (h->length - read == 0) {
-			return read;
+	int read = 0;
+	while (read < length) {
+		if (s->file != NULL && s->file->skip == 0 && !s->canceled && r->trace == NULL) {
+			int rc = stream_splice(r, s, length - read);
+			if (rc < 0) return rc;
+			read += rc;
+			// Either everything was moved, or splicing isn't possible for the rest
+			s->file = NULL;
+			continue;
 		}
+
+		int size = length - read;
+		if (size > CAMLIB_STREAM_CHUNK) size = CAMLIB_STREAM_CHUNK;
+		if (s->file != NULL && s->file->skip && size > s->file->skip) size = s->file->skip;
+
+		int rc = ptpip_read_exact(r, r->data, size);
+		if (rc <= 0) return PTP_IO_ERR;
+
+		stream_feed(r, s, r->data, rc);
+		read += rc;
 	}
+
+	return read;
 }
 
-// For reading USB style packets over sockets
-int ptpipusb_receive_bulk_packets(struct PtpRuntime *r) {
-	int read = 0;
-	int rc = 0;
+static int ptpusb_stream(struct PtpRuntime *r, struct StreamState *s) {
+	int rc = ptpusb_read_first_packet(r);
+	if (rc < 0) return rc;
 
-	rc = ptpipusb_read_packet(r, read);
+	struct PtpBulkContainer *c = (struct PtpBulkContainer *)(r->data);
+	if (c->type == PTP_PACKET_TYPE_RESPONSE) {
+		return 0;
+	} else if (c->type != PTP_PACKET_TYPE_DATA) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_USB, "Unexpected container type: %d\n", c->type);
+		return PTP_IO_ERR;
+	}
+
+	int length = (int)c->length;
+	stream_feed(r, s, r->data + 12, rc - 12);
+
+	if (rc < length) {
+		rc = stream_read_chunks(r, s, length - rc);
+		if (rc < 0) return rc;
+	}
+
+	ptp_stats_data_done(r, length - 12);
+
+	rc = ptpusb_read_response(r, 0);
 	if (rc < 0) return rc;
 
-	struct PtpBulkContainer *c = (struct PtpBulkContainer *)(r->data + read);
+	if (s->canceled) return PTP_CANCELED;
+	return 0;
+}
 
-	if (c->length < rc) {
-		ptp_verbose_log("Already read enough bytes\n");
-		return read;
+__attribute__((weak))
+int ptpusb_receive_stream(struct PtpRuntime *r, ptp_data_sink *sink, void *arg) {
+	struct StreamState s = {sink, arg, NULL, 0};
+	return ptpusb_stream(r, &s);
+}
+
+static int ptpip_stream(struct PtpRuntime *r, struct StreamState *s) {
+	int rc = ptpip_read_packet(r, 0);
+	if (rc < 0) return rc;
+
+	struct PtpIpHeader *h = (struct PtpIpHeader *)(r->data);
+	if (h->type == PTPIP_COMMAND_RESPONSE) {
+		return 0;
+	} else if (h->type != PTPIP_DATA_PACKET_START) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Unexpected packet: %X\n", h->type);
+		return PTP_IO_ERR;
 	}
 
-	read += rc;
+	// Only the data packet headers are kept, payload goes to the sink
+	struct PtpIpEndDataPacket dh;
+	int payload = 0;
+	do {
+		rc = ptpip_read_data_header(r, &dh);
+		if (rc < 0) return rc;
 
-	// Handle data phase
-	if (c->type == PTP_PACKET_TYPE_DATA) {
-		rc = ptpipusb_read_packet(r, read);
+		rc = stream_read_chunks(r, s, (int)dh.length - (int)sizeof(dh));
 		if (rc < 0) return rc;
+		payload += rc;
+	} while (dh.type == PTPIP_DATA_PACKET);
 
-		read += rc;
+	ptp_stats_data_done(r, payload);
+
+	rc = ptpip_read_packet(r, 0);
+	if (rc < 0) return rc;
+	h = (struct PtpIpHeader *)(r->data);
+	if (h->type != PTPIP_COMMAND_RESPONSE) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Non response packet after data end packet (%d)\n", h->type);
+		return PTP_IO_ERR;
 	}
 
-	ptp_verbose_log("ptpipusb_receive_bulk_packets: Read %d bytes\n", read);
-	ptp_verbose_log("ptpipusb_receive_bulk_packets: Return code: 0x%X\n", ptp_get_return_code(r));
+	if (s->canceled) return PTP_CANCELED;
+	return 0;
+}
 
-	return read;
+int ptpip_receive_stream(struct PtpRuntime *r, ptp_data_sink *sink, void *arg) {
+	struct StreamState s = {sink, arg, NULL, 0};
+	return ptpip_stream(r, &s);
 }
 
-int ptp_receive_bulk_packets(struct PtpRuntime *r) {
+static int ptpipusb_stream(struct PtpRuntime *r, struct StreamState *s) {
+	int rc = ptpip_read_length(r, 0);
+	if (rc < 0) return rc;
+
+	// Get the rest of the container header
+	rc = ptpip_read_exact(r, r->data + 4, 8);
+	if (rc < 0) return rc;
+
+	struct PtpBulkContainer *c = (struct PtpBulkContainer *)(r->data);
+	int length = (int)c->length;
+	if (c->type == PTP_PACKET_TYPE_RESPONSE) {
+		rc = ptpip_read_exact(r, r->data + 12, length - 12);
+		if (rc < 0) return rc;
+		return 0;
+	} else if (c->type != PTP_PACKET_TYPE_DATA) {
+		ptp_log(PTP_LOG_ERR, PTP_LOG_IP, "Unexpected container type: %d\n", c->type);
+		return PTP_IO_ERR;
+	}
+
+	rc = stream_read_chunks(r, s, length - 12);
+	if (rc < 0) return rc;
+
+	ptp_stats_data_done(r, length - 12);
+
+	rc = ptpipusb_read_packet(r, 0);
+	if (rc < 0) return rc;
+
+	if (s->canceled) return PTP_CANCELED;
+	return 0;
+}
+
+int ptpipusb_receive_stream(struct PtpRuntime *r, ptp_data_sink *sink, void *arg) {
+	struct StreamState s = {sink, arg, NULL, 0};
+	return ptpipusb_stream(r, &s);
+}
+
+int ptp_receive_stream_packets(struct PtpRuntime *r, ptp_data_sink *sink, void *arg) {
 	if (r->io_kill_switch) return -1;
 	if (r->connection_type == PTP_IP) {
-		return ptpip_receive_bulk_packets(r);
+		return ptpip_receive_stream(r, sink, arg);
 	} else if (r->connection_type == PTP_USB) {
-		return ptpusb_read_all_packets(r);
+		return ptpusb_receive_stream(r, sink, arg);
 	} else if (r->connection_type == PTP_IP_USB) {
-		return ptpipusb_receive_bulk_packets(r);
+		return ptpipusb_receive_stream(r, sink, arg);
+	} else {
+		return PTP_IO_ERR;
+	}
+}
+
+int ptp_freceive_bulk_packets(struct PtpRuntime *r, FILE *stream, int of) {
+	if (r->io_kill_switch) return -1;
+	struct FileTarget f = {stream, of};
+	struct StreamState s = {file_sink, &f, &f, 0};
+	int rc;
+	if (r->connection_type == PTP_IP) {
+		rc = ptpip_stream(r, &s);
+	} else if (r->connection_type == PTP_USB) {
+		// Let backends that override the USB stream reader (libwpd) handle it
+		rc = ptpusb_receive_stream(r, file_sink, &f);
+	} else if (r->connection_type == PTP_IP_USB) {
+		rc = ptpipusb_stream(r, &s);
+	} else {
+		return PTP_IO_ERR;
+	}
+
+	// A failed write to the file is the only way file_sink cancels
+	if (rc == PTP_CANCELED) return PTP_IO_ERR;
+	return rc;
+}
+
+// Send r->data up to length, then the rest of the file in CAMLIB_STREAM_CHUNK pieces.
+// Every write except the last is a multiple of the packet size, so the device doesn't
+// see a short packet before the container is complete.
+__attribute__((weak))
+int ptpusb_fsend_packets(struct PtpRuntime *r, int length, FILE *stream) {
+	// The data container header says how much of the file goes out, anything after that is left alone
+	struct PtpBulkContainer *bulk = (struct PtpBulkContainer *)(r->data);
+	int total = (int)bulk->length;
+	if (total < length) return PTP_IO_ERR;
+
+	int rc = ptp_buffer_resize(r, CAMLIB_STREAM_CHUNK);
+	if (rc) return rc;
+
+	int sent = 0;
+	int fill = length;
+	while (sent < total) {
+		int size = CAMLIB_STREAM_CHUNK - fill;
+		if (size > total - sent - fill) size = total - sent - fill;
+
+		int n = (int)fread(r->data + fill, 1, size, stream);
+		if (n != size) {
+			ptp_log(PTP_LOG_ERR, PTP_LOG_USB, "%s: File ended %d bytes early\n", __func__, total - sent - fill - n);
+			return PTP_IO_ERR;
+		}
+		fill += n;
+
+		rc = ptpusb_send_bulk_packets(r, fill);
+		if (rc != fill) return PTP_IO_ERR;
+		sent += fill;
+		fill = 0;
+	}
+
+	return sent;
+}
+
+// Copy exactly length bytes of the file to the socket, with sendfile until it turns out to be unsupported
+static int ptpip_send_file_part(struct PtpRuntime *r, FILE *stream, int length, int *use_sendfile) {
+	int sent = 0;
+	if (*use_sendfile) {
+		int fd = fileno(stream);
+		off_t pos = ftello(stream);
+		if (pos < 0 || lseek(fd, pos, SEEK_SET) != pos) *use_sendfile = 0;
+
+		while (*use_sendfile && sent < length) {
+			int rc = ptpip_cmd_sendfile(r, fd, length - sent);
+			if (rc == PTP_UNSUPPORTED) {
+				*use_sendfile = 0;
+			} else if (rc <= 0) {
+				return PTP_IO_ERR;
+			} else {
+				sent += rc;
+			}
+		}
+
+		// stdio doesn't know the descriptor offset moved
+		if (sent) fseeko(stream, lseek(fd, 0, SEEK_CUR), SEEK_SET);
+	}
+
+	while (sent < length) {
+		int size = length - sent;
+		if (size > CAMLIB_STREAM_CHUNK) size = CAMLIB_STREAM_CHUNK;
+		int n = (int)fread(r->data, 1, size, stream);
+		if (n <= 0) return PTP_IO_ERR;
+
+		if (ptpip_write_exact(r, r->data, n) < 0) return PTP_IO_ERR;
+		sent += n;
+	}
+
+	return sent;
+}
+
+// Same for sockets. r->data till length ends with the END header (PTP/IP) or data container
+// header (IP-USB), which has the payload length. With r->data_packet_size set, PTP/IP payloads
+// are split into DATA packets.
+static int ptpip_fsend_packets(struct PtpRuntime *r, int length, FILE *stream) {
+	struct PtpIpEndDataPacket *h = (struct PtpIpEndDataPacket *)(r->data + length - sizeof(*h));
+	int payload = (int)h->length - (int)sizeof(*h);
+	uint32_t transaction = h->transaction;
+
+	int chunk = payload;
+	if (r->connection_type == PTP_IP && r->data_packet_size > 0 && r->data_packet_size < payload) {
+		chunk = r->data_packet_size;
+	}
+
+	// The payload never passes through here with sendfile, so it couldn't be traced
+	int use_sendfile = r->trace == NULL;
+	int header = length;
+	int sent = 0;
+	while (1) {
+		int size = payload - sent;
+		int last = size <= chunk;
+		if (!last) size = chunk;
+
+		if (chunk != payload) {
+			h = (struct PtpIpEndDataPacket *)(r->data + header - sizeof(*h));
+			h->length = sizeof(*h) + size;
+			h->type = last ? PTPIP_DATA_PACKET_END : PTPIP_DATA_PACKET;
+			h->transaction = transaction;
+		}
+
+		if (ptpip_write_exact(r, r->data, header) < 0) return PTP_IO_ERR;
+		int rc = ptpip_send_file_part(r, stream, size, &use_sendfile);
+		if (rc < 0) return rc;
+
+		sent += size;
+		if (last) break;
+		header = sizeof(*h);
+	}
+
+	return length + payload;
+}
+
+int ptp_fsend_packets(struct PtpRuntime *r, int length, FILE *stream) {
+	if (r->io_kill_switch) return -1;
+	if (r->connection_type == PTP_USB) {
+		return ptpusb_fsend_packets(r, length, stream);
+	} else if (r->connection_type == PTP_IP || r->connection_type == PTP_IP_USB) {
+		return ptpip_fsend_packets(r, length, stream);
+	} else {
+		return PTP_IO_ERR;
+	}
+}
+
+// Send r->data up to length, then the caller's payload as separate transfers. Only enough of the
+// payload to fill the first packet is copied, so the header doesn't go out as a short packet.
+__attribute__((weak))
+int ptpusb_send_data_packets(struct PtpRuntime *r, int length, void *data, int data_length) {
+	int head = r->max_packet_size - length;
+	if (head < 0) head = 0;
+	if (head > data_length) head = data_length;
+
+	memcpy(r->data + length, data, head);
+	int rc = ptpusb_send_bulk_packets(r, length + head);
+	if (rc != length + head) return PTP_IO_ERR;
+
+	int sent = head;
+	while (sent < data_length) {
+		int size = data_length - sent;
+		if (size > CAMLIB_STREAM_CHUNK) size = CAMLIB_STREAM_CHUNK;
+		rc = ptp_cmd_write(r, (uint8_t *)data + sent, size);
+		if (rc <= 0) {
+			ptp_log(PTP_LOG_ERR, PTP_LOG_USB, "%s: Failed to write payload: %d\n", __func__, rc);
+			return PTP_IO_ERR;
+		}
+		ptp_trace_io(r, 0, (uint8_t *)data + sent, rc);
+		sent += rc;
+	}
+
+	return length + sent;
+}
+
+// ptpip_cmd_writev, with both parts traced
+static int ptpip_writev(struct PtpRuntime *r, void *header, int header_length, void *payload, int payload_length) {
+	int rc = ptpip_cmd_writev(r, header, header_length, payload, payload_length);
+	if (rc == header_length + payload_length) {
+		ptp_trace_io(r, 0, header, header_length);
+		ptp_trace_io(r, 0, payload, payload_length);
+	}
+
+	return rc;
+}
+
+// r->data till length ends with the END header. Send the payload as DATA packets of
+// r->data_packet_size instead, with the last piece in the END packet.
+static int ptpip_send_data_chunks(struct PtpRuntime *r, int length, void *data, int data_length) {
+	struct PtpIpEndDataPacket *h = (struct PtpIpEndDataPacket *)(r->data + length - sizeof(*h));
+	uint32_t transaction = h->transaction;
+
+	// First write carries the request, START and first DATA header, after that only packet headers
+	int header = length;
+	int sent = 0;
+	while (1) {
+		int size = data_length - sent;
+		int last = size <= r->data_packet_size;
+		if (!last) size = r->data_packet_size;
+
+		h = (struct PtpIpEndDataPacket *)(r->data + header - sizeof(*h));
+		h->length = sizeof(*h) + size;
+		h->type = last ? PTPIP_DATA_PACKET_END : PTPIP_DATA_PACKET;
+		h->transaction = transaction;
+
+		int rc = ptpip_writev(r, r->data, header, (uint8_t *)data + sent, size);
+		if (rc != header + size) return PTP_IO_ERR;
+
+		sent += size;
+		if (last) break;
+		header = sizeof(*h);
+	}
+
+	return length + data_length;
+}
+
+int ptp_send_data_packets(struct PtpRuntime *r, int length, void *data, int data_length) {
+	if (r->io_kill_switch) return -1;
+	if (r->connection_type == PTP_USB) {
+		return ptpusb_send_data_packets(r, length, data, data_length);
+	} else if (r->connection_type == PTP_IP && r->data_packet_size > 0 && r->data_packet_size < data_length) {
+		return ptpip_send_data_chunks(r, length, data, data_length);
+	} else if (r->connection_type == PTP_IP || r->connection_type == PTP_IP_USB) {
+		int rc = ptpip_writev(r, r->data, length, data, data_length);
+		if (rc != length + data_length) return PTP_IO_ERR;
+		return rc;
 	} else {
 		return PTP_IO_ERR;
 	}
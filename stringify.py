@@ -36,6 +36,85 @@ output += "\n};"
 
 output += "int ptp_enums_length = " + str(len(matches)) + ";\n"
 
+# Perfect hash tables over ptp_enums, see enums.c for the lookups. Hash and displace:
+# keys are split into buckets, and each bucket gets the first seed that puts all of
+# its keys into free slots. The hash functions must match enums.c.
+M32 = 0xffffffff
+
+def hash_int(x, seed):
+    x = (x ^ seed) & M32
+    x = (x * 0x9e3779b1) & M32
+    x ^= x >> 16
+    x = (x * 0x85ebca6b) & M32
+    x ^= x >> 13
+    return x
+
+def hash_str(s, seed):
+    h = 2166136261 ^ seed
+    for c in s.encode():
+        h ^= c
+        h = (h * 16777619) & M32
+    return h
+
+def code_key(type, vendor, value):
+    return (value ^ (type << 24) ^ (vendor << 20)) & M32
+
+def pow2(n):
+    x = 1
+    while x < n:
+        x *= 2
+    return x
+
+def table(values):
+    out = ""
+    for i in range(0, len(values), 16):
+        out += ", ".join(str(x) for x in values[i:i + 16]) + ",\n"
+    return out
+
+def perfect_hash(name, keys, hash):
+    # keys is a list of (key, index into ptp_enums), first one wins on duplicates
+    unique = {}
+    for k, i in keys:
+        if k not in unique:
+            unique[k] = i
+    size = pow2(len(unique) * 3 // 2)
+    nbuckets = max(1, size // 4)
+    assert len(matches) < 32768
+
+    buckets = [[] for _ in range(nbuckets)]
+    for k in unique:
+        buckets[hash(k, 0) & (nbuckets - 1)].append(k)
+
+    seeds = [0] * nbuckets
+    index = [-1] * size
+    for b in sorted(range(nbuckets), key=lambda b: -len(buckets[b])):
+        if len(buckets[b]) == 0:
+            break
+        for seed in range(1, 65536):
+            slots = [hash(k, seed) & (size - 1) for k in buckets[b]]
+            if len(set(slots)) == len(slots) and all(index[x] == -1 for x in slots):
+                break
+        else:
+            raise Exception("No seed for " + name)
+        seeds[b] = seed
+        for k, x in zip(buckets[b], slots):
+            index[x] = unique[k]
+
+    out = "static const unsigned short " + name + "_seeds[] = {\n" + table(seeds) + "};\n"
+    out += "static const short " + name + "_index[] = {\n" + table(index) + "};\n"
+    out += "const struct PtpEnumTable " + name + " = {" + str(nbuckets) + ", " + str(size) + ", "
+    out += name + "_seeds, " + name + "_index};\n"
+    return out
+
+entries = re.findall(r"\{(PTP_[A-Z]+), ([0-9]+), \"([A-Za-z0-9_]+)\", (0x[0-9a-fA-F]+)\}", output)
+types = {"PTP_ENUM": 0, "PTP_OC": 1, "PTP_OF": 2, "PTP_PC": 3, "PTP_EC": 4, "PTP_RC": 5, "PTP_ST": 6, "PTP_FT": 7, "PTP_AC": 8, "PTP_AT": 9}
+assert len(entries) == len(matches)
+
+output += "\n"
+output += perfect_hash("ptp_enum_by_value", [(int(e[3], 16), i) for i, e in enumerate(entries)], hash_int)
+output += perfect_hash("ptp_enum_by_code", [(code_key(types[e[0]], int(e[1]), int(e[3], 16)), i) for i, e in enumerate(entries)], hash_int)
+output += perfect_hash("ptp_enum_by_name", [(e[2], i) for i, e in enumerate(entries)], hash_str)
+
 print("Compiled", len(matches), "enums")
 f = open("src/enum_dump.c", "w")
 f.write(output)
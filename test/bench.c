@@ -0,0 +1,350 @@
+// Benchmarks for camlib against the in-memory camera (src/sim.c), run with make bench
+// Prints one JSON object per line, so results can be diffed between releases:
+// {"bench": name, "iterations": n, "ns_per_op": median, "ns_per_op_min": min[, "mb_per_s": x]}
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <camlib.h>
+#include <ptp.h>
+
+// Each repeat runs for about this long, the median of the repeats is reported
+#define BENCH_TARGET_NS 50000000ULL
+#define BENCH_REPEATS 5
+
+// GetObject throughput, large enough for the transport to dominate
+#define BENCH_OBJECT_SIZE (16 * 1024 * 1024)
+
+typedef void bench_fn(struct PtpRuntime *r, void *arg);
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static int bench_failed = 0;
+
+static void check(int rc, const char *what) {
+	if (rc < 0) {
+		fprintf(stderr, "bench: %s failed: %d\n", what, rc);
+		bench_failed = 1;
+	}
+}
+
+// bytes is how much data one call moves, 0 to leave out mb_per_s
+static void bench_run(const char *name, bench_fn *fn, struct PtpRuntime *r, void *arg, long bytes) {
+	// Warm up (the first call grows buffers), then find how many calls fill BENCH_TARGET_NS
+	fn(r, arg);
+	uint64_t start = now_ns();
+	fn(r, arg);
+	uint64_t once = now_ns() - start;
+	if (once == 0) once = 1;
+
+	uint64_t iterations = BENCH_TARGET_NS / once;
+	if (iterations < 1) iterations = 1;
+
+	uint64_t per_op[BENCH_REPEATS];
+	for (int i = 0; i < BENCH_REPEATS; i++) {
+		start = now_ns();
+		for (uint64_t j = 0; j < iterations; j++) {
+			fn(r, arg);
+		}
+		per_op[i] = (now_ns() - start) / iterations;
+	}
+
+	qsort(per_op, BENCH_REPEATS, sizeof(uint64_t), cmp_u64);
+	uint64_t median = per_op[BENCH_REPEATS / 2];
+
+	printf("{\"bench\": \"%s\", \"iterations\": %llu, \"ns_per_op\": %llu, \"ns_per_op_min\": %llu",
+		name, (unsigned long long)iterations, (unsigned long long)median, (unsigned long long)per_op[0]);
+	if (bytes && median) {
+		printf(", \"mb_per_s\": %.1f", (double)bytes * 1e9 / (double)median / (1024.0 * 1024.0));
+	}
+	printf("}\n");
+	fflush(stdout);
+}
+
+static void errors_to_stderr(int level, int category, const char *msg) {
+	fputs(msg, stderr);
+}
+
+static int bench_connect(struct PtpRuntime *r, int type) {
+	int rc;
+	if (type == PTP_USB) {
+		rc = ptp_device_init(r);
+	} else {
+		rc = ptpip_connect(r, "sim", 15740);
+		if (rc == 0 && type == PTP_IP) {
+			rc = ptpip_init_command_request(r, "bench");
+			if (rc == 0) rc = ptpip_connect_events(r, "sim", 15740);
+			if (rc == 0) rc = ptpip_init_events(r);
+		}
+	}
+
+	if (rc) return rc;
+	return ptp_open_session(r);
+}
+
+static void bench_disconnect(struct PtpRuntime *r) {
+	ptp_close_session(r);
+	if (r->connection_type == PTP_USB) {
+		ptp_device_close(r);
+	} else {
+		ptpip_close(r);
+	}
+	ptp_close(r);
+	free(r);
+}
+
+/* Parsers, run over the last payload received */
+
+static struct PtpDeviceInfo bench_di;
+
+static void parse_device_info(struct PtpRuntime *r, void *arg) {
+	ptp_parse_device_info(r, &bench_di);
+}
+
+static void parse_object_info(struct PtpRuntime *r, void *arg) {
+	struct PtpObjectInfo oi;
+	ptp_parse_object_info(r, &oi);
+}
+
+static void parse_prop_desc(struct PtpRuntime *r, void *arg) {
+	struct PtpPropDesc pd;
+	memset(&pd, 0, sizeof(pd));
+	ptp_parse_prop_desc(r, &pd);
+	free(pd.default_value);
+	free(pd.current_value);
+	free(pd.enum_form);
+}
+
+static void parse_eos_events(struct PtpRuntime *r, void *arg) {
+	struct PtpGenericEvent *events = NULL;
+	int length = ptp_eos_events(r, &events);
+	if (length > 0) free(events);
+}
+
+static void read_eos_events(struct PtpRuntime *r, void *arg) {
+	struct PtpEventReader e;
+	struct PtpGenericEvent ev;
+	ptp_eos_events_open(r, &e);
+	while (ptp_eos_events_next(r, &e, &ev) == 1);
+	ptp_eos_events_close(r, &e);
+}
+
+/* JSON serializers, into a buffer big enough to never truncate */
+
+static char json[16384];
+
+static void json_device_info(struct PtpRuntime *r, void *arg) {
+	ptp_device_info_json((const struct PtpDeviceInfo *)arg, json, sizeof(json));
+}
+
+static void json_object_info(struct PtpRuntime *r, void *arg) {
+	ptp_object_info_json((const struct PtpObjectInfo *)arg, json, sizeof(json));
+}
+
+static void json_prop_desc(struct PtpRuntime *r, void *arg) {
+	ptp_prop_desc_json((const struct PtpPropDesc *)arg, json, sizeof(json));
+}
+
+static void json_storage_info(struct PtpRuntime *r, void *arg) {
+	ptp_storage_info_json((const struct PtpStorageInfo *)arg, json, sizeof(json));
+}
+
+static void json_eos_events(struct PtpRuntime *r, void *arg) {
+	ptp_eos_events_json(r, json, sizeof(json));
+}
+
+/* Liveview pixel conversion, each call includes a round trip to the sim */
+
+static void ml_liveview(struct PtpRuntime *r, void *arg) {
+	check(ptp_liveview_ml(r, (uint8_t *)arg), "ptp_liveview_ml");
+}
+
+static void eos_liveview_copy(struct PtpRuntime *r, void *arg) {
+	check(ptp_liveview_frame(r, arg), "ptp_liveview_frame");
+}
+
+static void eos_liveview_borrow(struct PtpRuntime *r, void *arg) {
+	const uint8_t *jpeg;
+	int length;
+	int rc = ptp_liveview_eos_borrow(r, &jpeg, &length);
+	check(rc, "ptp_liveview_eos_borrow");
+	if (rc == 0) ptp_liveview_release(r);
+}
+
+struct ConvertArgs {
+	uint8_t *in;
+	uint8_t *out;
+	int format;
+};
+
+static void convert_rgb(struct PtpRuntime *r, void *arg) {
+	struct ConvertArgs *c = (struct ConvertArgs *)arg;
+	ptp_liveview_convert_rgb(c->out, c->in, 360 * 240, c->format);
+}
+
+static void ml_bmp_liveview(struct PtpRuntime *r, void *arg) {
+	check(ptp_ml_get_bmp_lv_frame(r, (uint32_t *)arg), "ptp_ml_get_bmp_lv_frame");
+}
+
+/* GetObject, end to end */
+
+static void get_object(struct PtpRuntime *r, void *arg) {
+	check(ptp_get_object(r, 1), "ptp_get_object");
+}
+
+static void get_object_file(struct PtpRuntime *r, void *arg) {
+	FILE *f = (FILE *)arg;
+	rewind(f);
+	check(ptp_get_object_file(r, 1, f), "ptp_get_object_file");
+}
+
+static int bench_data(void) {
+	struct PtpRuntime *r = ptp_new(PTP_USB);
+	int rc = bench_connect(r, PTP_USB);
+	if (rc) return rc;
+
+	rc = ptp_get_device_info(r, &bench_di);
+	if (rc) return rc;
+	bench_run("parse_device_info", parse_device_info, r, NULL, 0);
+	bench_run("json_device_info", json_device_info, r, &bench_di, 0);
+
+	struct PtpObjectInfo oi;
+	rc = ptp_get_object_info(r, 1, &oi);
+	if (rc) return rc;
+	bench_run("parse_object_info", parse_object_info, r, NULL, 0);
+	bench_run("json_object_info", json_object_info, r, &oi, 0);
+
+	struct PtpPropDesc pd;
+	memset(&pd, 0, sizeof(pd));
+	rc = ptp_get_prop_desc(r, PTP_PC_BatteryLevel, &pd);
+	if (rc) return rc;
+	bench_run("parse_prop_desc_range", parse_prop_desc, r, NULL, 0);
+	bench_run("json_prop_desc_range", json_prop_desc, r, &pd, 0);
+	free(pd.default_value);
+	free(pd.current_value);
+
+	memset(&pd, 0, sizeof(pd));
+	rc = ptp_get_prop_desc(r, PTP_PC_ImageSize, &pd);
+	if (rc) return rc;
+	bench_run("parse_prop_desc_enum", parse_prop_desc, r, NULL, 0);
+	bench_run("json_prop_desc_enum", json_prop_desc, r, &pd, 0);
+	free(pd.default_value);
+	free(pd.current_value);
+	free(pd.enum_form);
+
+	struct PtpStorageInfo si;
+	rc = ptp_get_storage_info(r, 0x10001, &si);
+	if (rc) return rc;
+	bench_run("json_storage_info", json_storage_info, r, &si, 0);
+
+	// First poll carries the avail lists, the second only the steady state prop reports
+	rc = ptp_eos_get_event(r);
+	if (rc) return rc;
+	rc = ptp_eos_get_event(r);
+	if (rc) return rc;
+	bench_run("parse_eos_events", parse_eos_events, r, NULL, 0);
+	bench_run("read_eos_events", read_eos_events, r, NULL, 0);
+	bench_run("json_eos_events", json_eos_events, r, NULL, 0);
+
+	bench_disconnect(r);
+	return 0;
+}
+
+static int bench_liveview(void) {
+	struct PtpRuntime *r = ptp_new(PTP_USB);
+	int rc = bench_connect(r, PTP_USB);
+	if (rc) return rc;
+
+	// The sim doesn't advertise the ML opcodes, so this picks EOS
+	rc = ptp_get_device_info(r, &bench_di);
+	if (rc) return rc;
+	rc = ptp_liveview_init(r);
+	if (rc) return rc;
+
+	uint8_t *buffer = malloc(ptp_liveview_size(r));
+	if (buffer == NULL) return PTP_OUT_OF_MEM;
+	bench_run("eos_liveview_copy", eos_liveview_copy, r, buffer, 0);
+	bench_run("eos_liveview_borrow", eos_liveview_borrow, r, NULL, 0);
+	free(buffer);
+
+	buffer = malloc(360 * 240 * 4);
+	if (buffer == NULL) return PTP_OUT_OF_MEM;
+	bench_run("ml_liveview_360x240", ml_liveview, r, buffer, 0);
+
+	// Conversion alone, out of the last frame
+	struct ConvertArgs c = {ptp_get_payload(r), buffer, PTP_LV_FORMAT_RGBA};
+	bench_run("convert_rgb_rgba_360x240", convert_rgb, r, &c, 360 * 240 * 3);
+	c.format = PTP_LV_FORMAT_BGRA;
+	bench_run("convert_rgb_bgra_360x240", convert_rgb, r, &c, 360 * 240 * 3);
+	free(buffer);
+
+	rc = ptp_ml_init_bmp_lv(r);
+	if (rc) return rc;
+	uint32_t *frame = malloc(PTP_ML_BMP_LV_WIDTH * PTP_ML_BMP_LV_HEIGHT * 4);
+	if (frame == NULL) return PTP_OUT_OF_MEM;
+	bench_run("ml_bmp_liveview_720x480", ml_bmp_liveview, r, frame, 0);
+	free(frame);
+
+	bench_disconnect(r);
+	return 0;
+}
+
+static int bench_get_object(int type, const char *name) {
+	struct PtpRuntime *r = ptp_new(type);
+	int rc = bench_connect(r, type);
+	if (rc) return rc;
+
+	char bench[64];
+	snprintf(bench, sizeof(bench), "get_object_%s", name);
+	bench_run(bench, get_object, r, NULL, BENCH_OBJECT_SIZE);
+
+	FILE *f = fopen("/dev/null", "wb");
+	if (f != NULL) {
+		snprintf(bench, sizeof(bench), "get_object_file_%s", name);
+		bench_run(bench, get_object_file, r, f, BENCH_OBJECT_SIZE);
+		fclose(f);
+	}
+
+	bench_disconnect(r);
+	return 0;
+}
+
+int main(void) {
+	// Keep stdout machine readable
+	ptp_log_set_sink(errors_to_stderr);
+	ptp_log_set_level(PTP_LOG_ERR);
+
+	struct PtpSimConfig c;
+	ptpsim_default_config(&c);
+	c.num_objects = 1;
+	c.object_size = BENCH_OBJECT_SIZE;
+	c.events_per_poll = 50;
+	ptpsim_set_config(&c);
+
+	printf("{\"camlib_bench\": 1, \"compiler\": \"%s\"}\n", __VERSION__);
+
+	int rc = bench_data();
+	if (rc == 0) rc = bench_liveview();
+	if (rc == 0) rc = bench_get_object(PTP_USB, "usb");
+	if (rc == 0) rc = bench_get_object(PTP_IP, "ip");
+	if (rc == 0) rc = bench_get_object(PTP_IP_USB, "ip_usb");
+
+	if (rc || bench_failed) {
+		fprintf(stderr, "bench: failed: %d\n", rc);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,99 @@
+// Record a session against the simulator (built with -D TEST_RECORD), then play the trace back
+// through src/replay_backend.c with the same code, run with make test-sim
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <camlib.h>
+
+static int connect_to(struct PtpRuntime *r, int type) {
+	if (type == PTP_USB) return ptp_device_init(r);
+
+	int rc = ptpip_connect(r, "sim", 15740);
+	if (rc == 0 && type == PTP_IP) {
+		rc = ptpip_init_command_request(r, "test");
+		if (rc == 0) rc = ptpip_connect_events(r, "sim", 15740);
+		if (rc == 0) rc = ptpip_init_events(r);
+	}
+	return rc;
+}
+
+static int session(struct PtpRuntime *r) {
+	int rc = ptp_open_session(r);
+	if (rc) return rc;
+
+	struct PtpDeviceInfo di;
+	rc = ptp_get_device_info(r, &di);
+	if (rc) return rc;
+	assert(!strcmp(di.model, "Canon EOS Rebel T6"));
+
+	struct PtpArray *arr;
+	rc = ptp_get_storage_ids(r, &arr);
+	if (rc) return rc;
+	assert(arr->length == 1);
+	free(arr);
+
+	// Big enough to take several reads
+	rc = ptp_get_object(r, 1);
+	if (rc) return rc;
+	int length = ptp_get_payload_length(r);
+	assert(length > 0);
+
+	// Unsupported opcodes come back the same way too
+	struct PtpCommand cmd;
+	cmd.code = 0x1fff;
+	cmd.param_length = 0;
+	assert(ptp_send(r, &cmd) == PTP_CHECK_CODE);
+	assert(ptp_get_return_code(r) == PTP_RC_OperationNotSupported);
+
+	return ptp_close_session(r);
+}
+
+static int run(int type, const char *path) {
+	struct PtpRuntime *r = ptp_new(type);
+
+#ifdef TEST_RECORD
+	int rc = ptp_trace_start(r, path);
+	if (rc) return rc;
+#else
+	int rc = ptp_replay_open(r, path, PTP_REPLAY_FAST);
+	if (rc) return rc;
+#endif
+
+	rc = connect_to(r, type);
+	if (rc == 0) rc = session(r);
+
+#ifdef TEST_RECORD
+	if (rc == 0) rc = ptp_trace_stop(r);
+#else
+	if (rc == 0 && ptp_replay_mismatches(r) != 0) {
+		printf("%d writes diverged from %s\n", ptp_replay_mismatches(r), path);
+		rc = PTP_RUNTIME_ERR;
+	}
+#endif
+
+	if (type == PTP_USB) {
+		ptp_device_close(r);
+	} else {
+		ptpip_close(r);
+	}
+	ptp_close(r);
+	free(r);
+	return rc;
+}
+
+int main() {
+	int rc;
+
+	rc = run(PTP_USB, "test-usb.trace");
+	printf("Return code: %d\n", rc);
+	if (rc) return rc;
+
+	rc = run(PTP_IP, "test-ip.trace");
+	printf("Return code: %d\n", rc);
+	if (rc) return rc;
+
+	return 0;
+}
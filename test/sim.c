@@ -0,0 +1,251 @@
+// Tests that need the simulator's config (src/sim.c), run with make test-sim
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <stdatomic.h>
+
+#include <camlib.h>
+
+static int connect_ip(struct PtpRuntime *r, int type) {
+	int rc = ptpip_connect(r, "sim", 15740);
+	if (rc == 0 && type == PTP_IP) {
+		rc = ptpip_init_command_request(r, "test");
+		if (rc == 0) rc = ptpip_connect_events(r, "sim", 15740);
+		if (rc == 0) rc = ptpip_init_events(r);
+	}
+
+	if (rc) return rc;
+	return ptp_open_session(r);
+}
+
+static void disconnect_ip(struct PtpRuntime *r) {
+	ptp_close_session(r);
+	ptpip_close(r);
+	ptp_close(r);
+	free(r);
+}
+
+// GetObject sizes that put a packet length across the end of a 16k socket read (ip.c rx buffer)
+int test_ip_read_boundary(int type) {
+	int sizes[] = {1000, 16350, 16351, 16352, 16353, 32700, 32730, 100000, 2000000};
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(int); i++) {
+		struct PtpSimConfig c;
+		ptpsim_default_config(&c);
+		c.num_objects = 1;
+		c.object_size = sizes[i];
+		c.ip_segment = 16384;
+		ptpsim_set_config(&c);
+
+		struct PtpRuntime *r = ptp_new(type);
+		int rc = connect_ip(r, type);
+		if (rc) return rc;
+
+		// Every offset of the response length within a segment
+		for (int j = 0; j < 8; j++) {
+			rc = ptp_get_object(r, 1);
+			if (rc) {
+				printf("GetObject of %d bytes failed: %d\n", sizes[i], rc);
+				return rc;
+			}
+			assert(ptp_get_payload_length(r) == sizes[i]);
+		}
+
+		disconnect_ip(r);
+	}
+
+	struct PtpSimConfig c;
+	ptpsim_default_config(&c);
+	ptpsim_set_config(&c);
+	return 0;
+}
+
+static int send_file(struct PtpRuntime *r, FILE *f, int length) {
+	// vcam's checksum op, param 0 is the sum of the bytes that should arrive
+	struct PtpCommand cmd;
+	cmd.code = 0xBEEF;
+	cmd.param_length = 1;
+	cmd.params[0] = 0;
+	for (int i = 0; i < length; i++) {
+		cmd.params[0] += (uint8_t)(i * 7);
+	}
+
+	rewind(f);
+	return ptp_send_data_file(r, &cmd, f, length);
+}
+
+// File data phases must stop at the container length, and fail if the file is too short
+int test_usb_send_file(void) {
+	FILE *f = tmpfile();
+	if (f == NULL) return PTP_IO_ERR;
+	for (int i = 0; i < 100000; i++) {
+		fputc((uint8_t)(i * 7), f);
+	}
+
+	struct PtpRuntime *r = ptp_new(PTP_USB);
+	int rc = ptp_device_init(r);
+	if (rc) return rc;
+	rc = ptp_open_session(r);
+	if (rc) return rc;
+
+	int lengths[] = {1, 511, 512, 1000, 65536, 70000, 100000};
+	for (size_t i = 0; i < sizeof(lengths) / sizeof(int); i++) {
+		rc = send_file(r, f, lengths[i]);
+		if (rc) {
+			printf("Sending %d bytes of file failed: %d\n", lengths[i], rc);
+			return rc;
+		}
+		assert(ptp_get_return_code(r) == PTP_RC_OK);
+	}
+
+	// Nothing past the container went out, so the next transaction is still in sync
+	struct PtpArray *arr;
+	rc = ptp_get_storage_ids(r, &arr);
+	if (rc) return rc;
+	free(arr);
+
+	assert(send_file(r, f, 100001) == PTP_IO_ERR);
+
+	fclose(f);
+	ptp_device_close(r);
+	ptp_close(r);
+	free(r);
+	return 0;
+}
+
+struct LvCallbackState {
+	atomic_int calls;
+	atomic_int in_callback;
+	// Set to make the callback stall, so the stream can be stopped in the middle of one
+	atomic_int hold;
+	uint64_t last_seq;
+};
+
+static void lv_callback(struct PtpRuntime *r, const struct PtpLvFrame *frame, void *arg) {
+	struct LvCallbackState *st = (struct LvCallbackState *)arg;
+	atomic_store(&st->in_callback, 1);
+
+	assert(frame->seq > st->last_seq);
+	st->last_seq = frame->seq;
+	assert(frame->length == 10000);
+	assert(frame->data[0] == 0xff && frame->data[1] == 0xd8);
+	assert(frame->data[frame->length - 2] == 0xff && frame->data[frame->length - 1] == 0xd9);
+
+	if (atomic_load(&st->hold)) CAMLIB_SLEEP(100);
+
+	atomic_fetch_add(&st->calls, 1);
+	atomic_store(&st->in_callback, 0);
+}
+
+static uint64_t test_now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Stream EOS liveview from a camera that only has a new frame every 1/60s
+int test_lv_stream(void) {
+	struct PtpSimConfig c;
+	ptpsim_default_config(&c);
+	c.lv_fps = 60;
+	c.lv_frame_size = 10000;
+	ptpsim_set_config(&c);
+
+	struct PtpRuntime *r = ptp_new(PTP_USB);
+	int rc = ptp_device_init(r);
+	if (rc) return rc;
+	rc = ptp_open_session(r);
+	if (rc) return rc;
+	struct PtpDeviceInfo di;
+	rc = ptp_get_device_info(r, &di);
+	if (rc) return rc;
+	rc = ptp_liveview_init(r);
+	if (rc) return rc;
+
+	struct PtpLvFrame *frame;
+	assert(ptp_lv_stream_latest(r, &frame) == PTP_RUNTIME_ERR);
+
+	struct LvCallbackState st = {0};
+	rc = ptp_lv_stream_start(r, lv_callback, &st);
+	if (rc) return rc;
+	assert(ptp_lv_stream_start(r, NULL, NULL) == PTP_RUNTIME_ERR);
+
+	// Long enough for the interval estimate to come down to the camera's rate
+	uint64_t start = test_now_ms();
+	uint64_t last_seq = 0;
+	int seen = 0;
+	while (test_now_ms() - start < 1000) {
+		rc = ptp_lv_stream_latest(r, &frame);
+		assert(rc == 0 || rc == 1);
+		if (rc == 1) {
+			assert(frame != NULL && frame->seq > last_seq);
+			assert(frame->data[0] == 0xff && frame->data[1] == 0xd8);
+			last_seq = frame->seq;
+			seen++;
+		} else if (frame != NULL) {
+			assert(frame->seq == last_seq);
+		}
+		CAMLIB_SLEEP(1);
+	}
+	uint64_t elapsed = test_now_ms() - start;
+
+	struct PtpLvStreamInfo info;
+	ptp_lv_stream_info(r, &info);
+	// The sim never hands out frames faster than lv_fps, so polling in between has to hit NotReady
+	assert(info.frames >= 10);
+	assert(info.frames <= (elapsed + 100) * 60 / 1000 + 1);
+	assert(info.not_ready > 0);
+	assert(last_seq <= info.frames);
+	assert(info.dropped + seen <= info.frames);
+	// Taking frames every 1ms, hardly any should go unseen
+	assert(seen >= (int)info.frames / 2);
+	assert(info.interval_us > 0);
+
+	// Stop while the thread is inside the callback, stop has to wait it out
+	atomic_store(&st.hold, 1);
+	while (!atomic_load(&st.in_callback)) CAMLIB_SLEEP(1);
+	int calls = atomic_load(&st.calls);
+	ptp_lv_stream_stop(r);
+	assert(atomic_load(&st.in_callback) == 0);
+	assert(atomic_load(&st.calls) == calls + 1);
+	assert(ptp_lv_stream_latest(r, &frame) == PTP_RUNTIME_ERR);
+	assert(frame == NULL);
+
+	// The runtime is usable again afterwards
+	rc = ptp_liveview_deinit(r);
+	if (rc) return rc;
+
+	ptp_close_session(r);
+	ptp_device_close(r);
+	ptp_close(r);
+	free(r);
+
+	ptpsim_default_config(&c);
+	ptpsim_set_config(&c);
+	return 0;
+}
+
+int main() {
+	int rc;
+
+	rc = test_ip_read_boundary(PTP_IP);
+	printf("Return code: %d\n", rc);
+	if (rc) return rc;
+
+	rc = test_ip_read_boundary(PTP_IP_USB);
+	printf("Return code: %d\n", rc);
+	if (rc) return rc;
+
+	rc = test_usb_send_file();
+	printf("Return code: %d\n", rc);
+	if (rc) return rc;
+
+	rc = test_lv_stream();
+	printf("Return code: %d\n", rc);
+	if (rc) return rc;
+
+	return 0;
+}
@@ -1,10 +1,11 @@
 // Unit testing for camlib
-// Designed for vcam libusb spoofer
+// Designed for vcam libusb spoofer, or the built in simulator (make test-sim)
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <limits.h>
 #include <time.h>
 
 #include <camlib.h>
@@ -59,10 +60,341 @@ int ptp_vcam_magic() {
 
 	rc = ptp_eos_evproc_run(&r, "EnableBootDisk %d 'aasd'", 10);
 
+	// The limit can't go out of range, or under what r->data already holds
+	assert(ptp_set_buffer_limit(&r, 1) == PTP_RUNTIME_ERR);
+	assert(ptp_set_buffer_limit(&r, (size_t)INT_MAX + 1) == PTP_RUNTIME_ERR);
+	assert(ptp_set_buffer_limit(&r, (size_t)r.data_length - 1) == PTP_RUNTIME_ERR);
+	assert(ptp_set_buffer_limit(&r, (size_t)r.data_length) == 0);
+	assert(ptp_buffer_resize(&r, (size_t)r.data_length + 1) == PTP_OUT_OF_MEM);
+	assert(ptp_set_buffer_limit(&r, CAMLIB_MAX_BUFFER_SIZE) == 0);
+
+	ptp_close(&r);
+	return 0;
+}
+
+static int scan_codes(const uint16_t *codes, int length, int code) {
+	for (int i = 0; i < length; i++) {
+		if (codes[i] == code) return 1;
+	}
+	return 0;
+}
+
+// Put a fake data phase in r->data, as if a transaction had just read it
+static uint8_t *fake_data_phase(struct PtpRuntime *r, int length) {
+	assert(ptp_buffer_resize(r, 12 + length) == 0);
+	ptp_write_u32(r->data, 12 + length);
+	ptp_write_u16(r->data + 4, PTP_PACKET_TYPE_DATA);
+	ptp_write_u16(r->data + 6, 0);
+	ptp_write_u32(r->data + 8, 0);
+	return r->data + 12;
+}
+
+static int eos_entry(uint8_t *d, uint32_t size, uint32_t type) {
+	ptp_write_u32(d, size);
+	ptp_write_u32(d + 4, type);
+	return 8;
+}
+
+static void *try_lock_thread(void *arg) {
+	struct PtpRuntime *r = (struct PtpRuntime *)arg;
+	if (pthread_mutex_trylock(r->mutex)) return (void *)1;
+	pthread_mutex_unlock(r->mutex);
+	return NULL;
+}
+
+// The mutex is recursive, so this has to be checked from another thread
+static int locked_elsewhere(struct PtpRuntime *r) {
+	pthread_t t;
+	void *ret;
+	pthread_create(&t, NULL, try_lock_thread, r);
+	pthread_join(t, &ret);
+	return ret != NULL;
+}
+
+// Read the payload with the reader, then check ptp_eos_events gets the same entries.
+// Returns how many entries came out before the reader stopped.
+static int eos_read_all(struct PtpRuntime *r, int expect_end) {
+	struct PtpGenericEvent evs[16];
+	struct PtpEventReader e;
+	int n = 0, rc;
+	ptp_eos_events_open(r, &e);
+	assert(locked_elsewhere(r));
+	while ((rc = ptp_eos_events_next(r, &e, &evs[n])) == 1) {
+		n++;
+		assert(n < 16);
+	}
+	assert(rc == expect_end);
+	// Nothing more comes out once the reader stopped
+	assert(ptp_eos_events_next(r, &e, &evs[n]) == 0);
+	ptp_eos_events_close(r, &e);
+	assert(!locked_elsewhere(r));
+
+	struct PtpGenericEvent *p = NULL;
+	assert(ptp_eos_events(r, &p) == n);
+	assert(!locked_elsewhere(r));
+	for (int i = 0; i < n; i++) {
+		assert(p[i].code == evs[i].code && p[i].value == evs[i].value);
+		assert(p[i].name == evs[i].name && p[i].str_value == evs[i].str_value);
+	}
+	free(p);
+
+	return n;
+}
+
+// Hand made GetEvent payloads, good and bad
+int test_eos_events_crafted() {
+	struct PtpRuntime r;
+	ptp_init(&r);
+
+	char json[512];
+
+	// Well formed: two prop changes (one ImageFormat), a transfer request, an unknown entry, then the end
+	uint8_t *d = fake_data_phase(&r, 16 + 32 + 16 + 12 + 8);
+	d += eos_entry(d, 16, PTP_EC_EOS_PropValueChanged);
+	d += ptp_write_u32(d, PTP_PC_EOS_BatteryPower);
+	d += ptp_write_u32(d, 1);
+	d += eos_entry(d, 32, PTP_EC_EOS_PropValueChanged);
+	d += ptp_write_u32(d, PTP_PC_EOS_ImageFormat);
+	d += ptp_write_u32(d, 1);
+	d += ptp_write_u32(d, 16);
+	d += ptp_write_u32(d, 1);
+	d += ptp_write_u32(d, 0);
+	d += ptp_write_u32(d, 3);
+	d += eos_entry(d, 16, PTP_EC_EOS_RequestObjectTransfer);
+	d += ptp_write_u32(d, 0x1234);
+	d += ptp_write_u32(d, 5);
+	d += eos_entry(d, 12, 0xc1ff);
+	d += ptp_write_u32(d, 0);
+	d += eos_entry(d, 8, 0);
+	assert(eos_read_all(&r, 0) == 4);
+	char expect[128];
+	snprintf(expect, sizeof(expect), "[[\"battery\", 2],\n[\"image format\", %d],\n[\"request object transfer\", 5],\n]", IMG_FORMAT_HIGH);
+	ptp_eos_events_json(&r, json, sizeof(json));
+	assert(!strcmp(json, expect));
+
+	// Zero size entry
+	d = fake_data_phase(&r, 16);
+	eos_entry(d, 0, PTP_EC_EOS_PropValueChanged);
+	assert(eos_read_all(&r, PTP_CHECK_CODE) == 0);
+	ptp_eos_events_json(&r, json, sizeof(json));
+	assert(!strcmp(json, "[]"));
+	assert(!locked_elsewhere(&r));
+
+	// Second entry runs past the payload
+	d = fake_data_phase(&r, 16 + 16);
+	d += eos_entry(d, 16, PTP_EC_EOS_RequestObjectTransfer);
+	d += ptp_write_u32(d, 1);
+	d += ptp_write_u32(d, 2);
+	eos_entry(d, 24, PTP_EC_EOS_PropValueChanged);
+	assert(eos_read_all(&r, PTP_CHECK_CODE) == 1);
+	ptp_eos_events_json(&r, json, sizeof(json));
+	assert(!strcmp(json, "[[\"request object transfer\", 2],\n]"));
+	assert(!locked_elsewhere(&r));
+
+	// Payload cut off in the middle of a header
+	d = fake_data_phase(&r, 16 + 5);
+	d += eos_entry(d, 16, PTP_EC_EOS_RequestObjectTransfer);
+	d += ptp_write_u32(d, 1);
+	d += ptp_write_u32(d, 2);
+	assert(eos_read_all(&r, 0) == 1);
+
+	// PropValueChanged without room for the value
+	d = fake_data_phase(&r, 12);
+	d += eos_entry(d, 12, PTP_EC_EOS_PropValueChanged);
+	ptp_write_u32(d, PTP_PC_EOS_BatteryPower);
+	assert(eos_read_all(&r, PTP_CHECK_CODE) == 0);
+
+	// ImageFormat needs its 4 extra words
+	d = fake_data_phase(&r, 16);
+	d += eos_entry(d, 16, PTP_EC_EOS_PropValueChanged);
+	d += ptp_write_u32(d, PTP_PC_EOS_ImageFormat);
+	ptp_write_u32(d, 1);
+	assert(eos_read_all(&r, PTP_CHECK_CODE) == 0);
+
+	ptp_close(&r);
+	return 0;
+}
+
+static int vf_count_blocks(struct PtpRuntime *r, int expect_end) {
+	struct PtpEOSViewFinderIter it;
+	struct PtpEOSViewFinderBlock b;
+	ptp_eos_vf_iter(r, &it);
+	int n = 0, rc;
+	while ((rc = ptp_eos_vf_next(&it, &b)) == 1) n++;
+	assert(rc == expect_end);
+	return n;
+}
+
+// Hand made GetViewFinderData payloads
+int test_eos_vf_crafted() {
+	struct PtpRuntime r;
+	ptp_init(&r);
+
+	struct PtpEOSViewFinderBlock b;
+
+	// The JPEG comes after a metadata block, with one of the other type codes
+	uint8_t *start = fake_data_phase(&r, 16 + 12 + 4);
+	uint8_t *d = start;
+	d += ptp_write_u32(d, 16);
+	d += ptp_write_u32(d, 0x5);
+	d += ptp_write_u32(d, 0);
+	d += ptp_write_u32(d, 0);
+	d += ptp_write_u32(d, 12);
+	d += ptp_write_u32(d, PTP_EOS_VF_JPEG2);
+	d[0] = 0xff; d[1] = 0xd8; d[2] = 0xff; d[3] = 0xd9;
+	assert(ptp_eos_vf_find_jpeg(&r, &b) == 0);
+	assert(b.type == PTP_EOS_VF_JPEG2 && b.length == 4 && b.data == start + 24);
+	assert(ptp_eos_vf_find(&r, 0x5, &b) == 0);
+	assert(b.length == 8 && b.data == start + 8);
+	assert(ptp_eos_vf_find(&r, 0x6, &b) == PTP_CHECK_CODE);
+	// Trailing bytes too short for a header are ignored
+	assert(vf_count_blocks(&r, 0) == 2);
+
+	// No JPEG block at all
+	d = fake_data_phase(&r, 8 + 12);
+	d += ptp_write_u32(d, 8);
+	d += ptp_write_u32(d, 0x5);
+	d += ptp_write_u32(d, 12);
+	d += ptp_write_u32(d, 0x6);
+	assert(vf_count_blocks(&r, 0) == 2);
+	assert(ptp_eos_vf_find_jpeg(&r, &b) == PTP_CHECK_CODE);
+
+	// Empty payload
+	fake_data_phase(&r, 0);
+	assert(vf_count_blocks(&r, 0) == 0);
+	assert(ptp_eos_vf_find_jpeg(&r, &b) == PTP_CHECK_CODE);
+
+	// Block lengths under the header size
+	uint32_t short_lengths[] = {0, 4, 7};
+	for (int i = 0; i < 3; i++) {
+		d = fake_data_phase(&r, 16);
+		d += ptp_write_u32(d, short_lengths[i]);
+		d += ptp_write_u32(d, PTP_EOS_VF_JPEG);
+		assert(vf_count_blocks(&r, PTP_CHECK_CODE) == 0);
+		assert(ptp_eos_vf_find_jpeg(&r, &b) == PTP_CHECK_CODE);
+	}
+
+	// JPEG block runs past the payload
+	d = fake_data_phase(&r, 8 + 20);
+	d += ptp_write_u32(d, 8);
+	d += ptp_write_u32(d, 0x5);
+	d += ptp_write_u32(d, 100);
+	d += ptp_write_u32(d, PTP_EOS_VF_JPEG);
+	assert(vf_count_blocks(&r, PTP_CHECK_CODE) == 1);
+	assert(ptp_eos_vf_find_jpeg(&r, &b) == PTP_CHECK_CODE);
+
 	ptp_close(&r);
 	return 0;
 }
 
+// Every SIMD kernel this CPU can run must match the scalar loop byte for byte, at every length
+// around the kernels' block sizes, and must not touch anything past the end of either buffer
+int test_convert_rgb() {
+	const char *kernels[] = {"avx2", "ssse3", "neon"};
+	const int formats[] = {PTP_LV_FORMAT_RGBA, PTP_LV_FORMAT_BGRA};
+
+	uint8_t *expect = malloc(400 * 4 + 16);
+	uint8_t *got = malloc(400 * 4 + 16);
+	if (expect == NULL || got == NULL) return PTP_OUT_OF_MEM;
+
+	// Spot check the scalar path itself
+	const uint8_t px[3] = {1, 2, 3};
+	assert(ptp_liveview_rgb_kernel("scalar") == 0);
+	assert(ptp_liveview_convert_rgb(got, px, 1, PTP_LV_FORMAT_RGBA) == 4);
+	assert(got[0] == 1 && got[1] == 2 && got[2] == 3);
+	assert(ptp_liveview_convert_rgb(got, px, 1, PTP_LV_FORMAT_BGRA) == 4);
+	assert(got[0] == 3 && got[1] == 2 && got[2] == 1);
+
+	int tested = 0;
+	for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+		if (ptp_liveview_rgb_kernel(kernels[k])) continue;
+		tested++;
+
+		for (int pixels = 0; pixels < 400; pixels++) {
+			// Sized exactly, so reading past the end shows up under ASan
+			uint8_t *in = malloc(pixels * 3 + 1);
+			if (in == NULL) return PTP_OUT_OF_MEM;
+			for (int i = 0; i < pixels * 3; i++) {
+				in[i] = (uint8_t)(i * 31 + pixels);
+			}
+
+			for (int f = 0; f < 2; f++) {
+				memset(expect, 0xaa, 400 * 4 + 16);
+				memset(got, 0xaa, 400 * 4 + 16);
+
+				assert(ptp_liveview_rgb_kernel("scalar") == 0);
+				assert(ptp_liveview_convert_rgb(expect, in, pixels, formats[f]) == pixels * 4);
+				assert(ptp_liveview_rgb_kernel(kernels[k]) == 0);
+				assert(ptp_liveview_convert_rgb(got, in, pixels, formats[f]) == pixels * 4);
+
+				if (memcmp(expect, got, 400 * 4 + 16)) {
+					printf("%s kernel differs from scalar at %d pixels, format %d\n", kernels[k], pixels, formats[f]);
+					return PTP_RUNTIME_ERR;
+				}
+			}
+
+			free(in);
+		}
+	}
+	printf("Checked %d RGB kernels against scalar\n", tested);
+
+	assert(ptp_liveview_rgb_kernel("mmx") == PTP_UNSUPPORTED);
+	assert(ptp_liveview_rgb_kernel(NULL) == 0);
+
+	free(expect);
+	free(got);
+	return 0;
+}
+
+// The r->caps bitmaps must agree with r->di for every code, including ones outside their category
+static void test_caps(struct PtpRuntime *r, struct PtpDeviceInfo *di) {
+	for (int code = 0; code <= 0xffff; code++) {
+		assert(ptp_check_opcode(r, code) == scan_codes(di->ops_supported, di->ops_supported_length, code));
+		assert(ptp_check_prop(r, code) == scan_codes(di->props_supported, di->props_supported_length, code));
+		assert(ptp_check_event(r, code) == scan_codes(di->events_supported, di->events_supported_length, code));
+		assert(ptp_check_format(r, code) == (scan_codes(di->capture_formats, di->capture_formats_length, code)
+			|| scan_codes(di->playback_formats, di->playback_formats_length, code)));
+	}
+
+	assert(ptp_check_opcode(r, PTP_OC_GetDeviceInfo));
+	assert(ptp_check_opcode(r, PTP_OC_EOS_GetEvent));
+	assert(!ptp_check_opcode(r, 0x1fff));
+	assert(!ptp_check_opcode(r, 0x9fff));
+	assert(ptp_check_format(r, PTP_OF_JPEG));
+	assert(!ptp_check_format(r, 0x3fff));
+	assert(!ptp_check_prop(r, 0x5fff));
+	assert(!ptp_check_event(r, 0x4fff));
+}
+
+// The profile is worked out once, and again when r->di is swapped for another device info
+static void test_profile(struct PtpRuntime *r, struct PtpDeviceInfo *di) {
+	const struct PtpDeviceProfile *p = ptp_get_profile(r);
+	assert(p->vendor == PTP_DEV_EOS);
+	assert(p->event_method == PTP_EVENTS_EOS);
+	assert(p->ops != NULL && p->ops->set_prop_value != NULL);
+	assert(ptp_device_type(r) == PTP_DEV_EOS);
+
+	struct PtpDeviceInfo other;
+	memcpy(&other, di, sizeof(struct PtpDeviceInfo));
+	strcpy(other.manufacturer, "Nikon Corporation");
+	other.ops_supported_length = 1;
+	other.ops_supported[0] = PTP_OC_GetDeviceInfo;
+	r->di = &other;
+
+	assert(ptp_device_type(r) == PTP_DEV_NIKON);
+	assert(ptp_get_profile(r)->event_method == (other.events_supported_length ? PTP_EVENTS_STANDARD : PTP_EVENTS_NONE));
+	assert(!ptp_check_opcode(r, PTP_OC_EOS_GetEvent));
+
+	// Edited in place, so it has to be rebuilt by hand
+	other.ops_supported[other.ops_supported_length++] = PTP_OC_EOS_GetEvent;
+	ptp_update_caps(r);
+	assert(ptp_check_opcode(r, PTP_OC_EOS_GetEvent));
+
+	r->di = di;
+	assert(ptp_device_type(r) == PTP_DEV_EOS);
+	assert(ptp_get_profile(r)->event_method == PTP_EVENTS_EOS);
+}
+
 // Test case for EOS T6/1300D vcam
 int test_eos_t6() {
 	struct PtpRuntime r;
@@ -78,6 +410,9 @@ int test_eos_t6() {
 	ptp_device_info_json(&di, buffer, sizeof(buffer));
 	printf("%s\n", buffer);
 
+	test_caps(&r, &di);
+	test_profile(&r, &di);
+
 	if (ptp_device_type(&r) == PTP_DEV_EOS) {
 		ptp_eos_set_remote_mode(&r, 1);
 		ptp_eos_set_event_mode(&r, 1);
@@ -166,6 +501,30 @@ int test_props() {
 	ptp_read_string(pd.default_value, buffer, sizeof(buffer));
 	assert(!strcmp(buffer, "640x480"));
 
+	rc = ptp_prop_store_enable(&r);
+	if (rc) return rc;
+	rc = ptp_prop_store_refresh(&r, PTP_PC_BatteryLevel);
+	if (rc) return rc;
+	struct PtpProp prop;
+	assert(ptp_prop_store_get(&r, PTP_PC_BatteryLevel, &prop, NULL, 0) == 0);
+	assert(prop.value == 50);
+
+	// The first EOS poll reports every prop
+	uint32_t seq = ptp_prop_store_seq(&r);
+	rc = ptp_eos_get_event(&r);
+	if (rc) return rc;
+	int codes[64];
+	int changed = ptp_prop_store_changed(&r, seq, codes, 64);
+	assert(changed > 0);
+	assert(ptp_prop_store_get(&r, codes[0], &prop, NULL, 0) == 0);
+	assert(prop.seq == ptp_prop_store_seq(&r));
+
+	// Avail lists are copied into the caller's buffer, cut off at max
+	uint32_t avail[4];
+	assert(ptp_prop_store_get(&r, PTP_PC_EOS_Aperture, &prop, avail, 4) == 0);
+	assert(prop.avail == avail && prop.avail_length > 4);
+	assert(ptp_prop_store_get(&r, 0x5fff, &prop, avail, 4) == -1);
+
 	ptp_close(&r);
 	return 0;
 }
@@ -275,6 +634,112 @@ static int test_multithread() {
 	return 0;	
 }
 
+static void async_check_code(struct PtpRuntime *r, struct PtpAsyncRequest *req, void *arg) {
+	int *calls = (int *)arg;
+	assert(req->rc == PTP_CHECK_CODE);
+	assert(req->code == PTP_RC_OperationNotSupported);
+	// Response is still ours to read
+	assert(ptp_get_return_code(r) == PTP_RC_OperationNotSupported);
+	(*calls)++;
+}
+
+static int async_sleep(struct PtpRuntime *r, void *arg) {
+	usleep(100000);
+	return 0;
+}
+
+struct AsyncWaiter {
+	struct PtpRuntime *r;
+	struct PtpAsyncRequest *req;
+	int rc;
+};
+
+static void *async_waiter(void *arg) {
+	struct AsyncWaiter *w = (struct AsyncWaiter *)arg;
+	w->rc = ptp_async_wait(w->r, w->req);
+	return NULL;
+}
+
+// Stopping the worker while other threads are still waiting on it
+static void test_async_stop_waiting(struct PtpRuntime *r) {
+	assert(ptp_async_start(r) == 0);
+
+	struct PtpCommand cmd;
+	cmd.code = PTP_OC_GetStorageIDs;
+	cmd.param_length = 0;
+
+	struct AsyncWaiter w[2] = {
+		{r, ptp_async_call(r, PTP_PRIO_CONTROL, async_sleep, NULL, NULL, NULL), -1},
+		{r, ptp_async_submit(r, &cmd, NULL, 0, NULL, NULL), -1},
+	};
+
+	pthread_t th[2];
+	for (int i = 0; i < 2; i++) {
+		assert(w[i].req != NULL);
+		assert(pthread_create(&th[i], NULL, async_waiter, &w[i]) == 0);
+	}
+
+	// Both are blocked in ptp_async_wait, the first request is still running
+	usleep(20000);
+	ptp_async_stop(r);
+
+	for (int i = 0; i < 2; i++) {
+		pthread_join(th[i], NULL);
+		ptp_async_free(w[i].req);
+	}
+
+	assert(w[0].rc == 0);
+	assert(w[1].rc == PTP_CANCELED);
+	assert(ptp_async_submit(r, &cmd, NULL, 0, NULL, NULL) == NULL);
+}
+
+// A failed request still gets its response code, and leaves the runtime usable
+int test_async() {
+	struct PtpRuntime r;
+
+	int rc = test_setup_usb(&r);
+	if (rc) return rc;
+
+	rc = ptp_async_start(&r);
+	if (rc) return rc;
+
+	struct PtpCommand cmd;
+	cmd.code = 0x1fff;
+	cmd.param_length = 0;
+
+	int calls = 0;
+	for (int i = 0; i < 3; i++) {
+		ptp_async_submit(&r, &cmd, NULL, 0, async_check_code, &calls);
+	}
+
+	struct PtpAsyncRequest *req = ptp_async_submit(&r, &cmd, NULL, 0, NULL, NULL);
+	assert(ptp_async_wait(&r, req) == PTP_CHECK_CODE);
+	assert(req->code == PTP_RC_OperationNotSupported);
+	ptp_async_free(req);
+	assert(calls == 3);
+
+	cmd.code = PTP_OC_GetStorageIDs;
+	req = ptp_async_submit(&r, &cmd, NULL, 0, NULL, NULL);
+	assert(ptp_async_wait(&r, req) == 0);
+	assert(req->code == PTP_RC_OK);
+	assert(req->payload_length > 0);
+	ptp_async_free(req);
+
+	ptp_async_stop(&r);
+
+	test_async_stop_waiting(&r);
+
+	// The worker didn't leave the runtime locked
+	assert(pthread_mutex_trylock(r.mutex) == 0);
+	pthread_mutex_unlock(r.mutex);
+
+	rc = ptp_close_session(&r);
+	if (rc) return rc;
+
+	ptp_close(&r);
+	return 0;
+}
+
 int main() {
 	int rc;
 
@@ -302,5 +767,21 @@ int main() {
 	printf("Return code: %d\n", rc);
 	if (rc) return rc;
 
+	rc = test_async();
+	printf("Return code: %d\n", rc);
+	if (rc) return rc;
+
+	rc = test_eos_events_crafted();
+	printf("Return code: %d\n", rc);
+	if (rc) return rc;
+
+	rc = test_eos_vf_crafted();
+	printf("Return code: %d\n", rc);
+	if (rc) return rc;
+
+	rc = test_convert_rgb();
+	printf("Return code: %d\n", rc);
+	if (rc) return rc;
+
 	return 0;
 }